@@ -0,0 +1,68 @@
+#version 410 core
+
+// Vertex shader for the quadtree ocean (see OceanQuadtree.hpp). Every
+// selected node draws the same unit patch, placed by per-instance data. Each
+// vertex is then snapped to the grid of the LOD level its distance calls for
+// and morphed toward the next coarser grid, using only its world position, so
+// vertices shared by neighbouring nodes always land in the same place.
+
+layout(location = 0) in vec3 position; // unit patch, xz in [0, 1]
+layout(location = 1) in vec4 node;     // min corner x, z, side, level
+
+layout(std140) uniform FrameData
+{
+    mat4 MVP;
+    vec3 lightPos;
+    float time;
+    vec3 viewPos;
+};
+
+layout(std140) uniform MaterialData
+{
+    vec4 objectColor;
+    vec2 texOffset;
+    float texScale;
+    float innerTess;
+    float outerTess;
+    float adaptiveTess;
+    float pixelsPerEdge;
+    float maxDisplacement;
+    float projScale;
+    float choppy;
+};
+
+layout(std140) uniform LodData
+{
+    float lodRange0;  // level 0 is used up to this distance; it doubles per level
+    float morphStart; // fraction of each level's range where morphing starts
+    float gridUnit;   // vertex spacing of level 0
+    float maxLevel;
+};
+
+// Outputs to tess control shader
+out vec2 uv_vs;
+
+void main() {
+    vec2 world = node.xy + position.xz * node.z;
+
+    // Integer coordinates on the level 0 grid, identical for every node that
+    // shares this vertex.
+    ivec2 q = ivec2(round(world / gridUnit));
+    vec2 snapped = vec2(q) * gridUnit;
+
+    float d = distance(viewPos, vec3(snapped.x, 0.0, snapped.y));
+    int level = d < lodRange0 ? 0 : int(floor(log2(d / lodRange0))) + 1;
+    level = clamp(level, int(node.w), int(maxLevel));
+    float range = lodRange0 * exp2(float(level));
+    float morph = clamp((d / range - morphStart) / (1.0 - morphStart), 0.0, 1.0);
+
+    // This level's grid and the next one's. Shifts on signed ints round
+    // towards -infinity, so negative coordinates snap the same way.
+    vec2 fine = vec2((q >> level) << level);
+    vec2 coarse = vec2((q >> (level + 1)) << (level + 1));
+    vec2 xz = mix(fine, coarse, morph) * gridUnit;
+
+    // The tessellation stages expect world positions, like vertex.glsl
+    gl_Position = vec4(xz.x, 0.0, xz.y, 1.0);
+    uv_vs = (xz + texOffset + (time * 0.001))/texScale;
+}
@@ -0,0 +1,23 @@
+#version 410 core
+
+in vec2 corner;
+in float fade;
+
+out vec4 color_out;
+
+layout(std140) uniform FoamData
+{
+    mat4 VP;
+    vec4 right;
+    vec4 up;
+    vec4 color;
+};
+
+void main()
+{
+    // a soft round blob inside the quad
+    float a = (1.0 - dot(corner, corner)) * fade * color.a;
+    if (a <= 0.0)
+        discard;
+    color_out = vec4(color.rgb, a);
+}
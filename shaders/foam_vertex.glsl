@@ -0,0 +1,28 @@
+#version 410 core
+
+// Foam and spray sprites (see FoamRenderer.hpp): one instance per particle,
+// four vertices each, the corner taken from gl_VertexID.
+
+layout(location = 0) in float x;
+layout(location = 1) in float y;
+layout(location = 2) in float z;
+layout(location = 3) in float age; // 0 at birth, 1 at death
+
+layout(std140) uniform FoamData
+{
+    mat4 VP;
+    vec4 right; // w = sprite radius
+    vec4 up;
+    vec4 color;
+};
+
+out vec2 corner;
+out float fade;
+
+void main() {
+    corner = vec2(gl_VertexID & 1, gl_VertexID >> 1) * 2.0 - 1.0;
+    vec3 world = vec3(x, y, z) + (right.xyz * corner.x + up.xyz * corner.y) * right.w;
+    // quick fade in, slow fade out
+    fade = min(age * 10.0, 1.0) * (1.0 - age);
+    gl_Position = VP * vec4(world, 1.0);
+}
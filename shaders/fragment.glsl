@@ -1,16 +1,60 @@
 #version 410 core
 
 // Interpolated values from the geometry shader.
+#if defined(MULTI_VIEW) || defined(GEOMETRY_PASSTHROUGH)
+// The multi-view and pass-through geometry stages rename them (their inputs
+// already have these names); the multi-view ones also tag each triangle with
+// its view.
+in vec3 viewNormal;
+in vec3 viewWorldPos;
+#define gsNormal viewNormal
+#define gsWorldPos viewWorldPos
+#else
 in vec3 gsNormal;
 in vec3 gsWorldPos;
+#endif
+#ifdef MULTI_VIEW
+flat in int viewIndex;
+#endif
 
 // Final fragment color.
 out vec4 color_out;
 
 // Uniforms for lighting calculations.
-uniform vec3 lightPos;    
-uniform vec3 viewPos;     
-uniform vec4 objectColor; 
+layout(std140) uniform FrameData
+{
+    mat4 MVP;
+    vec3 lightPos;
+    float time;
+    vec3 viewPos;
+};
+
+layout(std140) uniform MaterialData
+{
+    vec4 objectColor;
+    vec2 texOffset;
+    float texScale;
+    float innerTess;
+    float outerTess;
+    float adaptiveTess;
+    float pixelsPerEdge;
+    float maxDisplacement;
+    float projScale;
+    float choppy;
+};
+
+#ifdef MULTI_VIEW
+#define MAX_VIEWS 8
+
+// Same view table as tess_control.glsl; the eye is per view.
+layout(std140) uniform ViewData
+{
+    mat4 viewMVP[MAX_VIEWS];
+    vec4 viewEye[MAX_VIEWS];
+    int viewCount;
+};
+#endif
+
 uniform sampler2D waterTexture;
 
 void main()
@@ -29,7 +73,11 @@ void main()
     // Normalize vectors
     vec3 normal = normalize(gsNormal);
     vec3 lightDir = normalize(lightPos - gsWorldPos);
+#ifdef MULTI_VIEW
+    vec3 viewDir = normalize(viewEye[viewIndex].xyz - gsWorldPos);
+#else
     vec3 viewDir = normalize(viewPos - gsWorldPos);
+#endif
     vec3 reflectDir = reflect(-lightDir, normal);
 
     // Calculate cosine terms
@@ -1,18 +1,71 @@
 #version 410 core
 
 layout (triangles) in;
+
+#ifdef MULTI_VIEW
+#define MAX_VIEWS 8
+// The triangle is displaced once and emitted to every view. Layout
+// qualifiers only take expressions from GLSL 4.40, so this is 3 * MAX_VIEWS
+// spelled out.
+layout (triangle_strip, max_vertices = 24) out;
+#else
 layout (triangle_strip, max_vertices = 3) out;
+#endif
 
 // Input from tess eval shader
 in vec2 uv_tes[];
 
 // Output to fragment shader
+#ifdef MULTI_VIEW
+out vec3 viewNormal;
+out vec3 viewWorldPos;
+flat out int viewIndex;
+#else
 out vec3 gsNormal;
 out vec3 gsWorldPos;
+#endif
+
+layout(std140) uniform FrameData
+{
+    mat4 MVP;
+    vec3 lightPos;
+    float time;
+    vec3 viewPos;
+};
+
+layout(std140) uniform MaterialData
+{
+    vec4 objectColor;
+    vec2 texOffset;
+    float texScale;
+    float innerTess;
+    float outerTess;
+    float adaptiveTess;
+    float pixelsPerEdge;
+    float maxDisplacement;
+    float projScale;
+    float choppy;
+};
+
+#ifdef MULTI_VIEW
+// Same view table as tess_control.glsl.
+layout(std140) uniform ViewData
+{
+    mat4 viewMVP[MAX_VIEWS];
+    vec4 viewEye[MAX_VIEWS];
+    int viewCount;
+};
+
+// True when the clip-space triangle lies outside one plane of the view.
+bool offscreen(vec4 a, vec4 b, vec4 c)
+{
+    return (a.x < -a.w && b.x < -b.w && c.x < -c.w) || (a.x > a.w && b.x > b.w && c.x > c.w) ||
+           (a.y < -a.w && b.y < -b.w && c.y < -c.w) || (a.y > a.w && b.y > b.w && c.y > c.w) ||
+           (a.z < -a.w && b.z < -b.w && c.z < -c.w) || (a.z > a.w && b.z > b.w && c.z > c.w);
+}
+#endif
 
-uniform mat4 MVP;
 uniform sampler2D distext;
-uniform float time;
 
 // Calculate a triangle’s normal from three positions.
 vec3 GetNormal(vec4 a, vec4 b, vec4 c)
@@ -22,30 +75,30 @@ vec3 GetNormal(vec4 a, vec4 b, vec4 c)
     return normalize(cross(x, y));
 }
 
+#define MAX_WAVES 64
+
+// The wave table, filled from the C++ side (see WaveUniforms in PlaneMesh.hpp).
+// Each wave has frequency w, amplitude A, phase multiplier phi, sharpness Q,
+// direction D and exponent N, stored pre-multiplied:
+// - waveK[i]: (w * D.x, w * D.y, phi, A)
+// - waveAmp[i]: (D.x * A * Qi, D.y * A * Qi) where Qi = w * A * (Q^N)
+layout(std140) uniform WaveData
+{
+    vec4 waveK[MAX_WAVES];
+    vec4 waveAmp[MAX_WAVES];
+    int waveCount;
+};
+
 // Gerstner wave function.
-// For a given world position, computes a displacement due to one wave.
-// Parameters:
-// - worldpos: the input world coordinate.
-// - w: wave frequency.
-// - A: amplitude.
-// - phi: phase multiplier.
-// - Q: sharpness factor (between 0 and 1).
-// - D: 2D direction vector for the wave.
-// - N: exponent controlling the influence of Q.
-vec3 Gerstner(vec3 worldpos, float w, float A, float phi, float Q, vec2 D, int N)
+// For a given world position, computes the displacement due to wave i.
+vec3 Gerstner(vec3 worldpos, int i)
 {
-    // Compute the effective sharpness value: Qi = w * A * (Q^N)
-    float Qi = w * A * pow(Q, float(N));
-    // Dot product between the wave direction and the (x,z) components.
-    float dotProduct = dot(D, worldpos.xz);
-    // Compute phase: frequency * dot + phase shift scaled by time.
-    float phase = w * dotProduct + phi * time;
+    // Compute phase: frequency * dot(D, xz) + phase shift scaled by time.
+    float phase = dot(waveK[i].xy, worldpos.xz) + waveK[i].z * time;
+    float c = cos(phase);
     // Displacements in x and z are scaled by Qi and the respective D components.
-    float dx = D.x * A * cos(phase) * Qi;
-    float dz = D.y * A * cos(phase) * Qi;
     // Vertical (y) displacement is given by the sine of the phase.
-    float dy = A * sin(phase);
-    return vec3(dx, dy, dz);
+    return vec3(waveAmp[i].x * c, waveK[i].w * sin(phase), waveAmp[i].y * c);
 }
 
 void main()
@@ -57,20 +110,43 @@ void main()
     {
         pos[i] = gl_in[i].gl_Position;
         
-        // Use the passed UVs to sample displacement
-        float disp = texture(distext, uv_tes[i]).r;
-        pos[i].y += disp;
-
-        // Add Gerstner waves
-        pos[i] += vec4(Gerstner(pos[i].xyz, 4.0, 0.08, 1.1, 0.75, vec2(0.3, 0.6), 4), 0.0);
-        pos[i] += vec4(Gerstner(pos[i].xyz, 2.0, 0.05, 1.1, 0.75, vec2(0.2, 0.866), 4), 0.0);
-        pos[i] += vec4(Gerstner(pos[i].xyz, 0.6, 0.2, 0.4, 0.1, vec2(0.3, 0.7), 4), 0.0);
-        pos[i] += vec4(Gerstner(pos[i].xyz, 0.9, 0.15, 0.4, 0.1, vec2(0.8, 0.1), 4), 0.0);
+        // Use the passed UVs to sample displacement: r is height, g and b
+        // the horizontal offsets when choppy is set
+        vec3 disp = texture(distext, uv_tes[i]).rgb;
+        pos[i].y += disp.r;
+        pos[i].xz += choppy * disp.gb;
+
+        // Add Gerstner waves, each seeing the result of the previous ones
+        for (int w = 0; w < waveCount; ++w)
+        {
+            pos[i] += vec4(Gerstner(pos[i].xyz, w), 0.0);
+        }
     }
 
     // Calculate normal for the triangle
     vec3 normal = GetNormal(pos[0], pos[1], pos[2]);
 
+#ifdef MULTI_VIEW
+    // Emit the triangle to each view that can see it
+    for (int v = 0; v < viewCount; ++v)
+    {
+        vec4 clip[3];
+        for (int i = 0; i < 3; ++i)
+            clip[i] = viewMVP[v] * pos[i];
+        if (offscreen(clip[0], clip[1], clip[2]))
+            continue;
+        for (int i = 0; i < 3; ++i)
+        {
+            viewWorldPos = pos[i].xyz;
+            viewNormal = normal;
+            viewIndex = v;
+            gl_ViewportIndex = v;
+            gl_Position = clip[i];
+            EmitVertex();
+        }
+        EndPrimitive();
+    }
+#else
     // Emit vertices
     for (int i = 0; i < 3; ++i)
     {
@@ -80,4 +156,5 @@ void main()
         EmitVertex();
     }
     EndPrimitive();
+#endif
 }
@@ -0,0 +1,38 @@
+#version 410 core
+
+in vec3 worldPos;
+in vec3 worldNormal;
+in vec2 texCoord;
+
+out vec4 color_out;
+
+layout(std140) uniform MeshData
+{
+    mat4 MVP;
+    mat4 model;
+    vec3 lightPos;
+    vec3 viewPos;
+};
+
+uniform sampler2D meshTexture;
+
+void main()
+{
+    vec4 LightColor = vec4(1.0, 1.0, 1.0, 1.0);
+    vec4 MaterialDiffuseColor = vec4(texture(meshTexture, texCoord).rgb, 1.0);
+    vec4 MaterialAmbientColor = vec4(0.3, 0.3, 0.3, 1.0) * MaterialDiffuseColor;
+    vec4 MaterialSpecularColor = vec4(0.2, 0.2, 0.2, 1.0);
+
+    vec3 normal = normalize(worldNormal);
+    vec3 lightDir = normalize(lightPos - worldPos);
+    vec3 viewDir = normalize(viewPos - worldPos);
+    vec3 reflectDir = reflect(-lightDir, normal);
+
+    float cosTheta = max(dot(normal, lightDir), 0.0);
+    float cosAlpha = max(dot(viewDir, reflectDir), 0.0);
+
+    color_out =
+        MaterialAmbientColor +
+        MaterialDiffuseColor * LightColor * cosTheta +
+        MaterialSpecularColor * LightColor * pow(cosAlpha, 8);
+}
@@ -0,0 +1,32 @@
+#version 410 core
+
+// Many copies of one mesh (see InstancedMesh.hpp): each instance brings its
+// own model matrix, MVP holds only the view-projection and model is unused.
+// Shares mesh_fragment.glsl.
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 uv;
+layout(location = 3) in mat4 instanceModel; // locations 3-6
+
+layout(std140) uniform MeshData
+{
+    mat4 MVP;
+    mat4 model;
+    vec3 lightPos;
+    vec3 viewPos;
+};
+
+// Outputs to fragment shader
+out vec3 worldPos;
+out vec3 worldNormal;
+out vec2 texCoord;
+
+void main() {
+    vec4 world = instanceModel * vec4(position, 1.0);
+    worldPos = world.xyz;
+    // Instances only rotate, translate and scale uniformly.
+    worldNormal = mat3(instanceModel) * normal;
+    texCoord = uv;
+    gl_Position = MVP * world;
+}
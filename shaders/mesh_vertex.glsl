@@ -0,0 +1,28 @@
+#version 410 core
+
+// Textured meshes loaded from PLY files (see TextureMesh.hpp).
+
+layout(location = 0) in vec3 position;
+layout(location = 1) in vec3 normal;
+layout(location = 2) in vec2 uv;
+
+layout(std140) uniform MeshData
+{
+    mat4 MVP;
+    mat4 model;
+    vec3 lightPos;
+    vec3 viewPos;
+};
+
+// Outputs to fragment shader
+out vec3 worldPos;
+out vec3 worldNormal;
+out vec2 texCoord;
+
+void main() {
+    worldPos = (model * vec4(position, 1.0)).xyz;
+    // The model matrix only scales uniformly, so it can transform normals too.
+    worldNormal = mat3(model) * normal;
+    texCoord = uv;
+    gl_Position = MVP * vec4(position, 1.0);
+}
@@ -0,0 +1,60 @@
+#version 410 core
+
+// Multi-view stage for the pipelines without a geometry shader (see
+// PlaneMesh::drawViews()). The tessellation evaluation shader has already
+// displaced each vertex once, in world space; one invocation per view
+// projects the triangle and sends it to that view's viewport.
+
+#define MAX_VIEWS 8
+
+layout(triangles, invocations = MAX_VIEWS) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+// Input from the tess eval shader (its gl_Position is ignored)
+in vec3 gsNormal[];
+in vec3 gsWorldPos[];
+
+// Output to fragment shader
+out vec3 viewNormal;
+out vec3 viewWorldPos;
+flat out int viewIndex;
+
+// Same view table as tess_control.glsl.
+layout(std140) uniform ViewData
+{
+    mat4 viewMVP[MAX_VIEWS];
+    vec4 viewEye[MAX_VIEWS];
+    int viewCount;
+};
+
+// True when the clip-space triangle lies outside one plane of the view.
+bool offscreen(vec4 a, vec4 b, vec4 c)
+{
+    return (a.x < -a.w && b.x < -b.w && c.x < -c.w) || (a.x > a.w && b.x > b.w && c.x > c.w) ||
+           (a.y < -a.w && b.y < -b.w && c.y < -c.w) || (a.y > a.w && b.y > b.w && c.y > c.w) ||
+           (a.z < -a.w && b.z < -b.w && c.z < -c.w) || (a.z > a.w && b.z > b.w && c.z > c.w);
+}
+
+void main()
+{
+    int v = gl_InvocationID;
+    if (v >= viewCount)
+        return;
+
+    vec4 clip[3];
+    for (int i = 0; i < 3; ++i)
+        clip[i] = viewMVP[v] * vec4(gsWorldPos[i], 1.0);
+    if (offscreen(clip[0], clip[1], clip[2]))
+        return;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        viewWorldPos = gsWorldPos[i];
+        viewNormal = gsNormal[i];
+        viewIndex = v;
+        gl_ViewportIndex = v;
+        gl_Position = clip[i];
+        EmitVertex();
+    }
+    EndPrimitive();
+}
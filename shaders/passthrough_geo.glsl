@@ -0,0 +1,30 @@
+#version 410 core
+
+// Empty geometry stage behind the pipelines that have none, only on Mesa's
+// llvmpipe (see tessNeedsGeometryStage() in PlaneMesh.hpp). There, a
+// tessellation evaluation shader feeding the rasterizer directly gets slower
+// much faster than the triangle count grows; forwarding each triangle
+// through here avoids that path.
+
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+// Input from the tess eval shader
+in vec3 gsNormal[];
+in vec3 gsWorldPos[];
+
+// Output to fragment shader
+out vec3 viewNormal;
+out vec3 viewWorldPos;
+
+void main()
+{
+    for (int i = 0; i < 3; ++i)
+    {
+        viewWorldPos = gsWorldPos[i];
+        viewNormal = gsNormal[i];
+        gl_Position = gl_in[i].gl_Position;
+        EmitVertex();
+    }
+    EndPrimitive();
+}
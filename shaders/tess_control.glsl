@@ -8,8 +8,134 @@ in vec2 uv_vs[];
 // Output to tess eval shader
 out vec2 uv_tcs[];
 
-uniform float outerTess;
-uniform float innerTess;
+layout(std140) uniform FrameData
+{
+    mat4 MVP;
+    vec3 lightPos;
+    float time;
+    vec3 viewPos;
+};
+
+layout(std140) uniform MaterialData
+{
+    vec4 objectColor;
+    vec2 texOffset;
+    float texScale;
+    float innerTess;
+    float outerTess;
+    float adaptiveTess;
+    float pixelsPerEdge;
+    float maxDisplacement;
+    float projScale;
+    float choppy;
+};
+
+#ifdef MULTI_VIEW
+#define MAX_VIEWS 8
+
+// Every view of PlaneMesh::drawViews() (see ViewUniforms in PlaneMesh.hpp);
+// viewEye[i].w is view i's projScale.
+layout(std140) uniform ViewData
+{
+    mat4 viewMVP[MAX_VIEWS];
+    vec4 viewEye[MAX_VIEWS];
+    int viewCount;
+};
+#endif
+
+#define MAX_TESS 64.0
+
+// Tessellation level for the edge a-b seen through M: enough segments that
+// each covers about pixelsPerEdge pixels, measured as the projected size of a
+// sphere with the edge as its diameter. It depends only on the two endpoints
+// (in a symmetric way), so the patches on both sides of an edge always agree
+// and no cracks open.
+float edgeLevel(mat4 M, float scale, vec3 a, vec3 b)
+{
+    float w = (M * vec4(0.5 * (a + b), 1.0)).w;
+    float pixels = distance(a, b) * scale / max(w, 1e-3);
+    return clamp(pixels / pixelsPerEdge, 1.0, MAX_TESS);
+}
+
+// The four outer levels, in gl_TessLevelOuter's order.
+vec4 outerLevels(mat4 M, float scale)
+{
+    // Outer edges for quads: 0 is p0-p3 (u = 0), 1 is p0-p1 (v = 0),
+    // 2 is p1-p2 (u = 1) and 3 is p3-p2 (v = 1).
+    vec3 p0 = gl_in[0].gl_Position.xyz;
+    vec3 p1 = gl_in[1].gl_Position.xyz;
+    vec3 p2 = gl_in[2].gl_Position.xyz;
+    vec3 p3 = gl_in[3].gl_Position.xyz;
+    return vec4(edgeLevel(M, scale, p0, p3), edgeLevel(M, scale, p0, p1),
+                edgeLevel(M, scale, p1, p2), edgeLevel(M, scale, p3, p2));
+}
+
+#ifdef MULTI_VIEW
+// True when the sphere around the edge a-b, grown by maxDisplacement, reaches
+// into M's frustum. It depends only on the edge, like edgeLevel().
+bool edgeInView(mat4 M, vec3 a, vec3 b)
+{
+    vec4 center = vec4(0.5 * (a + b), 1.0);
+    float radius = 0.5 * distance(a, b) + maxDisplacement;
+    mat4 rows = transpose(M);
+    for (int i = 0; i < 3; ++i) {
+        vec4 lower = rows[3] + rows[i];
+        vec4 upper = rows[3] - rows[i];
+        if (dot(lower, center) < -radius * length(lower.xyz) || dot(upper, center) < -radius * length(upper.xyz))
+            return false;
+    }
+    return true;
+}
+
+// The finest level any view that can see the edge asks for. A view the edge
+// is outside of (a side monitor looking across it, say) would otherwise see
+// it at w near 0 and ask for MAX_TESS.
+float viewsEdgeLevel(vec3 a, vec3 b)
+{
+    float level = 1.0;
+    for (int v = 0; v < viewCount; ++v)
+        if (edgeInView(viewMVP[v], a, b))
+            level = max(level, edgeLevel(viewMVP[v], viewEye[v].w, a, b));
+    return level;
+}
+
+vec4 viewsOuterLevels()
+{
+    vec3 p0 = gl_in[0].gl_Position.xyz;
+    vec3 p1 = gl_in[1].gl_Position.xyz;
+    vec3 p2 = gl_in[2].gl_Position.xyz;
+    vec3 p3 = gl_in[3].gl_Position.xyz;
+    return vec4(viewsEdgeLevel(p0, p3), viewsEdgeLevel(p0, p1),
+                viewsEdgeLevel(p1, p2), viewsEdgeLevel(p3, p2));
+}
+#endif
+
+// True when the patch, grown by the furthest the waves and displacement map
+// can move a point, lies entirely outside one of M's clip planes.
+bool outsideFrustum(mat4 M)
+{
+    vec3 lo = min(min(gl_in[0].gl_Position.xyz, gl_in[1].gl_Position.xyz),
+                  min(gl_in[2].gl_Position.xyz, gl_in[3].gl_Position.xyz)) - vec3(maxDisplacement);
+    vec3 hi = max(max(gl_in[0].gl_Position.xyz, gl_in[1].gl_Position.xyz),
+                  max(gl_in[2].gl_Position.xyz, gl_in[3].gl_Position.xyz)) + vec3(maxDisplacement);
+
+    // Count, per plane, how many box corners are outside it.
+    int left = 0, right = 0, bottom = 0, top = 0, front = 0, back = 0;
+    for (int i = 0; i < 8; ++i)
+    {
+        vec3 corner = vec3((i & 1) != 0 ? hi.x : lo.x,
+                           (i & 2) != 0 ? hi.y : lo.y,
+                           (i & 4) != 0 ? hi.z : lo.z);
+        vec4 c = M * vec4(corner, 1.0);
+        left += int(c.x < -c.w);
+        right += int(c.x > c.w);
+        bottom += int(c.y < -c.w);
+        top += int(c.y > c.w);
+        front += int(c.z < -c.w);
+        back += int(c.z > c.w);
+    }
+    return left == 8 || right == 8 || bottom == 8 || top == 8 || front == 8 || back == 8;
+}
 
 void main() {
     // Pass through the control point
@@ -17,7 +143,35 @@ void main() {
     uv_tcs[gl_InvocationID] = uv_vs[gl_InvocationID];
 
     // Only one invocation sets the tessellation levels
-    if (gl_InvocationID == 0) {
+    if (gl_InvocationID == 0 && adaptiveTess > 0.5) {
+#ifdef MULTI_VIEW
+        // Culled when no view sees the patch. Which views an edge's level
+        // comes from is decided per edge, not per patch, so the two patches
+        // sharing it still agree.
+        bool seen = false;
+        for (int v = 0; v < viewCount; ++v)
+            seen = seen || !outsideFrustum(viewMVP[v]);
+        vec4 outer = seen ? viewsOuterLevels() : vec4(0.0);
+#else
+        bool seen = !outsideFrustum(MVP);
+        vec4 outer = seen ? outerLevels(MVP, projScale) : vec4(0.0);
+#endif
+        if (!seen) {
+            // Zero outer levels discard the patch.
+            gl_TessLevelOuter[0] = 0.0;
+            gl_TessLevelOuter[1] = 0.0;
+            gl_TessLevelOuter[2] = 0.0;
+            gl_TessLevelOuter[3] = 0.0;
+            return;
+        }
+
+        gl_TessLevelOuter[0] = outer.x;
+        gl_TessLevelOuter[1] = outer.y;
+        gl_TessLevelOuter[2] = outer.z;
+        gl_TessLevelOuter[3] = outer.w;
+        gl_TessLevelInner[0] = max(outer.y, outer.w);
+        gl_TessLevelInner[1] = max(outer.x, outer.z);
+    } else if (gl_InvocationID == 0) {
         gl_TessLevelInner[0] = innerTess;
         gl_TessLevelInner[1] = innerTess;
         gl_TessLevelOuter[0] = outerTess;
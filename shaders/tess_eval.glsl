@@ -8,8 +8,13 @@ in vec2 uv_tcs[];
 // Output to geometry shader
 out vec2 uv_tes;
 
-uniform mat4 MVP;
-uniform sampler2D distext;
+layout(std140) uniform FrameData
+{
+    mat4 MVP;
+    vec3 lightPos;
+    float time;
+    vec3 viewPos;
+};
 
 void main() {
     // Interpolate positions
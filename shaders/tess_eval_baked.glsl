@@ -0,0 +1,85 @@
+#version 410 core
+
+// tess_eval_displace.glsl with the Gerstner waves read from a looped bake
+// (see WaveBake.hpp) instead of evaluated: five texture fetches per vertex
+// whatever the number of waves. Feeds fragment.glsl directly.
+
+layout(quads, equal_spacing, cw) in;
+
+// Input from tess control shader
+in vec2 uv_tcs[];
+
+// Output to fragment shader (same names geo.glsl uses)
+out vec3 gsNormal;
+out vec3 gsWorldPos;
+
+layout(std140) uniform FrameData
+{
+    mat4 MVP;
+    vec3 lightPos;
+    float time;
+    vec3 viewPos;
+};
+
+layout(std140) uniform MaterialData
+{
+    vec4 objectColor;
+    vec2 texOffset;
+    float texScale;
+    float innerTess;
+    float outerTess;
+    float adaptiveTess;
+    float pixelsPerEdge;
+    float maxDisplacement;
+    float projScale;
+    float choppy;
+};
+
+// Wave displacement over one loop: x/z over a tile, time along the third
+// axis, repeating on all three.
+uniform sampler3D waveBake;
+// (1 / tile size in world units, 1 / loop length in seconds)
+uniform vec2 bakeScale;
+
+uniform sampler2D distext;
+
+void main() {
+    // Interpolate positions
+    vec4 bottom = mix(gl_in[0].gl_Position, gl_in[1].gl_Position, gl_TessCoord.x);
+    vec4 top = mix(gl_in[3].gl_Position, gl_in[2].gl_Position, gl_TessCoord.x);
+    vec3 pos = mix(bottom, top, gl_TessCoord.y).xyz;
+
+    // Interpolate UVs
+    vec2 uv1 = mix(uv_tcs[0], uv_tcs[1], gl_TessCoord.x);
+    vec2 uv2 = mix(uv_tcs[3], uv_tcs[2], gl_TessCoord.x);
+    vec2 uv = mix(uv1, uv2, gl_TessCoord.y);
+
+    // Displacement map, plus its slope by central differences. uv moves by
+    // 1/texScale per world unit (see vertex.glsl). r is height; with choppy
+    // set, g and b move the point along x and z as well.
+    float h = 1.0 / float(textureSize(distext, 0).x);
+    vec3 scale = vec3(choppy, 1.0, choppy);
+    pos += texture(distext, uv).grb * scale;
+    vec3 dDdx = (texture(distext, uv + vec2(h, 0.0)).grb - texture(distext, uv - vec2(h, 0.0)).grb) * scale / (2.0 * h * texScale);
+    vec3 dDdz = (texture(distext, uv + vec2(0.0, h)).grb - texture(distext, uv - vec2(0.0, h)).grb) * scale / (2.0 * h * texScale);
+
+    // Partial derivatives of the displaced position with respect to the
+    // undisplaced x and z.
+    vec3 tx = vec3(1.0, 0.0, 0.0) + dDdx;
+    vec3 tz = vec3(0.0, 0.0, 1.0) + dDdz;
+
+    // The baked waves at this point, and their slope by central differences.
+    // The bake is a function of where the wave chain starts, so its slope
+    // chains onto the distext tangents.
+    vec3 b = vec3(pos.xz * bakeScale.x, time * bakeScale.y);
+    float hb = 1.0 / float(textureSize(waveBake, 0).x);
+    vec3 dWdx = (texture(waveBake, b + vec3(hb, 0.0, 0.0)).xyz - texture(waveBake, b - vec3(hb, 0.0, 0.0)).xyz) * bakeScale.x / (2.0 * hb);
+    vec3 dWdz = (texture(waveBake, b + vec3(0.0, hb, 0.0)).xyz - texture(waveBake, b - vec3(0.0, hb, 0.0)).xyz) * bakeScale.x / (2.0 * hb);
+    pos += texture(waveBake, b).xyz;
+    tx += dWdx * tx.x + dWdz * tx.z;
+    tz += dWdx * tz.x + dWdz * tz.z;
+
+    gsWorldPos = pos;
+    gsNormal = normalize(cross(tz, tx));
+    gl_Position = MVP * vec4(pos, 1.0);
+}
@@ -0,0 +1,58 @@
+#version 410 core
+
+// tess_eval_displace.glsl with the displacement and normal fetched from the
+// maps wave_compute.glsl filled this frame: two texture fetches per vertex
+// whatever the number of waves or the tessellation level. Feeds
+// fragment.glsl directly.
+
+layout(quads, equal_spacing, cw) in;
+
+// Input from tess control shader
+in vec2 uv_tcs[];
+
+// Output to fragment shader (same names geo.glsl uses)
+out vec3 gsNormal;
+out vec3 gsWorldPos;
+
+layout(std140) uniform FrameData
+{
+    mat4 MVP;
+    vec3 lightPos;
+    float time;
+    vec3 viewPos;
+};
+
+layout(std140) uniform MaterialData
+{
+    vec4 objectColor;
+    vec2 texOffset;
+    float texScale;
+    float innerTess;
+    float outerTess;
+    float adaptiveTess;
+    float pixelsPerEdge;
+    float maxDisplacement;
+    float projScale;
+    float choppy;
+};
+
+// Written by wave_compute.glsl; both cover texScale x texScale world units
+// and repeat. Displacement in xyz, then the displaced normal in xyz.
+uniform sampler2D waveDisplacement;
+uniform sampler2D waveNormal;
+
+void main() {
+    // Interpolate positions
+    vec4 bottom = mix(gl_in[0].gl_Position, gl_in[1].gl_Position, gl_TessCoord.x);
+    vec4 top = mix(gl_in[3].gl_Position, gl_in[2].gl_Position, gl_TessCoord.x);
+    vec3 pos = mix(bottom, top, gl_TessCoord.y).xyz;
+
+    // The maps are indexed by the undisplaced position; distext's uv
+    // scrolling is already in them.
+    vec2 m = pos.xz / texScale;
+    pos += texture(waveDisplacement, m).xyz;
+
+    gsWorldPos = pos;
+    gsNormal = normalize(texture(waveNormal, m).xyz);
+    gl_Position = MVP * vec4(pos, 1.0);
+}
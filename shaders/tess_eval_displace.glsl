@@ -0,0 +1,96 @@
+#version 410 core
+
+// Tessellation evaluation with the wave displacement done here, once per
+// generated vertex, instead of in geo.glsl once per triangle corner. Normals
+// are analytic (chain rule through every wave) rather than per-face, so no
+// geometry shader is needed: this feeds fragment.glsl directly.
+
+layout(quads, equal_spacing, cw) in;
+
+// Input from tess control shader
+in vec2 uv_tcs[];
+
+// Output to fragment shader (same names geo.glsl uses)
+out vec3 gsNormal;
+out vec3 gsWorldPos;
+
+layout(std140) uniform FrameData
+{
+    mat4 MVP;
+    vec3 lightPos;
+    float time;
+    vec3 viewPos;
+};
+
+layout(std140) uniform MaterialData
+{
+    vec4 objectColor;
+    vec2 texOffset;
+    float texScale;
+    float innerTess;
+    float outerTess;
+    float adaptiveTess;
+    float pixelsPerEdge;
+    float maxDisplacement;
+    float projScale;
+    float choppy;
+};
+
+#define MAX_WAVES 64
+
+// Same wave table as geo.glsl.
+layout(std140) uniform WaveData
+{
+    vec4 waveK[MAX_WAVES];
+    vec4 waveAmp[MAX_WAVES];
+    int waveCount;
+};
+
+uniform sampler2D distext;
+
+void main() {
+    // Interpolate positions
+    vec4 bottom = mix(gl_in[0].gl_Position, gl_in[1].gl_Position, gl_TessCoord.x);
+    vec4 top = mix(gl_in[3].gl_Position, gl_in[2].gl_Position, gl_TessCoord.x);
+    vec3 pos = mix(bottom, top, gl_TessCoord.y).xyz;
+
+    // Interpolate UVs
+    vec2 uv1 = mix(uv_tcs[0], uv_tcs[1], gl_TessCoord.x);
+    vec2 uv2 = mix(uv_tcs[3], uv_tcs[2], gl_TessCoord.x);
+    vec2 uv = mix(uv1, uv2, gl_TessCoord.y);
+
+    // Displacement map, plus its slope by central differences. uv moves by
+    // 1/texScale per world unit (see vertex.glsl). r is height; with choppy
+    // set, g and b move the point along x and z as well.
+    float h = 1.0 / float(textureSize(distext, 0).x);
+    vec3 scale = vec3(choppy, 1.0, choppy);
+    pos += texture(distext, uv).grb * scale;
+    vec3 dDdx = (texture(distext, uv + vec2(h, 0.0)).grb - texture(distext, uv - vec2(h, 0.0)).grb) * scale / (2.0 * h * texScale);
+    vec3 dDdz = (texture(distext, uv + vec2(0.0, h)).grb - texture(distext, uv - vec2(0.0, h)).grb) * scale / (2.0 * h * texScale);
+
+    // Partial derivatives of the displaced position with respect to the
+    // undisplaced x and z.
+    vec3 tx = vec3(1.0, 0.0, 0.0) + dDdx;
+    vec3 tz = vec3(0.0, 0.0, 1.0) + dDdz;
+
+    // Gerstner waves, each seeing the result of the previous ones.
+    for (int i = 0; i < waveCount; ++i)
+    {
+        float phase = dot(waveK[i].xy, pos.xz) + waveK[i].z * time;
+        float s = sin(phase);
+        float c = cos(phase);
+
+        // d(wave)/d(phase), then chain through d(phase)/dx and d(phase)/dz.
+        vec3 dGdPhase = vec3(-waveAmp[i].x * s, waveK[i].w * c, -waveAmp[i].y * s);
+        float phaseX = dot(waveK[i].xy, tx.xz);
+        float phaseZ = dot(waveK[i].xy, tz.xz);
+
+        pos += vec3(waveAmp[i].x * c, waveK[i].w * s, waveAmp[i].y * c);
+        tx += dGdPhase * phaseX;
+        tz += dGdPhase * phaseZ;
+    }
+
+    gsWorldPos = pos;
+    gsNormal = normalize(cross(tz, tx));
+    gl_Position = MVP * vec4(pos, 1.0);
+}
@@ -1,16 +1,49 @@
 #version 410 core
 
+#ifdef PROCEDURAL_GRID
+// No vertex buffers: vertex i is corner i % 4 of patch i / 4, in PlaneGrid's
+// order (see PlaneGrid.hpp), on a grid of gridQuads x gridQuads quads.
+uniform float gridMin;
+uniform float gridStep;
+uniform int gridQuads;
+#else
 layout(location = 0) in vec3 position;
+#endif
 
-uniform mat4 MVP;
-uniform float texScale;
-uniform vec2 texOffset;
-uniform float time;
+layout(std140) uniform FrameData
+{
+    mat4 MVP;
+    vec3 lightPos;
+    float time;
+    vec3 viewPos;
+};
+
+layout(std140) uniform MaterialData
+{
+    vec4 objectColor;
+    vec2 texOffset;
+    float texScale;
+    float innerTess;
+    float outerTess;
+    float adaptiveTess;
+    float pixelsPerEdge;
+    float maxDisplacement;
+    float projScale;
+    float choppy;
+};
 
 // Outputs to tess control shader
 out vec2 uv_vs;
 
 void main() {
+#ifdef PROCEDURAL_GRID
+    int quad = gl_VertexID >> 2;
+    int corner = gl_VertexID & 3;
+    // corners (i,j), (i,j+1), (i+1,j+1), (i+1,j)
+    ivec2 ij = ivec2(quad / gridQuads, quad % gridQuads) + ivec2(corner >> 1, ((corner + 1) >> 1) & 1);
+    vec3 position = vec3(gridMin + float(ij.x) * gridStep, 0.0, gridMin + float(ij.y) * gridStep);
+#endif
+
     // Pass the vertex position as a vec4 to the next stage
     gl_Position = vec4(position, 1.0);
     
@@ -0,0 +1,89 @@
+#version 430 core
+
+// Evaluates distext and the Gerstner waves once per frame over one tile of
+// texScale x texScale world units, for tess_eval_compute.glsl to fetch:
+// texel (i, j) of waveDisplacement holds how far the point
+// ((i + 0.5) / n, (j + 0.5) / n) * texScale moves, waveNormal its normal.
+// The same maths as tess_eval_displace.glsl, just not per generated vertex.
+// The waves must repeat over the tile (see tileGerstnerWaves()).
+
+layout(local_size_x = 8, local_size_y = 8) in;
+
+layout(rgba16f, binding = 0) writeonly uniform image2D waveDisplacement;
+layout(rgba16f, binding = 1) writeonly uniform image2D waveNormal;
+
+layout(std140) uniform FrameData
+{
+    mat4 MVP;
+    vec3 lightPos;
+    float time;
+    vec3 viewPos;
+};
+
+layout(std140) uniform MaterialData
+{
+    vec4 objectColor;
+    vec2 texOffset;
+    float texScale;
+    float innerTess;
+    float outerTess;
+    float adaptiveTess;
+    float pixelsPerEdge;
+    float maxDisplacement;
+    float projScale;
+    float choppy;
+};
+
+#define MAX_WAVES 64
+
+// Same wave table as geo.glsl.
+layout(std140) uniform WaveData
+{
+    vec4 waveK[MAX_WAVES];
+    vec4 waveAmp[MAX_WAVES];
+    int waveCount;
+};
+
+uniform sampler2D distext;
+
+void main() {
+    ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(waveDisplacement);
+    if (texel.x >= size.x || texel.y >= size.y)
+        return;
+
+    vec2 xz = (vec2(texel) + 0.5) / vec2(size) * texScale;
+    vec3 start = vec3(xz.x, 0.0, xz.y);
+    vec3 pos = start;
+    // as vertex.glsl computes it
+    vec2 uv = (start.xz + texOffset + time * 0.001) / texScale;
+
+    // Displacement map and its slope, as in tess_eval_displace.glsl.
+    float h = 1.0 / float(textureSize(distext, 0).x);
+    vec3 scale = vec3(choppy, 1.0, choppy);
+    pos += textureLod(distext, uv, 0.0).grb * scale;
+    vec3 dDdx = (textureLod(distext, uv + vec2(h, 0.0), 0.0).grb - textureLod(distext, uv - vec2(h, 0.0), 0.0).grb) * scale / (2.0 * h * texScale);
+    vec3 dDdz = (textureLod(distext, uv + vec2(0.0, h), 0.0).grb - textureLod(distext, uv - vec2(0.0, h), 0.0).grb) * scale / (2.0 * h * texScale);
+
+    vec3 tx = vec3(1.0, 0.0, 0.0) + dDdx;
+    vec3 tz = vec3(0.0, 0.0, 1.0) + dDdz;
+
+    // Gerstner waves, each seeing the result of the previous ones.
+    for (int i = 0; i < waveCount; ++i)
+    {
+        float phase = dot(waveK[i].xy, pos.xz) + waveK[i].z * time;
+        float s = sin(phase);
+        float c = cos(phase);
+
+        vec3 dGdPhase = vec3(-waveAmp[i].x * s, waveK[i].w * c, -waveAmp[i].y * s);
+        float phaseX = dot(waveK[i].xy, tx.xz);
+        float phaseZ = dot(waveK[i].xy, tz.xz);
+
+        pos += vec3(waveAmp[i].x * c, waveK[i].w * s, waveAmp[i].y * c);
+        tx += dGdPhase * phaseX;
+        tz += dGdPhase * phaseZ;
+    }
+
+    imageStore(waveDisplacement, texel, vec4(pos - start, 0.0));
+    imageStore(waveNormal, texel, vec4(normalize(cross(tz, tx)), 0.0));
+}
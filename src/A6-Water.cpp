@@ -18,9 +18,18 @@ using namespace glm;
 
 #include <iostream>
 #include <vector>
+#include <memory>
+#include <chrono>
+#include <string.h>
 
 #include "PlaneMesh.hpp"
+#include "SpectralOcean.hpp"
+#include "TextureMesh.hpp"
+#include "InstancedMesh.hpp"
+#include "Buoyancy.hpp"
+#include "FoamRenderer.hpp"
 #include "CamControls.hpp"
+#include "Headless.hpp"
 
 //////////////////////////////////////////////////////////////////////////////
 // Main
@@ -36,97 +45,441 @@ int main( int argc, char* argv[])
 	float xmin = -10;
 	float xmax = 10;
 
-	if (argc > 1 ) {
-		screenW = atoi(argv[1]);
+	// Render this many frames offscreen at a fixed 60 Hz clock and exit (0 = interactive).
+	int headlessFrames = 0;
+	// With --headless, write the last frame here as a PPM.
+	const char *dumpPath = NULL;
+	// Write a Chrome/Perfetto trace of every frame here on exit (enables profiling).
+	const char *tracePath = NULL;
+	// Print rolling per-zone timings every 300 frames and on exit.
+	bool printProfile = false;
+	// Wave table for the shaders and any CPU-side wave queries.
+	const char *seaStatePath = "assets/seastate.txt";
+	// Where the waves are evaluated: "geo" (geometry shader), "tes" (tessellation
+	// evaluation), "baked" (looked up in a looped bake of them, see WaveBake.hpp)
+	// or "compute" (into maps once per frame; GL 4.3, else "geo").
+	WaterPipeline pipeline = PIPELINE_GEOMETRY;
+	// Draw one fixed grid from xmin to xmax instead of the quadtree ocean around the camera.
+	bool fixedGrid = false;
+	// With --grid, rebuild the grid from gl_VertexID instead of vertex and index buffers.
+	bool proceduralGrid = false;
+	// Fixed tessellation level for every patch (0 = screen-space adaptive levels).
+	float fixedTess = 0;
+	// With adaptive levels: target edge length on screen, and an optional triangle budget.
+	float pixelsPerEdge = 8.0f;
+	long triangleBudget = 0;
+	// FFT ocean resolution (0 = the displacement BMP plus the sea state's Gerstner waves).
+	SpectralOceanParams fftParams;
+	fftParams.size = 0;
+	// Upload the FFT sea with glTexSubImage2D from client memory instead of the PBO streamer.
+	bool syncUpload = false;
+	// Instanced boats scattered around the origin, floating on the waves (0 = none).
+	int fleetSize = 0;
+	// Foam and spray particles where the waves fold (0 = none); the default
+	// sea is too gentle to fold, try --sea assets/seastate-storm.txt.
+	size_t foamCapacity = 0;
+	// Resolution, slice count and memory budget of the "baked" pipeline's bake.
+	WaveBakeSettings bakeSettings;
+	// Texels per side of the "compute" pipeline's maps.
+	int waveMapSize = WAVE_MAP_SIZE;
+	// Split the window into this many views: the camera, a top-down chart and
+	// side monitors. The water draws all of them in one pass (up to MAX_VIEWS).
+	int viewCount = 1;
+
+	// Flags can go anywhere; the rest are positional as before.
+	std::vector<char*> args;
+	for (int i = 1; i < argc; ++i) {
+		if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc) {
+			headlessFrames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--dump") == 0 && i + 1 < argc) {
+			dumpPath = argv[++i];
+		} else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+			tracePath = argv[++i];
+		} else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+			pipeline = parsePipeline(argv[++i]);
+		} else if (strcmp(argv[i], "--sea") == 0 && i + 1 < argc) {
+			seaStatePath = argv[++i];
+		} else if (strcmp(argv[i], "--tess") == 0 && i + 1 < argc) {
+			fixedTess = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--pixels-per-edge") == 0 && i + 1 < argc) {
+			pixelsPerEdge = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--tri-budget") == 0 && i + 1 < argc) {
+			triangleBudget = atol(argv[++i]);
+		} else if (strcmp(argv[i], "--fft") == 0 && i + 1 < argc) {
+			fftParams.size = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--wind") == 0 && i + 1 < argc) {
+			fftParams.windSpeed = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--spectrum") == 0 && i + 1 < argc) {
+			fftParams.spectrum = parseSpectrum(argv[++i]);
+		} else if (strcmp(argv[i], "--choppy") == 0 && i + 1 < argc) {
+			fftParams.choppiness = atof(argv[++i]);
+		} else if (strcmp(argv[i], "--fleet") == 0 && i + 1 < argc) {
+			fleetSize = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--bake-size") == 0 && i + 1 < argc) {
+			bakeSettings.size = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--bake-frames") == 0 && i + 1 < argc) {
+			bakeSettings.frames = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--bake-budget") == 0 && i + 1 < argc) {
+			bakeSettings.budgetBytes = (size_t)atoi(argv[++i]) << 20;
+		} else if (strcmp(argv[i], "--compute-size") == 0 && i + 1 < argc) {
+			waveMapSize = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--foam") == 0 && i + 1 < argc) {
+			foamCapacity = (size_t)atol(argv[++i]);
+		} else if (strcmp(argv[i], "--views") == 0 && i + 1 < argc) {
+			viewCount = atoi(argv[++i]);
+		} else if (strcmp(argv[i], "--sync-upload") == 0) {
+			syncUpload = true;
+		} else if (strcmp(argv[i], "--grid") == 0) {
+			fixedGrid = true;
+		} else if (strcmp(argv[i], "--procedural") == 0) {
+			proceduralGrid = true;
+		} else if (strcmp(argv[i], "--profile") == 0) {
+			printProfile = true;
+		} else {
+			args.push_back(argv[i]);
+		}
+	}
+
+	if (args.size() > 0) {
+		screenW = atoi(args[0]);
 	}
-	if (argc > 2) {
-		screenH = atoi(argv[2]);
+	if (args.size() > 1) {
+		screenH = atoi(args[1]);
 	}
-	if (argc > 3) {
-		stepsize = atof(argv[3]);
+	if (args.size() > 2) {
+		stepsize = atof(args[2]);
 	}
-	if (argc > 4) {
-		xmin = atof(argv[4]);
+	if (args.size() > 3) {
+		xmin = atof(args[3]);
 	}
-	if (argc > 5) {
-		xmax = atof(argv[5]);
+	if (args.size() > 4) {
+		xmax = atof(args[4]);
 	}
 
 	///////////////////////////////////////////////////////
 
-	// Initialise GLFW
-	if( !glfwInit() )
-	{
-		fprintf( stderr, "Failed to initialize GLFW\n" );
-		getchar();
-		return -1;
-	}
+	HeadlessContext headless;
+	if (headlessFrames > 0) {
+		if (!headless.create(screenW, screenH)) {
+			return -1;
+		}
+	} else {
+		// Initialise GLFW
+		if( !glfwInit() )
+		{
+			fprintf( stderr, "Failed to initialize GLFW\n" );
+			getchar();
+			return -1;
+		}
 
-	glfwWindowHint(GLFW_SAMPLES, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-	// glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-	// Open a window and create its OpenGL context
-	window = glfwCreateWindow( screenW, screenH, "Phong", NULL, NULL);
-	if( window == NULL ){
-		fprintf( stderr, "Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials.\n" );
-		getchar();
-		glfwTerminate();
-		return -1;
-	}
-	glfwMakeContextCurrent(window);
-
-	// Initialize GLEW
-	glewExperimental = true; // Needed for core profile
-	if (glewInit() != GLEW_OK) {
-		fprintf(stderr, "Failed to initialize GLEW\n");
-		getchar();
-		glfwTerminate();
-		return -1;
+		glfwWindowHint(GLFW_SAMPLES, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+		// glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE); // To make MacOS happy; should not be needed
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+		// Open a window and create its OpenGL context
+		window = glfwCreateWindow( screenW, screenH, "Phong", NULL, NULL);
+		if( window == NULL ){
+			fprintf( stderr, "Failed to open GLFW window. If you have an Intel GPU, they are not 3.3 compatible. Try the 2.1 version of the tutorials.\n" );
+			getchar();
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
+
+		// Initialize GLEW
+		glewExperimental = true; // Needed for core profile
+		if (glewInit() != GLEW_OK) {
+			fprintf(stderr, "Failed to initialize GLEW\n");
+			getchar();
+			glfwTerminate();
+			return -1;
+		}
 	}
 
-	PlaneMesh plane(xmin, xmax, stepsize);
+	// The scene lives in its own scope so every GL object is deleted while
+	// the context still exists, before glfwTerminate() below.
+	{
+		std::vector<GerstnerWave> waves = defaultGerstnerWaves();
+		loadSeaState(seaStatePath, waves);
+
+		// The FFT sea replaces both the BMP and the Gerstner waves.
+		std::unique_ptr<ThreadPool> pool;
+		std::unique_ptr<SpectralOcean> spectral;
+		if (fftParams.size > 0) {
+			if (fftParams.size & (fftParams.size - 1)) {
+				fprintf(stderr, "--fft needs a power of two, got %d\n", fftParams.size);
+				glfwTerminate();
+				return -1;
+			}
+			pool.reset(new ThreadPool());
+			spectral.reset(new SpectralOcean(fftParams, *pool));
+			waves.clear();
+		}
+
+		// The baked pipeline loops the waves; the looped ones then drive
+		// everything, the fleet included, so the boats ride the sea that's drawn.
+		WaveBake bake;
+		if (pipeline == PIPELINE_TESS_BAKED) {
+			if (waves.empty()) {
+				fprintf(stderr, "Nothing to bake without Gerstner waves\n");
+			} else {
+				if (!pool) {
+					pool.reset(new ThreadPool());
+				}
+				if (bake.bake(waves, bakeSettings, pool.get())) {
+					waves = bake.getWaves();
+					fprintf(stderr, "Baked %.1f s of waves in %.0f ms (%zu MB), speeds off by up to %.1f%%, directions %.1f%%\n",
+						bake.getPeriod(), bake.getBakeMs(), bake.getBytes() >> 20,
+						100.0f * bake.getTimeError(), 100.0f * bake.getSpaceError());
+				}
+			}
+		}
+
+		// The ocean's finest vertex spacing is the stepsize; xmin/xmax only apply to --grid.
+		OceanSettings oceanSettings;
+		oceanSettings.gridUnit = stepsize;
+		std::unique_ptr<PlaneMesh> planePtr(fixedGrid ? new PlaneMesh(xmin, xmax, stepsize, proceduralGrid, pool.get()) : new PlaneMesh(oceanSettings, pool.get()));
+		PlaneMesh &plane = *planePtr;
+		plane.setWaveBake(&bake);
+		plane.setWaveMapSize(waveMapSize);
+		plane.setPipeline(pipeline);
+		// The compute pipeline's maps repeat over the displacement map's tile,
+		// so the waves have to as well. Like the bake's, the tiled waves then
+		// drive the fleet too, so say how far they moved.
+		if (plane.getPipeline() == PIPELINE_TESS_COMPUTE && !waves.empty()) {
+			std::vector<GerstnerWave> tiled = tileGerstnerWaves(waves, plane.getMapTileSize());
+			fprintf(stderr, "Tiled the waves over %g units for the compute pipeline, wave vectors off by up to %.1f%%\n",
+				plane.getMapTileSize(), 100.0f * loopSpaceError(waves, tiled));
+			waves = tiled;
+		}
+		plane.setWaves(waves);
+		plane.setViewportHeight(screenH);
+		if (fixedTess > 0) {
+			plane.setTessLevels(fixedTess, fixedTess);
+		} else {
+			plane.setAdaptiveTess(pixelsPerEdge);
+			plane.setTriangleBudget(triangleBudget);
+		}
 	
-	//TextureMesh boat("Assets/boat.ply", "Assets/boat.bmp", 1);
-	//TextureMesh head("Assets/head.ply", "Assets/head.bmp", 1);
-	//TextureMesh eyes("Assets/eyes.ply", "Assets/eyes.bmp", 1);
+		TextureStreamer *seaStream = NULL;
+		if (spectral && !syncUpload) {
+			seaStream = plane.streamDisplacementMap(spectral->size(), fftParams.patchSize);
+		}
+
+		// The FFT writes straight into a streamer slot; draw() uploads it.
+		auto updateSea = [&](float t) {
+			if (!spectral)
+				return;
+			if (seaStream) {
+				void *slot = seaStream->acquire();
+				if (!slot)
+					return; // every slot is in flight, keep last frame's sea
+				{
+					PROFILE_CPU("fft");
+					spectral->update(t, (float *)slot);
+				}
+				seaStream->publish(slot);
+				plane.setDisplacementBound(spectral->maxDisplacement());
+			} else {
+				{
+					PROFILE_CPU("fft");
+					spectral->update(t);
+				}
+				plane.setDisplacementMap(spectral->displacement(), spectral->size(),
+					fftParams.patchSize, spectral->maxDisplacement());
+			}
+		};
 
-	// Ensure we can capture the escape key being pressed below
-	glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+		TextureMesh boat("assets/boat.ply", "assets/boat.bmp", 1);
+		TextureMesh head("assets/head.ply", "assets/head.bmp", 1);
+		TextureMesh eyes("assets/eyes.ply", "assets/eyes.bmp", 1);
+		// The fleet floats on the Gerstner waves (not the FFT sea), stepped at a
+		// fixed 60 Hz whatever the frame rate.
+		std::unique_ptr<InstancedMesh> fleet;
+		std::unique_ptr<WaveField> fleetWaves;
+		std::unique_ptr<BuoyancySystem> buoyancy;
+		if (fleetSize > 0) {
+			fleet.reset(new InstancedMesh("assets/boat.ply", "assets/boat.bmp"));
+			fleet->setTransforms(fleetLayout(fleetSize, 3.0f));
+		}
+		if (fleet && fleet->isLoaded()) {
+			const MeshGeometry &g = fleet->getGeometry();
+			if (!pool) {
+				pool.reset(new ThreadPool());
+			}
+			fleetWaves.reset(new WaveField(waves));
+			buoyancy.reset(new BuoyancySystem(*fleetWaves, *pool, BuoyancyHull::boat(g.boundsMin, g.boundsMax)));
+			buoyancy->addBodies(fleet->getTransforms());
+		}
+		auto updateFleet = [&](float t) {
+			if (buoyancy) {
+				PROFILE_CPU("buoyancy");
+				buoyancy->advanceTo(t);
+				buoyancy->writeTransforms(fleet->getTransforms());
+			}
+		};
 
-	// Dark blue background
-	glClearColor(0.2f, 0.2f, 0.3f, 0.0f);
-	// glColor4f(1.0f, 1.0f, 1.0f, 1.0f); // not working - old
+		// Foam is emitted from the Gerstner waves around the camera and drawn
+		// last, as it is blended.
+		std::unique_ptr<WaveField> foamWaves;
+		std::unique_ptr<FoamParticles> foam;
+		std::unique_ptr<FoamRenderer> foamRenderer;
+		if (foamCapacity > 0) {
+			if (waves.empty()) {
+				fprintf(stderr, "Foam needs Gerstner waves, there is none on the FFT sea\n");
+			} else {
+				if (!pool) {
+					pool.reset(new ThreadPool());
+				}
+				FoamSettings foamSettings;
+				foamSettings.capacity = foamCapacity;
+				foamWaves.reset(new WaveField(waves));
+				foam.reset(new FoamParticles(*foamWaves, foamSettings, pool.get()));
+				foamRenderer.reset(new FoamRenderer());
+			}
+		}
+		float lastFoamTime = 0.0f;
+		auto updateFoam = [&](const glm::mat4 &view, float t) {
+			if (foam) {
+				PROFILE_CPU("foam update");
+				glm::vec3 eye = glm::vec3(glm::inverse(view)[3]);
+				foam->setFocus(eye.x, eye.z);
+				// A stalled frame shouldn't fling the particles.
+				foam->update(t, std::min(std::max(t - lastFoamTime, 0.0f), 0.1f));
+				lastFoamTime = t;
+			}
+		};
 
-	glDisable(GL_CULL_FACE);
+		// Ensure we can capture the escape key being pressed below
+		if (window) {
+			glfwSetInputMode(window, GLFW_STICKY_KEYS, GL_TRUE);
+		}
 
-	glm::mat4 Projection = glm::perspective(glm::radians(45.0f), screenW/screenH, 0.001f, 1000.0f);
+		// Dark blue background
+		glClearColor(0.2f, 0.2f, 0.3f, 0.0f);
+		// glColor4f(1.0f, 1.0f, 1.0f, 1.0f); // not working - old
 
-	glm::mat4 V;
+		glDisable(GL_CULL_FACE);
 
-	glm::vec3 lightpos(5.0f, 30.0f, 5.0f);
-	glm::vec4 color1(1.0f, 1.0f, 1.0f, 1.0f);
+		glm::mat4 Projection = glm::perspective(glm::radians(45.0f), screenW/screenH, 0.001f, 1000.0f);
 
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
+		glm::mat4 V;
 
-	do{
-		// Clear the screen
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		glm::vec3 lightpos(5.0f, 30.0f, 5.0f);
+		glm::vec4 color1(1.0f, 1.0f, 1.0f, 1.0f);
 
-		cameraControlsGlobe(V, 5);
-		
-		plane.draw(lightpos, V, Projection);
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_LESS);
 
-		// Swap buffers
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		// With --views, layoutMonitorViews() tiles the window around the camera;
+		// the rest of the scene is drawn view by view.
+		std::vector<WaterView> views;
+		auto drawScene = [&](const glm::mat4 &view, float t) {
+			auto drawObjects = [&](const glm::mat4 &objectV, const glm::mat4 &objectP) {
+				boat.draw(lightpos, objectV, objectP);
+				head.draw(lightpos, objectV, objectP);
+				eyes.draw(lightpos, objectV, objectP);
+				if (fleet) {
+					fleet->draw(lightpos, objectV, objectP);
+				}
+				if (foam) {
+					foamRenderer->draw(*foam, objectV, objectP);
+				}
+			};
+			if (viewCount > 1) {
+				layoutMonitorViews(view, viewCount, (int)screenW, (int)screenH, views);
+				plane.drawViews(lightpos, views.data(), (int)views.size(), t);
+				for (const WaterView &v : views) {
+					glViewport(v.x, v.y, v.width, v.height);
+					drawObjects(v.V, v.P);
+				}
+				glViewport(0, 0, (int)screenW, (int)screenH);
+			} else {
+				plane.draw(lightpos, view, Projection, t);
+				drawObjects(view, Projection);
+			}
+		};
 
-	} // Check if the ESC key was pressed or the window was closed
-	while( glfwGetKey(window, GLFW_KEY_ESCAPE ) != GLFW_PRESS &&
-		   glfwWindowShouldClose(window) == 0 );
+		profiler().setEnabled(tracePath != NULL || printProfile);
+		int frameCount = 0;
+
+		if (headlessFrames > 0) {
+			// GLFW is never initialised in this mode, so time with the standard clock.
+			auto start = std::chrono::steady_clock::now();
+			for (int frame = 0; frame < headlessFrames; ++frame) {
+				float t = frame / 60.0f;
+				profiler().beginFrame();
+				PROFILE_CPU("frame");
+
+				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+				{
+					PROFILE_CPU("camera");
+					cameraOrbit(V, 5, t);
+				}
+				updateSea(t);
+				updateFleet(t);
+				updateFoam(V, t);
+				drawScene(V, t);
+			}
+			glFinish();
+			double elapsedMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+			printf("Rendered %d frames in %.1f ms (%.2f ms/frame)\n",
+				headlessFrames, elapsedMs, elapsedMs / headlessFrames);
+
+			if (dumpPath) {
+				headless.writePPM(dumpPath);
+			}
+			if (printProfile) {
+				profiler().printSummary(stderr);
+			}
+			if (tracePath) {
+				profiler().writeChromeTrace(tracePath);
+			}
+			return 0;
+		}
+
+		do{
+			profiler().beginFrame();
+			PROFILE_CPU("frame");
+
+			// Clear the screen
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+			{
+				PROFILE_CPU("camera");
+				cameraControlsGlobe(V, 5);
+			}
+
+			float t = (float)glfwGetTime();
+			updateSea(t);
+			updateFleet(t);
+			updateFoam(V, t);
+			drawScene(V, t);
+
+			// Swap buffers
+			{
+				PROFILE_CPU("swap");
+				glfwSwapBuffers(window);
+				glfwPollEvents();
+			}
+
+			if (printProfile && ++frameCount % 300 == 0) {
+				profiler().printSummary(stderr);
+			}
+
+		} // Check if the ESC key was pressed or the window was closed
+		while( glfwGetKey(window, GLFW_KEY_ESCAPE ) != GLFW_PRESS &&
+			   glfwWindowShouldClose(window) == 0 );
+
+		if (printProfile) {
+			profiler().printSummary(stderr);
+		}
+		if (tracePath) {
+			profiler().writeChromeTrace(tracePath);
+		}
+	}
 
 	// Close OpenGL window and terminate GLFW
 	glfwTerminate();
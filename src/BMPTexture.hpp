@@ -0,0 +1,126 @@
+#ifndef BMP_TEXTURE_HPP
+#define BMP_TEXTURE_HPP
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <vector>
+#include <string.h>
+#include <GL/glew.h>
+
+#include "LoadBMP.hpp"
+#include "GLState.hpp"
+#include "ThreadPool.hpp"
+
+// Uploads a mapped BMP as a new repeating, mipmapped texture, reading the
+// pixels straight out of the mapping: BMP rows are padded to four bytes,
+// which is GL's default unpack alignment. Greyscale 8 bpp images become
+// single-channel textures that read back as (v, v, v, 1).
+GLuint uploadBMPTexture(const BMPImage &img, const char *imagePath)
+{
+	GLint maxSize = 0;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+	if (img.width > (unsigned)maxSize || img.height > (unsigned)maxSize)
+	{
+		std::cerr << imagePath << " is " << img.width << "x" << img.height
+				  << ", larger than GL_MAX_TEXTURE_SIZE " << maxSize << std::endl;
+		return 0;
+	}
+
+	GLenum internalFormat = GL_RGB8, format = GL_BGR;
+	const unsigned char *pixels = img.pixels;
+	size_t stride = img.rowStride;
+	std::vector<unsigned char> expanded;
+	if (img.bitsPerPixel == 32)
+	{
+		internalFormat = GL_RGBA8;
+		format = GL_BGRA;
+	}
+	else if (img.bitsPerPixel == 8 && img.isGreyscale())
+	{
+		internalFormat = GL_R8;
+		format = GL_RED;
+	}
+	else if (img.bitsPerPixel == 8)
+	{
+		// A real palette: the only case that needs a copy.
+		stride = ((size_t)img.width * 3 + 3) & ~(size_t)3;
+		expanded.resize(stride * img.height);
+		for (size_t y = 0; y < img.height; ++y)
+		{
+			const unsigned char *src = img.pixels + y * img.rowStride;
+			unsigned char *dst = expanded.data() + y * stride;
+			for (size_t x = 0; x < img.width; ++x)
+				memcpy(dst + 3 * x, img.palette + 4 * std::min((unsigned)src[x], img.paletteSize - 1), 3);
+		}
+		pixels = expanded.data();
+	}
+
+	GLuint textureID;
+	glGenTextures(1, &textureID);
+	glState().bindTexture(0, GL_TEXTURE_2D, textureID);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	if (format == GL_RED)
+	{
+		GLint grey[4] = {GL_RED, GL_RED, GL_RED, GL_ONE};
+		glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, grey);
+	}
+
+	if (!img.topDown)
+	{
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, img.width, img.height, 0, format, GL_UNSIGNED_BYTE, pixels);
+	}
+	else
+	{
+		// GL wants the bottom row first; feed the rows in reverse, still
+		// straight from the mapping.
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, img.width, img.height, 0, format, GL_UNSIGNED_BYTE, NULL);
+		for (size_t y = 0; y < img.height; ++y)
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, (GLint)(img.height - 1 - y), img.width, 1, format, GL_UNSIGNED_BYTE,
+							pixels + y * stride);
+	}
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glState().bindTexture(0, GL_TEXTURE_2D, 0);
+	return textureID;
+}
+
+// Loads several BMPs into textures: the files are mapped, validated and read
+// ahead on the pool's threads (on this one without a pool), then uploaded
+// here on the GL thread. ids[i] is 0 where a file couldn't be loaded.
+void loadTexturesFromBMP(const char *const *imagePaths, GLuint *ids, int count, ThreadPool *pool = nullptr)
+{
+	std::vector<std::unique_ptr<MappedBMP>> files(count);
+	auto mapFile = [&](size_t i, unsigned)
+	{
+		files[i].reset(new MappedBMP(imagePaths[i]));
+		files[i]->prefetch();
+	};
+	if (pool)
+		pool->parallelFor(count, mapFile);
+	else
+		for (int i = 0; i < count; ++i)
+			mapFile(i, 0);
+
+	for (int i = 0; i < count; ++i)
+	{
+		ids[i] = 0;
+		if (files[i]->isOpen())
+			ids[i] = uploadBMPTexture(files[i]->image(), imagePaths[i]);
+		if (!ids[i])
+			std::cerr << "Failed to load BMP: " << imagePaths[i] << std::endl;
+	}
+}
+
+GLuint loadTextureFromBMP(const char *imagePath)
+{
+	MappedBMP file(imagePath);
+	GLuint id = file.isOpen() ? uploadBMPTexture(file.image(), imagePath) : 0;
+	if (!id)
+		std::cerr << "Failed to load BMP: " << imagePath << std::endl;
+	return id;
+}
+
+#endif
@@ -0,0 +1,939 @@
+// Benchmark driver: renders the water offscreen along a scripted camera path
+// with a fixed simulated clock, sweeps the settings that matter and prints
+// one CSV row per configuration.
+//
+//   ./build/bench [--suite grid|waves|pipeline|adaptive|ocean|fft|upload|shaders|instances|buoyancy|query|bake|procedural|foam|views]
+//                 [--frames N] [--warmup N]
+//                 [--size WxH] [--steps a,b,..] [--domains a,b,..] [--tess a,b,..]
+//                 [--waves a,b,..] [--pixels a,b,..] [--worlds a,b,..]
+//                 [--fft-sizes a,b,..] [--threads a,b,..] [--instances a,b,..]
+//                 [--bodies a,b,..] [--queries a,b,..] [--bake-sizes a,b,..]
+//                 [--particles a,b,..] [--views a,b,..] [--out file.csv]
+//
+// Suites:
+//   grid      stepsize x domain x tessellation level
+//   waves     wave count (generated sea states) x tessellation level
+//   pipeline  geometry-shader vs tess-eval vs baked vs compute-pass displacement
+//             x tessellation level
+//   adaptive  fixed tessellation levels vs screen-space levels (pixels per edge)
+//   ocean     quadtree ocean size x stepsize, with the CPU node selection time
+//   fft       Tessendorf FFT ocean resolution x worker threads, with the CPU update time
+//   upload    FFT ocean texture upload: synchronous glTexSubImage2D vs the PBO streamer
+//   shaders   program build time from source, into an empty binary cache and from it
+//   instances fleet of boats: one instanced, frustum-culled draw vs one draw per boat
+//   buoyancy  fixed-step buoyancy of a fleet x worker threads (CPU only)
+//   query     surface height queries x Newton iterations x worker threads, with
+//             and without the displacement map (CPU only)
+//   bake      wave count x live tess-eval waves vs the looped bake at each
+//             bake size x tessellation level, with the bake time and size
+//   procedural fixed grid from vertex and index buffers vs from gl_VertexID,
+//             stepsize x domain x tessellation level
+//   foam      foam and spray particle pool size x worker threads, with the
+//             surface sampling and particle update times
+//   views     view count x surface (fixed grid, quadtree ocean) x pipeline x
+//             level: one multi-view pass vs one draw per view
+//
+// Frame times are wall-clock per frame with a glFinish() at the end of each
+// frame, so they include the (software or hardware) GPU work. GPU time comes
+// from GL_TIME_ELAPSED queries and triangle counts from GL_PRIMITIVES_GENERATED.
+
+// Include standard headers
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmath>
+
+#include <GL/glew.h>
+
+// Include GLFW
+#include <GLFW/glfw3.h>
+// CamControls.hpp refers to it; the benchmark never opens a window.
+GLFWwindow* window = NULL;
+
+// Include GLM
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+using namespace glm;
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "PlaneMesh.hpp"
+#include "InstancedMesh.hpp"
+#include "Buoyancy.hpp"
+#include "SurfaceQuery.hpp"
+#include "FoamRenderer.hpp"
+#include "SpectralOcean.hpp"
+#include "CamControls.hpp"
+#include "Headless.hpp"
+
+struct BenchOptions
+{
+	std::string suite = "grid";
+	int frames = 120;
+	int warmup = 10;
+	int width = 512;
+	int height = 512;
+	std::vector<float> steps = {1.0f, 0.5f};
+	std::vector<float> domains = {10.0f, 20.0f}; // half-extent: the grid spans [-d, d]
+	std::vector<float> tess = {16.0f, 32.0f, 64.0f};
+	std::vector<float> waves = {4.0f, 8.0f, 16.0f, 32.0f, 64.0f};
+	std::vector<float> pixels = {4.0f, 8.0f, 16.0f};
+	std::vector<float> worlds = {1000.0f, 100000.0f}; // side of the quadtree ocean
+	std::vector<float> fftSizes = {128.0f, 256.0f, 512.0f};
+	std::vector<float> threads = {1.0f, 0.0f}; // 0 = one per hardware thread
+	std::vector<float> instances = {1000.0f, 10000.0f};
+	std::vector<float> bodies = {10000.0f, 50000.0f};
+	std::vector<float> queries = {1000000.0f};
+	std::vector<float> bakeSizes = {128.0f, 256.0f};
+	std::vector<float> particles = {100000.0f, 1000000.0f};
+	std::vector<float> views = {1.0f, 2.0f, 4.0f, 8.0f};
+	const char *outPath = NULL;
+};
+
+static std::vector<float> parseList(const char *s)
+{
+	std::vector<float> values;
+	while (*s)
+	{
+		char *end;
+		values.push_back(strtof(s, &end));
+		if (end == s)
+			break;
+		s = (*end == ',') ? end + 1 : end;
+	}
+	return values;
+}
+
+// Nearest-rank percentile, p in [0, 100].
+static double percentile(std::vector<double> v, double p)
+{
+	if (v.empty())
+		return 0.0;
+	std::sort(v.begin(), v.end());
+	size_t rank = (size_t)std::ceil(p / 100.0 * v.size());
+	return v[rank > 0 ? rank - 1 : 0];
+}
+
+static double mean(const std::vector<double> &v)
+{
+	double sum = 0.0;
+	for (double x : v)
+		sum += x;
+	return v.empty() ? 0.0 : sum / v.size();
+}
+
+struct FrameSamples
+{
+	std::vector<double> cpuMs;
+	std::vector<double> gpuMs;
+	GLuint64 primitives = 0; // per frame, from the last measured frame
+};
+
+// Draws warmup + frames frames with the scripted camera. fn(V, t) issues the
+// draw calls for one frame.
+template <typename DrawFn>
+static FrameSamples runFrames(const BenchOptions &opt, DrawFn fn)
+{
+	GLuint queries[2];
+	glGenQueries(2, queries);
+
+	FrameSamples samples;
+	glm::mat4 V;
+	for (int frame = 0; frame < opt.warmup + opt.frames; ++frame)
+	{
+		float t = frame / 60.0f;
+		bool measured = frame >= opt.warmup;
+
+		auto start = std::chrono::steady_clock::now();
+		glBeginQuery(GL_TIME_ELAPSED, queries[0]);
+		glBeginQuery(GL_PRIMITIVES_GENERATED, queries[1]);
+
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		cameraOrbit(V, 5, t);
+		fn(V, t);
+
+		glEndQuery(GL_PRIMITIVES_GENERATED);
+		glEndQuery(GL_TIME_ELAPSED);
+		glFinish();
+		auto end = std::chrono::steady_clock::now();
+
+		if (measured)
+		{
+			GLuint64 gpuNs = 0;
+			glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &gpuNs);
+			glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &samples.primitives);
+			samples.cpuMs.push_back(std::chrono::duration<double, std::milli>(end - start).count());
+			samples.gpuMs.push_back(gpuNs / 1.0e6);
+		}
+	}
+
+	glDeleteQueries(2, queries);
+	return samples;
+}
+
+static const char *statsHeader =
+	"patches,triangles,frames,cpu_p50_ms,cpu_p90_ms,cpu_p99_ms,cpu_max_ms,gpu_mean_ms,"
+	"patches_per_s,triangles_per_s";
+
+static void printStats(FILE *out, const BenchOptions &opt, const FrameSamples &s, GLsizei patches)
+{
+	double frameS = mean(s.cpuMs) / 1000.0;
+	fprintf(out, "%d,%llu,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.0f,%.0f\n",
+			(int)patches, (unsigned long long)s.primitives, opt.frames,
+			percentile(s.cpuMs, 50), percentile(s.cpuMs, 90), percentile(s.cpuMs, 99),
+			percentile(s.cpuMs, 100), mean(s.gpuMs),
+			patches / frameS, s.primitives / frameS);
+	fflush(out);
+}
+
+static glm::mat4 benchProjection(const BenchOptions &opt)
+{
+	return glm::perspective(glm::radians(45.0f), (float)opt.width / opt.height, 0.001f, 1000.0f);
+}
+
+static const glm::vec3 benchLight(5.0f, 30.0f, 5.0f);
+
+// Grid resolution, domain size and tessellation level sweep over PlaneMesh::draw.
+static void suiteGrid(const BenchOptions &opt, FILE *out)
+{
+	glm::mat4 P = benchProjection(opt);
+	fprintf(out, "stepsize,domain,tess,%s\n", statsHeader);
+
+	for (float step : opt.steps)
+	{
+		for (float domain : opt.domains)
+		{
+			PlaneMesh plane(-domain, domain, step);
+			for (float tess : opt.tess)
+			{
+				plane.setTessLevels(tess, tess);
+				FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+										   { plane.draw(benchLight, V, P, t); });
+				fprintf(out, "%g,%g,%g,", step, domain, tess);
+				printStats(out, opt, s, plane.numPatches());
+			}
+		}
+	}
+}
+
+// Frame time against the number of waves in the sea state, on the first
+// stepsize/domain given.
+static void suiteWaves(const BenchOptions &opt, FILE *out)
+{
+	glm::mat4 P = benchProjection(opt);
+	fprintf(out, "waves,tess,%s\n", statsHeader);
+
+	PlaneMesh plane(-opt.domains[0], opt.domains[0], opt.steps[0]);
+	for (float count : opt.waves)
+	{
+		plane.setWaves(generateSeaState((int)count));
+		for (float tess : opt.tess)
+		{
+			plane.setTessLevels(tess, tess);
+			FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+									   { plane.draw(benchLight, V, P, t); });
+			fprintf(out, "%d,%g,", (int)count, tess);
+			printStats(out, opt, s, plane.numPatches());
+		}
+	}
+}
+
+// The fixed grid drawn from its vertex and index buffers against the same
+// grid rebuilt from gl_VertexID, for each stepsize, domain and tessellation
+// level. setup_ms is building and uploading the grid alone; grid_kb what its
+// buffers take.
+static void suiteProcedural(const BenchOptions &opt, FILE *out)
+{
+	glm::mat4 P = benchProjection(opt);
+	fprintf(out, "stepsize,domain,mode,setup_ms,grid_kb,tess,%s\n", statsHeader);
+
+	for (float step : opt.steps)
+	{
+		for (float domain : opt.domains)
+		{
+			for (int procedural = 0; procedural < 2; ++procedural)
+			{
+				PlaneMesh plane(-domain, domain, step, procedural != 0);
+				for (float tess : opt.tess)
+				{
+					plane.setTessLevels(tess, tess);
+					FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+											   { plane.draw(benchLight, V, P, t); });
+					fprintf(out, "%g,%g,%s,%.3f,%.1f,%g,", step, domain, procedural ? "procedural" : "buffers",
+							plane.getGridSetupMs(), plane.gridBytes() / 1024.0, tess);
+					printStats(out, opt, s, plane.numPatches());
+				}
+			}
+		}
+	}
+}
+
+// Displacement in geo.glsl (per triangle corner) against tess_eval_displace.glsl
+// (per vertex, no geometry stage), tess_eval_baked.glsl (looked up in the
+// default bake) and tess_eval_compute.glsl (fetched from maps wave_compute.glsl
+// fills each frame, GL 4.3 only), on the first stepsize/domain given. Every
+// pipeline draws the looped default waves, which also tile the compute maps,
+// so they all displace the same sea.
+static void suitePipeline(const BenchOptions &opt, FILE *out)
+{
+	glm::mat4 P = benchProjection(opt);
+	fprintf(out, "pipeline,tess,%s\n", statsHeader);
+
+	ThreadPool pool;
+	WaveBake bake;
+	if (!bake.bake(defaultGerstnerWaves(), WaveBakeSettings(), &pool))
+		return;
+	PlaneMesh plane(-opt.domains[0], opt.domains[0], opt.steps[0]);
+	plane.setWaves(bake.getWaves());
+	plane.setWaveBake(&bake);
+	for (float tess : opt.tess)
+	{
+		for (int p = 0; p < PIPELINE_COUNT; ++p)
+		{
+			if (p == PIPELINE_TESS_COMPUTE && !computeShadersSupported())
+				continue;
+			plane.setPipeline((WaterPipeline)p);
+			plane.setTessLevels(tess, tess);
+			FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+									   { plane.draw(benchLight, V, P, t); });
+			fprintf(out, "%s,%g,", pipelineName((WaterPipeline)p), tess);
+			printStats(out, opt, s, plane.numPatches());
+		}
+	}
+}
+
+// Fixed levels against adaptive screen-space levels with frustum culling, on
+// each domain given with the first stepsize. Larger domains put more patches
+// far away or out of view, which is where the adaptive levels pay off.
+static void suiteAdaptive(const BenchOptions &opt, FILE *out)
+{
+	glm::mat4 P = benchProjection(opt);
+	fprintf(out, "domain,mode,level,%s\n", statsHeader);
+
+	for (float domain : opt.domains)
+	{
+		PlaneMesh plane(-domain, domain, opt.steps[0]);
+		plane.setViewportHeight(opt.height);
+		for (float tess : opt.tess)
+		{
+			plane.setTessLevels(tess, tess);
+			FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+									   { plane.draw(benchLight, V, P, t); });
+			fprintf(out, "%g,fixed,%g,", domain, tess);
+			printStats(out, opt, s, plane.numPatches());
+		}
+		for (float px : opt.pixels)
+		{
+			plane.setAdaptiveTess(px);
+			FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+									   { plane.draw(benchLight, V, P, t); });
+			fprintf(out, "%g,adaptive,%g,", domain, px);
+			printStats(out, opt, s, plane.numPatches());
+		}
+	}
+}
+
+// The CDLOD ocean at each world size and stepsize, adaptive tessellation at
+// the default 8 px. select_ms is the CPU quadtree walk alone.
+static void suiteOcean(const BenchOptions &opt, FILE *out)
+{
+	glm::mat4 P = benchProjection(opt);
+	fprintf(out, "world,stepsize,levels,nodes,visited,select_mean_ms,select_max_ms,%s\n", statsHeader);
+
+	for (float world : opt.worlds)
+	{
+		for (float step : opt.steps)
+		{
+			OceanSettings settings;
+			settings.worldSize = world;
+			settings.gridUnit = step;
+			PlaneMesh plane(settings);
+			plane.setViewportHeight(opt.height);
+
+			std::vector<double> selectMs;
+			FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+									   {
+				plane.draw(benchLight, V, P, t);
+				selectMs.push_back(plane.getOcean()->lastSelectMs()); });
+
+			const OceanQuadtree *ocean = plane.getOcean();
+			fprintf(out, "%g,%g,%d,%zu,%zu,%.4f,%.4f,", world, step, ocean->numLevels(),
+					ocean->lastSelection().size(), ocean->lastVisited(),
+					mean(selectMs), percentile(selectMs, 100));
+			printStats(out, opt, s, plane.numPatches());
+		}
+	}
+}
+
+// The quadtree ocean displaced by the CPU FFT sea at each resolution and
+// thread count. update_ms is SpectralOcean::update() alone (spectrum, two
+// inverse FFTs, interleave); upload_ms the texture upload and mipmaps.
+static void suiteFFT(const BenchOptions &opt, FILE *out)
+{
+	glm::mat4 P = benchProjection(opt);
+	fprintf(out, "fft_size,threads,update_mean_ms,update_p99_ms,upload_mean_ms,%s\n", statsHeader);
+
+	PlaneMesh plane((OceanSettings()));
+	plane.setViewportHeight(opt.height);
+	plane.setWaves(std::vector<GerstnerWave>());
+	for (float size : opt.fftSizes)
+	{
+		for (float threads : opt.threads)
+		{
+			ThreadPool pool((unsigned)threads);
+			SpectralOceanParams params;
+			params.size = (int)size;
+			SpectralOcean sea(params, pool);
+
+			std::vector<double> updateMs, uploadMs;
+			FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+									   {
+				sea.update(t);
+				updateMs.push_back(sea.lastUpdateMs());
+				auto start = std::chrono::steady_clock::now();
+				plane.setDisplacementMap(sea.displacement(), sea.size(), params.patchSize, sea.maxDisplacement());
+				uploadMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+				plane.draw(benchLight, V, P, t); });
+
+			fprintf(out, "%d,%u,%.3f,%.3f,%.3f,", params.size, pool.numWorkers(),
+					mean(updateMs), percentile(updateMs, 99), mean(uploadMs));
+			printStats(out, opt, s, plane.numPatches());
+		}
+	}
+}
+
+// Render-thread time spent uploading the FFT sea each frame, for each
+// resolution: "sync" is setDisplacementMap() (glTexSubImage2D from client
+// memory plus mipmaps), "stream" the TextureStreamer slot the FFT writes into
+// directly; a frame where no new image was ready counts as 0. upload_max_ms
+// catches the stalls the mean hides.
+static void suiteUpload(const BenchOptions &opt, FILE *out)
+{
+	glm::mat4 P = benchProjection(opt);
+	fprintf(out, "fft_size,mode,persistent,upload_mean_ms,upload_p99_ms,upload_max_ms,dropped,%s\n", statsHeader);
+
+	ThreadPool pool;
+	for (float size : opt.fftSizes)
+	{
+		SpectralOceanParams params;
+		params.size = (int)size;
+		SpectralOcean sea(params, pool);
+
+		for (int streamed = 0; streamed < 2; ++streamed)
+		{
+			PlaneMesh plane((OceanSettings()));
+			plane.setViewportHeight(opt.height);
+			plane.setWaves(std::vector<GerstnerWave>());
+			TextureStreamer *stream = streamed ? plane.streamDisplacementMap(sea.size(), params.patchSize) : NULL;
+
+			std::vector<double> uploadMs;
+			FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+									   {
+				if (stream)
+				{
+					void *slot = stream->acquire();
+					if (slot)
+					{
+						sea.update(t, (float *)slot);
+						stream->publish(slot);
+					}
+					plane.setDisplacementBound(sea.maxDisplacement());
+					plane.draw(benchLight, V, P, t);
+					uploadMs.push_back(stream->getLastUploadMs());
+				}
+				else
+				{
+					sea.update(t);
+					auto start = std::chrono::steady_clock::now();
+					plane.setDisplacementMap(sea.displacement(), sea.size(), params.patchSize, sea.maxDisplacement());
+					uploadMs.push_back(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+					plane.draw(benchLight, V, P, t);
+				} });
+
+			fprintf(out, "%d,%s,%d,%.3f,%.3f,%.3f,%zu,", params.size, stream ? "stream" : "sync",
+					stream ? (int)stream->isPersistent() : 0,
+					mean(uploadMs), percentile(uploadMs, 99), percentile(uploadMs, 100),
+					stream ? stream->numDropped() : (size_t)0);
+			printStats(out, opt, s, plane.numPatches());
+		}
+	}
+}
+
+// A fleet of boats (fleetLayout(), 3 units apart) drawn as one InstancedMesh
+// with CPU frustum culling, against one TextureMesh::draw() per boat. The
+// patches column holds the boats drawn per frame.
+static void suiteInstances(const BenchOptions &opt, FILE *out)
+{
+	glm::mat4 P = benchProjection(opt);
+	fprintf(out, "instances,mode,cull_mean_ms,%s\n", statsHeader);
+
+	InstancedMesh fleet("assets/boat.ply", "assets/boat.bmp");
+	TextureMesh boat("assets/boat.ply", "assets/boat.bmp");
+	for (float count : opt.instances)
+	{
+		std::vector<glm::mat4> layout = fleetLayout((int)count, 3.0f);
+		fleet.setTransforms(layout);
+
+		std::vector<double> cullMs;
+		FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+								   {
+			fleet.draw(benchLight, V, P);
+			cullMs.push_back(fleet.getLastCullMs()); });
+		fprintf(out, "%d,instanced,%.3f,", (int)count, mean(cullMs));
+		printStats(out, opt, s, (GLsizei)fleet.numVisible());
+
+		s = runFrames(opt, [&](const glm::mat4 &V, float t)
+					  {
+			for (const glm::mat4 &m : layout)
+			{
+				boat.setTransform(m);
+				boat.draw(benchLight, V, P);
+			} });
+		fprintf(out, "%d,separate,0,", (int)count);
+		printStats(out, opt, s, (GLsizei)layout.size());
+	}
+}
+
+// Buoyancy step time for fleets of boats (BuoyancyHull::boat() of
+// assets/boat.ply) on the default waves, for each worker count. No rendering.
+static void suiteBuoyancy(const BenchOptions &opt, FILE *out)
+{
+	fprintf(out, "bodies,threads,steps,step_mean_ms,step_p99_ms,bodies_per_s\n");
+	PlyMesh boat;
+	if (!loadPly("assets/boat.ply", boat))
+		return;
+	glm::vec3 lo, hi;
+	boat.bounds(&lo[0], &hi[0]);
+	BuoyancyHull hull = BuoyancyHull::boat(lo, hi);
+	WaveField sea;
+	for (float count : opt.bodies)
+	{
+		std::vector<glm::mat4> layout = fleetLayout((int)count, 3.0f);
+		for (float threads : opt.threads)
+		{
+			ThreadPool pool((unsigned)threads);
+			BuoyancySystem system(sea, pool, hull);
+			system.addBodies(layout);
+
+			std::vector<double> stepMs;
+			for (int i = 0; i < opt.warmup + opt.frames; ++i)
+			{
+				system.step();
+				if (i >= opt.warmup)
+					stepMs.push_back(system.getLastStepMs());
+			}
+			fprintf(out, "%d,%u,%d,%.3f,%.3f,%.0f\n", (int)count, pool.numWorkers(), opt.frames,
+					mean(stepMs), percentile(stepMs, 99), count / (mean(stepMs) / 1000.0));
+			fflush(out);
+		}
+	}
+}
+
+// SurfaceQuery batches of random points over a 100 x 100 patch of the default
+// waves, alone and with the BMP displacement map, for 1 to 4 Newton passes
+// and each worker count. max_error is the largest horizontal residual left.
+static void suiteQuery(const BenchOptions &opt, FILE *out)
+{
+	fprintf(out, "queries,map,iterations,threads,batches,mean_ms,p99_ms,queries_per_s,misses,max_error\n");
+	WaveField sea;
+	uint32_t state = 1;
+	for (float count : opt.queries)
+	{
+		std::vector<float> x((size_t)count), z((size_t)count), error((size_t)count), height((size_t)count);
+		std::vector<float> nx((size_t)count), ny((size_t)count), nz((size_t)count);
+		for (size_t i = 0; i < x.size(); ++i)
+		{
+			state = state * 1664525u + 1013904223u;
+			x[i] = (state >> 8) * (100.0f / 16777216.0f) - 50.0f;
+			state = state * 1664525u + 1013904223u;
+			z[i] = (state >> 8) * (100.0f / 16777216.0f) - 50.0f;
+		}
+		SurfaceQueryOutput result;
+		result.height = height.data();
+		result.nx = nx.data();
+		result.ny = ny.data();
+		result.nz = nz.data();
+		result.error = error.data();
+
+		for (int map = 0; map < 2; ++map)
+			for (int iterations = 1; iterations <= 4; ++iterations)
+				for (float threads : opt.threads)
+				{
+					ThreadPool pool((unsigned)threads);
+					SurfaceQuery query(sea, &pool);
+					if (map && !query.loadDisplacementMap("assets/displacement-map1.bmp", 50.0f))
+						return;
+					query.setIterations(iterations);
+
+					std::vector<double> batchMs;
+					size_t misses = 0;
+					for (int i = 0; i < opt.warmup + opt.frames; ++i)
+					{
+						query.setTime(i / 60.0f);
+						misses = query.query(x.data(), z.data(), x.size(), result);
+						if (i >= opt.warmup)
+							batchMs.push_back(query.getLastMs());
+					}
+					float maxError = 0.0f;
+					for (float e : error)
+						maxError = std::max(maxError, e);
+					fprintf(out, "%d,%d,%d,%u,%d,%.3f,%.3f,%.0f,%zu,%.2e\n", (int)count, map, iterations,
+							pool.numWorkers(), opt.frames, mean(batchMs), percentile(batchMs, 99),
+							count / (mean(batchMs) / 1000.0), misses, maxError);
+					fflush(out);
+				}
+	}
+}
+
+// Live tess-eval waves against the looped bake of the same generated sea
+// state, for each wave count, bake size and tessellation level on the first
+// stepsize/domain given. The live rows draw the looped waves too, so both
+// displace the same sea; their bake columns are 0. The bake's slice count
+// and budget are the defaults.
+static void suiteBake(const BenchOptions &opt, FILE *out)
+{
+	glm::mat4 P = benchProjection(opt);
+	fprintf(out, "waves,pipeline,bake_size,bake_frames,bake_ms,bake_mb,period_s,time_error,space_error,tess,%s\n",
+			statsHeader);
+
+	ThreadPool pool;
+	PlaneMesh plane(-opt.domains[0], opt.domains[0], opt.steps[0]);
+	for (float count : opt.waves)
+	{
+		std::vector<GerstnerWave> waves = generateSeaState((int)count);
+		WaveBakeSettings settings;
+		settings.period = chooseLoopPeriod(waves, settings.frames, settings.minFramesPerCycle);
+		std::vector<GerstnerWave> looped = loopGerstnerWaves(waves, settings.tileSize, settings.period);
+		float timeError = loopTimeError(waves, settings.period), spaceError = loopSpaceError(waves, looped);
+		plane.setWaves(looped);
+
+		plane.setPipeline(PIPELINE_TESS_EVAL);
+		for (float tess : opt.tess)
+		{
+			plane.setTessLevels(tess, tess);
+			FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+									   { plane.draw(benchLight, V, P, t); });
+			fprintf(out, "%d,%s,0,0,0,0,%.2f,%.4f,%.4f,%g,", (int)count, pipelineName(PIPELINE_TESS_EVAL),
+					settings.period, timeError, spaceError, tess);
+			printStats(out, opt, s, plane.numPatches());
+		}
+
+		for (float size : opt.bakeSizes)
+		{
+			WaveBake bake;
+			settings.size = (int)size;
+			if (!bake.bake(waves, settings, &pool))
+				continue;
+			plane.setWaveBake(&bake);
+			plane.setPipeline(PIPELINE_TESS_BAKED);
+			for (float tess : opt.tess)
+			{
+				plane.setTessLevels(tess, tess);
+				FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+										   { plane.draw(benchLight, V, P, t); });
+				fprintf(out, "%d,%s,%d,%d,%.1f,%.1f,%.2f,%.4f,%.4f,%g,", (int)count,
+						pipelineName(PIPELINE_TESS_BAKED), bake.getSettings().size, bake.getSettings().frames,
+						bake.getBakeMs(), bake.getBytes() / 1048576.0, bake.getPeriod(), bake.getTimeError(),
+						bake.getSpaceError(), tess);
+				printStats(out, opt, s, plane.numPatches());
+			}
+			plane.setWaveBake(NULL);
+		}
+	}
+}
+
+// Foam on the storm sea state with the emission turned up until the pool is
+// full every frame, so each pool size is the live count, updated and drawn
+// as one instanced draw. field_ms is sampling the surface, update_ms moving,
+// compacting and emitting the particles; the patches column holds the
+// particles drawn.
+static void suiteFoam(const BenchOptions &opt, FILE *out)
+{
+	glm::mat4 P = benchProjection(opt);
+	fprintf(out, "particles,threads,live,field_mean_ms,update_mean_ms,update_p99_ms,%s\n", statsHeader);
+
+	std::vector<GerstnerWave> waves;
+	if (!loadSeaState("assets/seastate-storm.txt", waves))
+		return;
+	WaveField sea(waves);
+	FoamRenderer renderer;
+	for (float count : opt.particles)
+	{
+		for (float threads : opt.threads)
+		{
+			ThreadPool pool((unsigned)threads);
+			FoamSettings settings;
+			settings.capacity = (size_t)count;
+			settings.rate = 100000.0f;
+			FoamParticles foam(sea, settings, &pool);
+
+			std::vector<double> fieldMs, updateMs;
+			size_t live = 0;
+			FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+									   {
+				glm::vec3 eye = glm::vec3(glm::inverse(V)[3]);
+				foam.setFocus(eye.x, eye.z);
+				foam.update(t, 1.0f / 60.0f);
+				fieldMs.push_back(foam.getLastFieldMs());
+				updateMs.push_back(foam.getLastUpdateMs());
+				live = foam.numLive();
+				renderer.draw(foam, V, P); });
+
+			fprintf(out, "%d,%u,%zu,%.3f,%.3f,%.3f,", (int)count, pool.numWorkers(), live, mean(fieldMs),
+					mean(updateMs), percentile(updateMs, 99));
+			printStats(out, opt, s, (GLsizei)live);
+		}
+	}
+}
+
+// The bridge, chart and side monitors of layoutMonitorViews() around the
+// scripted camera, for each view count, pipeline and level: "multi" draws
+// them all with one drawViews(), which tessellates and displaces the patches
+// once, "separate" with one draw() per view. The "grid" surface is the first
+// stepsize/domain given with each fixed tessellation level; the "ocean" is
+// the default quadtree ocean with adaptive levels at each pixels per edge
+// (its selection in "multi" covers every view at once). Both use the looped
+// default waves, as in the pipeline suite. The patches column counts the
+// patches submitted (once in "multi", once per view in "separate") and the
+// triangles column every view's; "multi" only counts the triangles its
+// geometry stage sends to a view that can see them.
+static void suiteViews(const BenchOptions &opt, FILE *out)
+{
+	fprintf(out, "views,surface,pipeline,mode,level,%s\n", statsHeader);
+
+	ThreadPool pool;
+	WaveBake bake;
+	if (!bake.bake(defaultGerstnerWaves(), WaveBakeSettings(), &pool))
+		return;
+	std::vector<WaterView> views;
+	for (int isOcean = 0; isOcean < 2; ++isOcean)
+	{
+		std::unique_ptr<PlaneMesh> mesh(isOcean ? new PlaneMesh(OceanSettings(), &pool)
+												: new PlaneMesh(-opt.domains[0], opt.domains[0], opt.steps[0], false, &pool));
+		PlaneMesh &plane = *mesh;
+		plane.setWaves(bake.getWaves());
+		plane.setWaveBake(&bake);
+		const std::vector<float> &levels = isOcean ? opt.pixels : opt.tess;
+		for (float count : opt.views)
+		{
+			for (int p = 0; p < PIPELINE_COUNT; ++p)
+			{
+				if (p == PIPELINE_TESS_COMPUTE && !computeShadersSupported())
+					continue;
+				plane.setPipeline((WaterPipeline)p);
+				for (float level : levels)
+				{
+					if (isOcean)
+						plane.setAdaptiveTess(level);
+					else
+						plane.setTessLevels(level, level);
+					for (int multi = 1; multi >= 0; --multi)
+					{
+						GLsizei patches = 0;
+						FrameSamples s = runFrames(opt, [&](const glm::mat4 &V, float t)
+												   {
+							layoutMonitorViews(V, (int)count, opt.width, opt.height, views);
+							patches = 0;
+							if (multi)
+							{
+								plane.drawViews(benchLight, views.data(), (int)views.size(), t);
+								patches = plane.numPatches();
+							}
+							else
+								for (const WaterView &view : views)
+								{
+									glViewport(view.x, view.y, view.width, view.height);
+									plane.setViewportHeight(view.height);
+									plane.draw(benchLight, view.V, view.P, t);
+									patches += plane.numPatches();
+								}
+							glViewport(0, 0, opt.width, opt.height); });
+						fprintf(out, "%d,%s,%s,%s,%g,", (int)views.size(), isOcean ? "ocean" : "grid",
+								pipelineName((WaterPipeline)p), multi ? "multi" : "separate", level);
+						printStats(out, opt, s, patches);
+					}
+				}
+			}
+		}
+	}
+}
+
+// Program build time for every water pipeline (grid and quadtree vertex
+// shaders), the compute pass where supported, plus the mesh program: "source" without the binary cache, "cold"
+// into an empty cache and "warm" from it. With parallel compiles all builds
+// are started before the first is waited on. The driver's own shader cache,
+// if it has one, is not cleared, so "source" may already be partly warm.
+static void suiteShaders(const BenchOptions &opt, FILE *out)
+{
+	fprintf(out, "mode,parallel,programs,cached,build_ms\n");
+	bool parallel = enableParallelShaderCompile();
+	std::string saved = shaderCacheDir;
+	std::string dir = "build/shadercache-bench";
+
+	// Empty the bench cache before the cold pass.
+	mkdir(dir.c_str(), 0755);
+	if (DIR *d = opendir(dir.c_str()))
+	{
+		while (dirent *e = readdir(d))
+			if (e->d_name[0] != '.')
+				remove((dir + "/" + e->d_name).c_str());
+		closedir(d);
+	}
+
+	const char *modes[3] = {"source", "cold", "warm"};
+	for (int m = 0; m < 3; ++m)
+	{
+		shaderCacheDir = m == 0 ? "" : dir;
+		auto start = std::chrono::steady_clock::now();
+		std::vector<std::unique_ptr<ShaderBuilder>> builders;
+		for (int cdlod = 0; cdlod < 2; ++cdlod)
+			for (int p = 0; p < PIPELINE_COUNT; ++p)
+				builders.emplace_back(waterProgramBuilder((WaterPipeline)p, cdlod != 0));
+		if (computeShadersSupported())
+			builders.emplace_back(waveComputeBuilder());
+		builders.emplace_back(new ShaderBuilder());
+		builders.back()->stage(GL_VERTEX_SHADER, "shaders/mesh_vertex.glsl");
+		builders.back()->stage(GL_FRAGMENT_SHADER, "shaders/mesh_fragment.glsl");
+		for (auto &b : builders)
+			b->start();
+
+		int cached = 0;
+		for (auto &b : builders)
+		{
+			GLuint id = b->finish();
+			cached += b->wasCached();
+			glDeleteProgram(id);
+			glState().forgetProgram(id);
+		}
+		glFinish();
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		fprintf(out, "%s,%d,%zu,%d,%.2f\n", modes[m], (int)parallel, builders.size(), cached, ms);
+	}
+	shaderCacheDir = saved;
+}
+
+int main(int argc, char *argv[])
+{
+	BenchOptions opt;
+	for (int i = 1; i < argc; ++i)
+	{
+		const char *arg = argv[i];
+		const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+		if (!value)
+		{
+			fprintf(stderr, "Missing value for %s\n", arg);
+			return 1;
+		}
+		++i;
+
+		if (strcmp(arg, "--suite") == 0)
+			opt.suite = value;
+		else if (strcmp(arg, "--frames") == 0)
+			opt.frames = atoi(value);
+		else if (strcmp(arg, "--warmup") == 0)
+			opt.warmup = atoi(value);
+		else if (strcmp(arg, "--size") == 0)
+			sscanf(value, "%dx%d", &opt.width, &opt.height);
+		else if (strcmp(arg, "--steps") == 0)
+			opt.steps = parseList(value);
+		else if (strcmp(arg, "--domains") == 0)
+			opt.domains = parseList(value);
+		else if (strcmp(arg, "--tess") == 0)
+			opt.tess = parseList(value);
+		else if (strcmp(arg, "--waves") == 0)
+			opt.waves = parseList(value);
+		else if (strcmp(arg, "--pixels") == 0)
+			opt.pixels = parseList(value);
+		else if (strcmp(arg, "--worlds") == 0)
+			opt.worlds = parseList(value);
+		else if (strcmp(arg, "--fft-sizes") == 0)
+			opt.fftSizes = parseList(value);
+		else if (strcmp(arg, "--threads") == 0)
+			opt.threads = parseList(value);
+		else if (strcmp(arg, "--instances") == 0)
+			opt.instances = parseList(value);
+		else if (strcmp(arg, "--bodies") == 0)
+			opt.bodies = parseList(value);
+		else if (strcmp(arg, "--queries") == 0)
+			opt.queries = parseList(value);
+		else if (strcmp(arg, "--bake-sizes") == 0)
+			opt.bakeSizes = parseList(value);
+		else if (strcmp(arg, "--particles") == 0)
+			opt.particles = parseList(value);
+		else if (strcmp(arg, "--views") == 0)
+			opt.views = parseList(value);
+		else if (strcmp(arg, "--out") == 0)
+			opt.outPath = value;
+		else
+		{
+			fprintf(stderr, "Unknown option %s\n", arg);
+			return 1;
+		}
+	}
+
+	FILE *out = stdout;
+	if (opt.outPath)
+	{
+		out = fopen(opt.outPath, "w");
+		if (!out)
+		{
+			fprintf(stderr, "Could not write %s\n", opt.outPath);
+			return 1;
+		}
+	}
+
+	HeadlessContext headless;
+	if (!headless.create(opt.width, opt.height))
+		return 1;
+
+	glClearColor(0.2f, 0.2f, 0.3f, 0.0f);
+	glDisable(GL_CULL_FACE);
+	glEnable(GL_DEPTH_TEST);
+	glDepthFunc(GL_LESS);
+
+	if (opt.suite == "grid")
+		suiteGrid(opt, out);
+	else if (opt.suite == "waves")
+		suiteWaves(opt, out);
+	else if (opt.suite == "pipeline")
+		suitePipeline(opt, out);
+	else if (opt.suite == "adaptive")
+		suiteAdaptive(opt, out);
+	else if (opt.suite == "ocean")
+		suiteOcean(opt, out);
+	else if (opt.suite == "fft")
+		suiteFFT(opt, out);
+	else if (opt.suite == "upload")
+		suiteUpload(opt, out);
+	else if (opt.suite == "shaders")
+		suiteShaders(opt, out);
+	else if (opt.suite == "instances")
+		suiteInstances(opt, out);
+	else if (opt.suite == "buoyancy")
+		suiteBuoyancy(opt, out);
+	else if (opt.suite == "query")
+		suiteQuery(opt, out);
+	else if (opt.suite == "bake")
+		suiteBake(opt, out);
+	else if (opt.suite == "procedural")
+		suiteProcedural(opt, out);
+	else if (opt.suite == "foam")
+		suiteFoam(opt, out);
+	else if (opt.suite == "views")
+		suiteViews(opt, out);
+	else
+	{
+		fprintf(stderr, "Unknown suite %s\n", opt.suite.c_str());
+		return 1;
+	}
+
+	if (out != stdout)
+		fclose(out);
+	return 0;
+}
@@ -0,0 +1,311 @@
+#ifndef BUOYANCY_HPP
+#define BUOYANCY_HPP
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.hpp"
+#include "WaveField.hpp"
+
+// Rigid bodies floating on the Gerstner sea. Every body shares one hull: a
+// set of sample points in body space, each standing for a column of the hull
+// volume. Each fixed step, a sample below the surface is pushed along the
+// surface normal in proportion to how deep its column is. It is also damped
+// by the water. The forces act at the sample points, so bodies pitch and roll
+// with the waves, and they are integrated with semi-implicit Euler.
+//
+// Only the Gerstner waves are seen. The displacement map added on top in the
+// shaders and the FFT sea are not. The height is read at the sample's own x/z
+// as if the surface didn't move sideways, which is close for the gentle
+// sharpness of the default waves.
+//
+// Bodies are independent, so a step splits them into chunks and runs the
+// chunks on the pool. Each chunk evaluates its hull samples in one batch
+// through the SIMD WaveField kernels.
+
+#define BUOYANCY_WATER_DENSITY 1000.0f
+#define BUOYANCY_GRAVITY 9.81f
+// Bodies per task; a worker's scratch is 12 floats per hull sample of each.
+#define BUOYANCY_CHUNK 256
+
+struct BuoyancyHull
+{
+	std::vector<glm::vec3> points; // bottom of each column, from the centre of mass
+	glm::vec3 center;			   // centre of mass in model space
+	float columnHeight;			   // a column is fully under at this depth
+	float volume;				   // of the whole hull
+	glm::vec3 halfExtents;		   // for the inertia tensor
+
+	// An nx x nz grid of columns on the bottom face of the model-space box
+	// [lo, hi]. The mass sits in the middle, a third of the way up: with
+	// it any higher a half-sunk box is unstable in roll.
+	static BuoyancyHull box(const glm::vec3 &lo, const glm::vec3 &hi, int nx, int nz)
+	{
+		BuoyancyHull hull;
+		glm::vec3 size = hi - lo;
+		hull.center = glm::vec3(lo.x + 0.5f * size.x, lo.y + size.y / 3.0f, lo.z + 0.5f * size.z);
+		for (int i = 0; i < nx; ++i)
+			for (int k = 0; k < nz; ++k)
+			{
+				float fx = nx > 1 ? (float)i / (nx - 1) : 0.5f;
+				float fz = nz > 1 ? (float)k / (nz - 1) : 0.5f;
+				hull.points.push_back(glm::vec3(lo.x + fx * size.x, lo.y, lo.z + fz * size.z) - hull.center);
+			}
+		hull.columnHeight = size.y;
+		hull.volume = size.x * size.y * size.z;
+		hull.halfExtents = 0.5f * size;
+		return hull;
+	}
+
+	// A boat's hull from its model bounds: the bottom quarter of the box, as
+	// the rest is cabin and mast, with 2 x 3 columns.
+	static BuoyancyHull boat(const glm::vec3 &lo, const glm::vec3 &hi)
+	{
+		return box(lo, glm::vec3(hi.x, lo.y + 0.25f * (hi.y - lo.y), hi.z), 2, 3);
+	}
+};
+
+class BuoyancySystem
+{
+	// Body state, one entry per body in each array. p is the centre of mass.
+	std::vector<float> px, py, pz;
+	std::vector<float> vx, vy, vz;
+	std::vector<float> qw, qx, qy, qz; // orientation, unit quaternion
+	std::vector<float> wx, wy, wz;	   // angular velocity, world space
+
+	BuoyancyHull hull;
+	float mass, invInertia[3];
+	float linearDrag, angularDrag;
+
+	const WaveField &field;
+	ThreadPool &pool;
+	std::vector<GerstnerTerm> terms;
+	// Per-worker x/y/z probe arrays for one chunk.
+	std::vector<std::vector<float>> scratch;
+
+	double fixedDt, simTime;
+	float probeStep;
+	int maxSteps;
+	size_t stepsTaken;
+	double lastStepMs;
+
+	// Advances bodies [begin, end) by dt.
+	void stepChunk(size_t begin, size_t end, unsigned worker, float dt)
+	{
+		const size_t S = hull.points.size();
+		const size_t n = (end - begin) * S;
+		float *x = scratch[worker].data();
+		float *y = x + 3 * n;
+		float *z = y + 3 * n;
+		float *r = z + 3 * n; // sample offsets from the centre of mass, world axes
+
+		// Each sample gets three probes: at the point, and probeStep along x
+		// and z, so the normal comes out of the same (chained) wave sum the
+		// shaders use.
+		for (size_t b = begin; b < end; ++b)
+		{
+			glm::mat3 R = orientation(b);
+			for (size_t s = 0; s < S; ++s)
+			{
+				size_t j = (b - begin) * S + s;
+				glm::vec3 offset = R * hull.points[s];
+				r[3 * j] = offset.x;
+				r[3 * j + 1] = offset.y;
+				r[3 * j + 2] = offset.z;
+				float sx = px[b] + offset.x, sz = pz[b] + offset.z;
+				size_t i = 3 * j;
+				x[i] = sx;
+				z[i] = sz;
+				x[i + 1] = sx + probeStep;
+				z[i + 1] = sz;
+				x[i + 2] = sx;
+				z[i + 2] = sz + probeStep;
+			}
+		}
+		std::fill(y, y + 3 * n, 0.0f);
+		field.displace(terms, x, y, z, 0, 3 * n);
+
+		const float columnVolume = hull.volume / S;
+		const float pointMass = mass / S;
+		for (size_t b = begin; b < end; ++b)
+		{
+			glm::vec3 force(0.0f, -mass * BUOYANCY_GRAVITY, 0.0f);
+			glm::vec3 torque(0.0f);
+			glm::vec3 v(vx[b], vy[b], vz[b]), w(wx[b], wy[b], wz[b]);
+			for (size_t s = 0; s < S; ++s)
+			{
+				size_t j = (b - begin) * S + s;
+				size_t i = 3 * j;
+				glm::vec3 offset(r[i], r[i + 1], r[i + 2]);
+				float depth = y[i] - (py[b] + offset.y);
+				if (depth <= 0.0f)
+					continue;
+				float submerged = std::min(depth / hull.columnHeight, 1.0f);
+
+				glm::vec3 p0(x[i], y[i], z[i]);
+				glm::vec3 tx = glm::vec3(x[i + 1], y[i + 1], z[i + 1]) - p0;
+				glm::vec3 tz = glm::vec3(x[i + 2], y[i + 2], z[i + 2]) - p0;
+				glm::vec3 normal = glm::normalize(glm::cross(tz, tx));
+
+				glm::vec3 pointVelocity = v + glm::cross(w, offset);
+				glm::vec3 f = normal * (BUOYANCY_WATER_DENSITY * BUOYANCY_GRAVITY * columnVolume * submerged) -
+							  pointVelocity * (linearDrag * pointMass * submerged);
+				force += f;
+				torque += glm::cross(offset, f);
+			}
+
+			v += force * (dt / mass);
+			// The world inverse inertia is R I^-1 R^T of the body-space box.
+			glm::mat3 R = orientation(b);
+			glm::vec3 local(glm::dot(R[0], torque) * invInertia[0], glm::dot(R[1], torque) * invInertia[1],
+							glm::dot(R[2], torque) * invInertia[2]);
+			w += (R * local) * dt;
+			w *= std::max(0.0f, 1.0f - angularDrag * dt);
+
+			vx[b] = v.x;
+			vy[b] = v.y;
+			vz[b] = v.z;
+			wx[b] = w.x;
+			wy[b] = w.y;
+			wz[b] = w.z;
+			px[b] += v.x * dt;
+			py[b] += v.y * dt;
+			pz[b] += v.z * dt;
+
+			// q += 0.5 * (0, w) * q * dt, renormalised.
+			float a = qw[b], bx = qx[b], by = qy[b], bz = qz[b];
+			float h = 0.5f * dt;
+			float nw = a + h * (-w.x * bx - w.y * by - w.z * bz);
+			float nx = bx + h * (w.x * a + w.y * bz - w.z * by);
+			float ny = by + h * (w.y * a + w.z * bx - w.x * bz);
+			float nz = bz + h * (w.z * a + w.x * by - w.y * bx);
+			float len = 1.0f / sqrtf(nw * nw + nx * nx + ny * ny + nz * nz);
+			qw[b] = nw * len;
+			qx[b] = nx * len;
+			qy[b] = ny * len;
+			qz[b] = nz * len;
+		}
+	}
+
+	// Rotation matrix of body b's orientation.
+	glm::mat3 orientation(size_t b) const
+	{
+		float w = qw[b], x = qx[b], y = qy[b], z = qz[b];
+		glm::mat3 R;
+		R[0] = glm::vec3(1 - 2 * (y * y + z * z), 2 * (x * y + w * z), 2 * (x * z - w * y));
+		R[1] = glm::vec3(2 * (x * y - w * z), 1 - 2 * (x * x + z * z), 2 * (y * z + w * x));
+		R[2] = glm::vec3(2 * (x * z + w * y), 2 * (y * z - w * x), 1 - 2 * (x * x + y * y));
+		return R;
+	}
+
+public:
+	// The hull floats about half under (mass = half the displaced water).
+	// Steps are dt seconds long.
+	BuoyancySystem(const WaveField &field, ThreadPool &pool, const BuoyancyHull &hull, double dt = 1.0 / 60.0)
+		: hull(hull), linearDrag(4.0f), angularDrag(1.0f), field(field), pool(pool),
+		  fixedDt(dt), simTime(0.0), probeStep(0.05f), maxSteps(4), stepsTaken(0), lastStepMs(0.0)
+	{
+		mass = 0.5f * BUOYANCY_WATER_DENSITY * hull.volume;
+		glm::vec3 e = 2.0f * hull.halfExtents;
+		invInertia[0] = 12.0f / (mass * (e.y * e.y + e.z * e.z));
+		invInertia[1] = 12.0f / (mass * (e.x * e.x + e.z * e.z));
+		invInertia[2] = 12.0f / (mass * (e.x * e.x + e.y * e.y));
+		scratch.resize(pool.numWorkers());
+		for (std::vector<float> &s : scratch)
+			s.resize(12 * BUOYANCY_CHUNK * hull.points.size());
+	}
+
+	// Adds a body at rest with its model origin at position, turned yaw
+	// radians about y.
+	void addBody(const glm::vec3 &position, float yaw = 0.0f)
+	{
+		qw.push_back(cosf(0.5f * yaw));
+		qx.push_back(0.0f);
+		qy.push_back(sinf(0.5f * yaw));
+		qz.push_back(0.0f);
+		px.push_back(0.0f);
+		py.push_back(0.0f);
+		pz.push_back(0.0f);
+		glm::vec3 p = position + orientation(numBodies() - 1) * hull.center;
+		px.back() = p.x;
+		py.back() = p.y;
+		pz.back() = p.z;
+		vx.push_back(0.0f);
+		vy.push_back(0.0f);
+		vz.push_back(0.0f);
+		wx.push_back(0.0f);
+		wy.push_back(0.0f);
+		wz.push_back(0.0f);
+	}
+
+	// Takes the position and yaw of each transform (e.g. from fleetLayout()).
+	void addBodies(const std::vector<glm::mat4> &transforms)
+	{
+		for (const glm::mat4 &m : transforms)
+			addBody(glm::vec3(m[3]), atan2f(m[2][0], m[0][0]));
+	}
+
+	size_t numBodies() const { return px.size(); }
+
+	// One fixed step of every body, with the waves at the current sim time.
+	void step()
+	{
+		auto start = std::chrono::steady_clock::now();
+		foldGerstnerTerms(field.getWaves(), (float)simTime, terms);
+		float dt = (float)fixedDt;
+		size_t count = numBodies();
+		size_t chunks = (count + BUOYANCY_CHUNK - 1) / BUOYANCY_CHUNK;
+		pool.parallelFor(chunks, [&](size_t c, unsigned worker)
+						 { stepChunk(c * BUOYANCY_CHUNK, std::min(count, (c + 1) * BUOYANCY_CHUNK), worker, dt); });
+		simTime += fixedDt;
+		++stepsTaken;
+		lastStepMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	// Runs as many fixed steps as it takes to catch up with time (the render
+	// clock), at most maxSteps per call so a long frame can't snowball; the
+	// lost time is dropped. Returns the number of steps run.
+	int advanceTo(double time)
+	{
+		int steps = 0;
+		while (simTime + fixedDt <= time && steps < maxSteps)
+		{
+			step();
+			++steps;
+		}
+		if (simTime + fixedDt <= time)
+			simTime = time;
+		return steps;
+	}
+
+	// Starts the clock at time without stepping, e.g. the first frame's.
+	void setTime(double time) { simTime = time; }
+	double getTime() const { return simTime; }
+	double getFixedDt() const { return fixedDt; }
+	size_t getStepsTaken() const { return stepsTaken; }
+	double getLastStepMs() const { return lastStepMs; }
+
+	// Model matrices of every body, for an InstancedMesh.
+	void writeTransforms(std::vector<glm::mat4> &out) const
+	{
+		out.resize(numBodies());
+		for (size_t b = 0; b < numBodies(); ++b)
+		{
+			glm::mat3 R = orientation(b);
+			glm::mat4 &m = out[b];
+			m[0] = glm::vec4(R[0], 0.0f);
+			m[1] = glm::vec4(R[1], 0.0f);
+			m[2] = glm::vec4(R[2], 0.0f);
+			m[3] = glm::vec4(getPosition(b) - R * hull.center, 1.0f);
+		}
+	}
+
+	// Centre of mass of body b.
+	glm::vec3 getPosition(size_t b) const { return glm::vec3(px[b], py[b], pz[b]); }
+};
+
+#endif
@@ -174,4 +174,23 @@ void cameraControlsGlobe(glm::mat4& V, float start) {
 
 }
 
+// Scripted version of cameraControlsGlobe for runs without input: starts from
+// the same eye position and circles the origin once every 60 seconds of t.
+void cameraOrbit(glm::mat4& V, float start, float t) {
+    glm::vec3 eye = {start, start/2, start};
+    glm::vec3 targ = {0.0f, 0.0f, 0.0f};
+    glm::vec3 up = {0.0f, 1.0f, 0.0f};
+
+    float radius = glm::length(eye);
+    float phi = 0.392f*3.14159f;
+    float theta = (float)(2*_PI) * t / 60.0f;
+
+    glm::vec3 direction(
+        sin(phi) * cos(theta),
+        cos(phi),
+        sin(phi) * sin(theta)
+    );
+    V = glm::lookAt(direction * radius, targ, up);
+}
+
 #endif
@@ -0,0 +1,55 @@
+// Offline mesh cooker: parses PLY files once and writes the cooked binary
+// meshes that TextureMesh maps at startup (see MeshCache.hpp).
+//
+//   ./build/cook [--out dir] mesh.ply [more.ply ..]
+//
+// Each input becomes <dir>/<name>.mesh, MESH_CACHE_DIR by default. Meshes
+// whose cooked file is still fresh are skipped.
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <string>
+
+#include "MeshCache.hpp"
+
+int main(int argc, char *argv[])
+{
+	std::string outDir = MESH_CACHE_DIR;
+	int first = 1;
+	if (argc > 2 && !strcmp(argv[1], "--out"))
+	{
+		outDir = argv[2];
+		first = 3;
+	}
+	if (first >= argc)
+	{
+		fprintf(stderr, "usage: %s [--out dir] mesh.ply [more.ply ..]\n", argv[0]);
+		return 1;
+	}
+	mkdir(outDir.c_str(), 0755);
+
+	int cooked = 0, failed = 0;
+	for (int i = first; i < argc; ++i)
+	{
+		std::string target = cookedMeshPath(argv[i]);
+		target = outDir + target.substr(target.find_last_of('/'));
+		CookedMesh existing;
+		if (existing.open(target.c_str(), argv[i]))
+			continue;
+
+		auto start = std::chrono::steady_clock::now();
+		if (!cookMesh(argv[i], target.c_str()))
+		{
+			fprintf(stderr, "Failed to cook %s\n", argv[i]);
+			++failed;
+			continue;
+		}
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		printf("%s -> %s (%.1f ms)\n", argv[i], target.c_str(), ms);
+		++cooked;
+	}
+	printf("%d cooked, %d failed\n", cooked, failed);
+	return failed ? 1 : 0;
+}
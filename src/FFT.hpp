@@ -0,0 +1,434 @@
+#ifndef FFT_HPP
+#define FFT_HPP
+
+#include <stddef.h>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define FFT_X86 1
+#include <immintrin.h>
+#endif
+
+#include "ThreadPool.hpp"
+
+// Square 2D complex FFT for the spectral ocean, on split (SoA) real and
+// imaginary arrays of n * n floats, row-major.
+//
+// Blocks of 16 columns are copied (bit-reversed) into a small contiguous
+// buffer and run through an iterative radix-4 DIT transform (plus one radix-2
+// stage when log2(n) is odd) down all 16 columns at once. The columns share
+// their twiddles, so every butterfly is a plain SIMD operation on contiguous
+// floats. Blocks of 8 rows go through the same kernels by being transposed
+// on the way into the buffer and back out. Blocks are spread over a
+// ThreadPool; each worker has its own buffer (16 x n complex, 64 KB at n = 512).
+//
+// The inverse transform is unnormalised: x[j] = sum_k X[k] e^(+2 pi i jk / n),
+// which is the form the ocean spectrum sums are written in.
+
+#define FFT_BLOCK_COLUMNS 16
+// Fewer rows per block: the rows are a power-of-two stride apart, and 16 of
+// them (times two arrays) overflow the L1 sets they map to once n >= 512.
+#define FFT_BLOCK_ROWS 8
+
+namespace fftdetail
+{
+
+// out = a + w*b and a - w*b, for count columns.
+static void radix2Scalar(float *ar, float *ai, float *br, float *bi, float wr, float wi, size_t count)
+{
+	for (size_t c = 0; c < count; ++c)
+	{
+		float tr = wr * br[c] - wi * bi[c];
+		float ti = wr * bi[c] + wi * br[c];
+		br[c] = ar[c] - tr;
+		bi[c] = ai[c] - ti;
+		ar[c] += tr;
+		ai[c] += ti;
+	}
+}
+
+// Two radix-2 stages fused: (a, b) and (c, d) with w1, then (a, c) with w2
+// and (b, d) with i*w2. p[0..3] are the rows a, b, c, d.
+static void radix4Scalar(float *const *re, float *const *im, float w1r, float w1i, float w2r, float w2i, size_t count)
+{
+	for (size_t c = 0; c < count; ++c)
+	{
+		float tr = w1r * re[1][c] - w1i * im[1][c];
+		float ti = w1r * im[1][c] + w1i * re[1][c];
+		float ar = re[0][c] + tr, ai = im[0][c] + ti;
+		float br = re[0][c] - tr, bi = im[0][c] - ti;
+
+		tr = w1r * re[3][c] - w1i * im[3][c];
+		ti = w1r * im[3][c] + w1i * re[3][c];
+		float cr = re[2][c] + tr, ci = im[2][c] + ti;
+		float dr = re[2][c] - tr, di = im[2][c] - ti;
+
+		tr = w2r * cr - w2i * ci;
+		ti = w2r * ci + w2i * cr;
+		re[0][c] = ar + tr;
+		im[0][c] = ai + ti;
+		re[2][c] = ar - tr;
+		im[2][c] = ai - ti;
+
+		// i * w2 * d = (-(w2r*di + w2i*dr), w2r*dr - w2i*di)
+		tr = -(w2r * di + w2i * dr);
+		ti = w2r * dr - w2i * di;
+		re[1][c] = br + tr;
+		im[1][c] = bi + ti;
+		re[3][c] = br - tr;
+		im[3][c] = bi - ti;
+	}
+}
+
+#ifdef FFT_X86
+
+static void radix2SSE(float *ar, float *ai, float *br, float *bi, float wr, float wi, size_t count)
+{
+	const __m128 vwr = _mm_set1_ps(wr), vwi = _mm_set1_ps(wi);
+	size_t c = 0;
+	for (; c + 4 <= count; c += 4)
+	{
+		__m128 xr = _mm_loadu_ps(br + c), xi = _mm_loadu_ps(bi + c);
+		__m128 tr = _mm_sub_ps(_mm_mul_ps(vwr, xr), _mm_mul_ps(vwi, xi));
+		__m128 ti = _mm_add_ps(_mm_mul_ps(vwr, xi), _mm_mul_ps(vwi, xr));
+		__m128 yr = _mm_loadu_ps(ar + c), yi = _mm_loadu_ps(ai + c);
+		_mm_storeu_ps(br + c, _mm_sub_ps(yr, tr));
+		_mm_storeu_ps(bi + c, _mm_sub_ps(yi, ti));
+		_mm_storeu_ps(ar + c, _mm_add_ps(yr, tr));
+		_mm_storeu_ps(ai + c, _mm_add_ps(yi, ti));
+	}
+	radix2Scalar(ar + c, ai + c, br + c, bi + c, wr, wi, count - c);
+}
+
+static void radix4SSE(float *const *re, float *const *im, float w1r, float w1i, float w2r, float w2i, size_t count)
+{
+	const __m128 v1r = _mm_set1_ps(w1r), v1i = _mm_set1_ps(w1i);
+	const __m128 v2r = _mm_set1_ps(w2r), v2i = _mm_set1_ps(w2i);
+	size_t c = 0;
+	for (; c + 4 <= count; c += 4)
+	{
+		__m128 xr = _mm_loadu_ps(re[1] + c), xi = _mm_loadu_ps(im[1] + c);
+		__m128 tr = _mm_sub_ps(_mm_mul_ps(v1r, xr), _mm_mul_ps(v1i, xi));
+		__m128 ti = _mm_add_ps(_mm_mul_ps(v1r, xi), _mm_mul_ps(v1i, xr));
+		__m128 yr = _mm_loadu_ps(re[0] + c), yi = _mm_loadu_ps(im[0] + c);
+		__m128 ar = _mm_add_ps(yr, tr), ai = _mm_add_ps(yi, ti);
+		__m128 br = _mm_sub_ps(yr, tr), bi = _mm_sub_ps(yi, ti);
+
+		xr = _mm_loadu_ps(re[3] + c);
+		xi = _mm_loadu_ps(im[3] + c);
+		tr = _mm_sub_ps(_mm_mul_ps(v1r, xr), _mm_mul_ps(v1i, xi));
+		ti = _mm_add_ps(_mm_mul_ps(v1r, xi), _mm_mul_ps(v1i, xr));
+		yr = _mm_loadu_ps(re[2] + c);
+		yi = _mm_loadu_ps(im[2] + c);
+		__m128 cr = _mm_add_ps(yr, tr), ci = _mm_add_ps(yi, ti);
+		__m128 dr = _mm_sub_ps(yr, tr), di = _mm_sub_ps(yi, ti);
+
+		tr = _mm_sub_ps(_mm_mul_ps(v2r, cr), _mm_mul_ps(v2i, ci));
+		ti = _mm_add_ps(_mm_mul_ps(v2r, ci), _mm_mul_ps(v2i, cr));
+		_mm_storeu_ps(re[0] + c, _mm_add_ps(ar, tr));
+		_mm_storeu_ps(im[0] + c, _mm_add_ps(ai, ti));
+		_mm_storeu_ps(re[2] + c, _mm_sub_ps(ar, tr));
+		_mm_storeu_ps(im[2] + c, _mm_sub_ps(ai, ti));
+
+		tr = _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(_mm_mul_ps(v2r, di), _mm_mul_ps(v2i, dr)));
+		ti = _mm_sub_ps(_mm_mul_ps(v2r, dr), _mm_mul_ps(v2i, di));
+		_mm_storeu_ps(re[1] + c, _mm_add_ps(br, tr));
+		_mm_storeu_ps(im[1] + c, _mm_add_ps(bi, ti));
+		_mm_storeu_ps(re[3] + c, _mm_sub_ps(br, tr));
+		_mm_storeu_ps(im[3] + c, _mm_sub_ps(bi, ti));
+	}
+	if (c < count)
+	{
+		float *r[4] = {re[0] + c, re[1] + c, re[2] + c, re[3] + c};
+		float *i[4] = {im[0] + c, im[1] + c, im[2] + c, im[3] + c};
+		radix4Scalar(r, i, w1r, w1i, w2r, w2i, count - c);
+	}
+}
+
+__attribute__((target("avx2,fma"))) static void radix2AVX2(float *ar, float *ai, float *br, float *bi, float wr, float wi, size_t count)
+{
+	const __m256 vwr = _mm256_set1_ps(wr), vwi = _mm256_set1_ps(wi);
+	size_t c = 0;
+	for (; c + 8 <= count; c += 8)
+	{
+		__m256 xr = _mm256_loadu_ps(br + c), xi = _mm256_loadu_ps(bi + c);
+		__m256 tr = _mm256_fmsub_ps(vwr, xr, _mm256_mul_ps(vwi, xi));
+		__m256 ti = _mm256_fmadd_ps(vwr, xi, _mm256_mul_ps(vwi, xr));
+		__m256 yr = _mm256_loadu_ps(ar + c), yi = _mm256_loadu_ps(ai + c);
+		_mm256_storeu_ps(br + c, _mm256_sub_ps(yr, tr));
+		_mm256_storeu_ps(bi + c, _mm256_sub_ps(yi, ti));
+		_mm256_storeu_ps(ar + c, _mm256_add_ps(yr, tr));
+		_mm256_storeu_ps(ai + c, _mm256_add_ps(yi, ti));
+	}
+	if (c < count)
+	{
+		// The scalar tail is non-VEX code: clear the upper halves first or
+		// every call pays the SSE/AVX transition penalty.
+		_mm256_zeroupper();
+		radix2Scalar(ar + c, ai + c, br + c, bi + c, wr, wi, count - c);
+	}
+}
+
+__attribute__((target("avx2,fma"))) static void radix4AVX2(float *const *re, float *const *im, float w1r, float w1i, float w2r, float w2i, size_t count)
+{
+	const __m256 v1r = _mm256_set1_ps(w1r), v1i = _mm256_set1_ps(w1i);
+	const __m256 v2r = _mm256_set1_ps(w2r), v2i = _mm256_set1_ps(w2i);
+	size_t c = 0;
+	for (; c + 8 <= count; c += 8)
+	{
+		__m256 xr = _mm256_loadu_ps(re[1] + c), xi = _mm256_loadu_ps(im[1] + c);
+		__m256 tr = _mm256_fmsub_ps(v1r, xr, _mm256_mul_ps(v1i, xi));
+		__m256 ti = _mm256_fmadd_ps(v1r, xi, _mm256_mul_ps(v1i, xr));
+		__m256 yr = _mm256_loadu_ps(re[0] + c), yi = _mm256_loadu_ps(im[0] + c);
+		__m256 ar = _mm256_add_ps(yr, tr), ai = _mm256_add_ps(yi, ti);
+		__m256 br = _mm256_sub_ps(yr, tr), bi = _mm256_sub_ps(yi, ti);
+
+		xr = _mm256_loadu_ps(re[3] + c);
+		xi = _mm256_loadu_ps(im[3] + c);
+		tr = _mm256_fmsub_ps(v1r, xr, _mm256_mul_ps(v1i, xi));
+		ti = _mm256_fmadd_ps(v1r, xi, _mm256_mul_ps(v1i, xr));
+		yr = _mm256_loadu_ps(re[2] + c);
+		yi = _mm256_loadu_ps(im[2] + c);
+		__m256 cr = _mm256_add_ps(yr, tr), ci = _mm256_add_ps(yi, ti);
+		__m256 dr = _mm256_sub_ps(yr, tr), di = _mm256_sub_ps(yi, ti);
+
+		tr = _mm256_fmsub_ps(v2r, cr, _mm256_mul_ps(v2i, ci));
+		ti = _mm256_fmadd_ps(v2r, ci, _mm256_mul_ps(v2i, cr));
+		_mm256_storeu_ps(re[0] + c, _mm256_add_ps(ar, tr));
+		_mm256_storeu_ps(im[0] + c, _mm256_add_ps(ai, ti));
+		_mm256_storeu_ps(re[2] + c, _mm256_sub_ps(ar, tr));
+		_mm256_storeu_ps(im[2] + c, _mm256_sub_ps(ai, ti));
+
+		tr = _mm256_fnmsub_ps(v2r, di, _mm256_mul_ps(v2i, dr));
+		ti = _mm256_fmsub_ps(v2r, dr, _mm256_mul_ps(v2i, di));
+		_mm256_storeu_ps(re[1] + c, _mm256_add_ps(br, tr));
+		_mm256_storeu_ps(im[1] + c, _mm256_add_ps(bi, ti));
+		_mm256_storeu_ps(re[3] + c, _mm256_sub_ps(br, tr));
+		_mm256_storeu_ps(im[3] + c, _mm256_sub_ps(bi, ti));
+	}
+	if (c < count)
+	{
+		_mm256_zeroupper();
+		float *r[4] = {re[0] + c, re[1] + c, re[2] + c, re[3] + c};
+		float *i[4] = {im[0] + c, im[1] + c, im[2] + c, im[3] + c};
+		radix4Scalar(r, i, w1r, w1i, w2r, w2i, count - c);
+	}
+}
+
+#endif
+
+} // namespace fftdetail
+
+class FFT2D
+{
+public:
+	enum Kernel
+	{
+		KERNEL_SCALAR,
+		KERNEL_SSE,
+		KERNEL_AVX2
+	};
+
+private:
+	int n, logN;
+	ThreadPool &pool;
+	Kernel kernel;
+	// e^(+2 pi i k / n) for k < n / 2
+	std::vector<float> twRe, twIm;
+	std::vector<int> bitReverse;
+	// Per-worker copy of the block being transformed.
+	std::vector<std::vector<float>> scratch;
+
+	void radix2(float *ar, float *ai, float *br, float *bi, float wr, float wi, size_t count) const
+	{
+		switch (kernel)
+		{
+#ifdef FFT_X86
+		case KERNEL_AVX2:
+			fftdetail::radix2AVX2(ar, ai, br, bi, wr, wi, count);
+			break;
+		case KERNEL_SSE:
+			fftdetail::radix2SSE(ar, ai, br, bi, wr, wi, count);
+			break;
+#endif
+		default:
+			fftdetail::radix2Scalar(ar, ai, br, bi, wr, wi, count);
+			break;
+		}
+	}
+
+	void radix4(float *const *re, float *const *im, float w1r, float w1i, float w2r, float w2i, size_t count) const
+	{
+		switch (kernel)
+		{
+#ifdef FFT_X86
+		case KERNEL_AVX2:
+			fftdetail::radix4AVX2(re, im, w1r, w1i, w2r, w2i, count);
+			break;
+		case KERNEL_SSE:
+			fftdetail::radix4SSE(re, im, w1r, w1i, w2r, w2i, count);
+			break;
+#endif
+		default:
+			fftdetail::radix4Scalar(re, im, w1r, w1i, w2r, w2i, count);
+			break;
+		}
+	}
+
+	// Inverse transform down the columns of a block held in scratch: n rows
+	// of width floats each, already in bit-reversed row order.
+	void transformBlock(float *re, float *im, int width) const
+	{
+		int half = 1;
+		if (logN & 1)
+		{
+			// The lone radix-2 stage has only the trivial twiddle.
+			for (int g = 0; g < n; g += 2)
+			{
+				size_t a = (size_t)g * width, b = a + width;
+				radix2(re + a, im + a, re + b, im + b, 1.0f, 0.0f, width);
+			}
+			half = 2;
+		}
+
+		// Each pass does the stages of size 2*half and 4*half.
+		for (; half < n; half *= 4)
+		{
+			int span = 4 * half;
+			int stride1 = n / (2 * half); // twiddle step for the first stage
+			int stride2 = n / span;		  // and for the second
+			for (int g = 0; g < n; g += span)
+			{
+				for (int j = 0; j < half; ++j)
+				{
+					float *rows[4], *irows[4];
+					for (int q = 0; q < 4; ++q)
+					{
+						size_t offset = (size_t)(g + j + q * half) * width;
+						rows[q] = re + offset;
+						irows[q] = im + offset;
+					}
+					radix4(rows, irows, twRe[j * stride1], twIm[j * stride1],
+						   twRe[j * stride2], twIm[j * stride2], width);
+				}
+			}
+		}
+	}
+
+	// Columns [c0, c0 + width). They are copied out to a contiguous block
+	// first: with power-of-two row strides the column elements would all
+	// land in the same few cache sets.
+	void columnBlock(float *re, float *im, int c0, int width, unsigned worker)
+	{
+		float *sr = scratch[worker].data();
+		float *si = sr + (size_t)n * width;
+		for (int r = 0; r < n; ++r)
+		{
+			const size_t from = (size_t)bitReverse[r] * n + c0;
+			std::copy(re + from, re + from + width, sr + (size_t)r * width);
+			std::copy(im + from, im + from + width, si + (size_t)r * width);
+		}
+		transformBlock(sr, si, width);
+		for (int r = 0; r < n; ++r)
+		{
+			const size_t to = (size_t)r * n + c0;
+			std::copy(sr + (size_t)r * width, sr + (size_t)(r + 1) * width, re + to);
+			std::copy(si + (size_t)r * width, si + (size_t)(r + 1) * width, im + to);
+		}
+	}
+
+	// Rows [r0, r0 + height), transposed into the block on the way in and
+	// back on the way out, so rows go through the same column kernels.
+	void rowBlock(float *re, float *im, int r0, int height, unsigned worker)
+	{
+		float *sr = scratch[worker].data();
+		float *si = sr + (size_t)n * height;
+		float *baseRe = re + (size_t)r0 * n;
+		float *baseIm = im + (size_t)r0 * n;
+		// Column j of the rows becomes block row bitReverse[j]; walking j
+		// outermost keeps the block writes contiguous and the reads to a
+		// handful of sequential streams.
+		for (int j = 0; j < n; ++j)
+		{
+			float *toRe = sr + (size_t)bitReverse[j] * height;
+			float *toIm = si + (size_t)bitReverse[j] * height;
+			for (int i = 0; i < height; ++i)
+			{
+				toRe[i] = baseRe[(size_t)i * n + j];
+				toIm[i] = baseIm[(size_t)i * n + j];
+			}
+		}
+		transformBlock(sr, si, height);
+		for (int j = 0; j < n; ++j)
+		{
+			const float *fromRe = sr + (size_t)j * height;
+			const float *fromIm = si + (size_t)j * height;
+			for (int i = 0; i < height; ++i)
+			{
+				baseRe[(size_t)i * n + j] = fromRe[i];
+				baseIm[(size_t)i * n + j] = fromIm[i];
+			}
+		}
+	}
+
+public:
+	// size must be a power of two.
+	FFT2D(int size, ThreadPool &pool) : n(size), pool(pool), kernel(bestKernel()), scratch(pool.numWorkers())
+	{
+		logN = 0;
+		while ((1 << logN) < n)
+			++logN;
+
+		twRe.resize(std::max(n / 2, 1));
+		twIm.resize(std::max(n / 2, 1));
+		for (int k = 0; k < n / 2; ++k)
+		{
+			double a = 2.0 * M_PI * k / n;
+			twRe[k] = (float)cos(a);
+			twIm[k] = (float)sin(a);
+		}
+
+		bitReverse.resize(n);
+		for (int i = 0; i < n; ++i)
+		{
+			int r = 0;
+			for (int b = 0; b < logN; ++b)
+				r |= ((i >> b) & 1) << (logN - 1 - b);
+			bitReverse[i] = r;
+		}
+	}
+
+	// Widest kernel this CPU can run.
+	static Kernel bestKernel()
+	{
+#ifdef FFT_X86
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+			return KERNEL_AVX2;
+		return KERNEL_SSE;
+#else
+		return KERNEL_SCALAR;
+#endif
+	}
+
+	void setKernel(Kernel k) { kernel = k > bestKernel() ? bestKernel() : k; }
+	Kernel getKernel() const { return kernel; }
+	int size() const { return n; }
+
+	// Unnormalised inverse 2D transform, in place.
+	void inverse(float *re, float *im)
+	{
+		int columns = std::min(n, FFT_BLOCK_COLUMNS);
+		int rows = std::min(n, FFT_BLOCK_ROWS);
+		for (std::vector<float> &buffer : scratch)
+			buffer.resize((size_t)2 * n * columns);
+
+		pool.parallelFor(n / columns, [&](size_t task, unsigned worker)
+						 { columnBlock(re, im, (int)task * columns, columns, worker); });
+		pool.parallelFor(n / rows, [&](size_t task, unsigned worker)
+						 { rowBlock(re, im, (int)task * rows, rows, worker); });
+	}
+};
+
+#endif
@@ -0,0 +1,452 @@
+#ifndef FOAM_PARTICLES_HPP
+#define FOAM_PARTICLES_HPP
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "ThreadPool.hpp"
+#include "WaveField.hpp"
+
+// Whitecaps and spray where the Gerstner waves fold.
+//
+// Every frame the surface is sampled on a fieldSize x fieldSize grid around a
+// focus point (the camera). At each sample the chain through the waves (see
+// gerstnerChainScalar()) gives the displaced point and the Jacobian of the
+// horizontal displacement, J = dX/du dZ/dv - dX/dv dZ/du: 1 on a flat sea,
+// shrinking where the sharpness Q pinches crests together and negative where
+// the surface folds over. Samples with J under the threshold emit foam, which
+// drifts off with the crest and slows down; well under it, some of it is
+// spray, thrown up and falling under gravity. Foam keeps the height it was
+// born at.
+//
+// Particles live in fixed-capacity SoA arrays allocated once. A frame updates
+// them in chunks on the pool with SIMD kernels, packs each chunk's survivors
+// at its front, fills the gaps between chunks from the top and appends the
+// new particles, so the live ones are always [0, numLive()), in no
+// particular order.
+
+// Particles per update task.
+#define FOAM_CHUNK 16384
+#define FOAM_GRAVITY 9.81f
+
+// The per-particle arrays. age runs from 0 at birth to 1 at death, by
+// ageRate per second; gravity is 0 for foam.
+enum FoamAttribute
+{
+	FA_X, FA_Y, FA_Z,
+	FA_VX, FA_VY, FA_VZ,
+	FA_AGE, FA_AGE_RATE, FA_GRAVITY,
+	FA_COUNT
+};
+
+// The sampled surface: displaced point, its velocity and J.
+enum FoamFieldChannel
+{
+	FF_X, FF_Y, FF_Z,
+	FF_VX, FF_VY, FF_VZ,
+	FF_J,
+	FF_COUNT
+};
+
+struct FoamSettings
+{
+	size_t capacity = 1u << 20;   // particles the pool holds
+	int fieldSize = 128;          // surface samples per side
+	float fieldSpacing = 0.5f;    // world units between samples
+	float threshold = 0.6f;       // J under which foam is emitted
+	float sprayThreshold = 0.45f; // J under which some of it is spray
+	float sprayShare = 0.3f;      // of the particles emitted there
+	float rate = 400.0f;          // per second per sample, at J = threshold - 1 and below
+	float foamLife = 3.0f;        // seconds, the longest; each gets 50-100%
+	float sprayLife = 1.2f;
+	float sprayLift = 3.0f;       // upward speed of new spray, units per second
+	float drag = 0.8f;            // fraction of the speed lost per second
+};
+
+// Advances particles [begin, end) by dt: gravity, drag, then position and age.
+static void foamUpdateScalar(float *const *a, size_t begin, size_t end, float dt, float damp)
+{
+	for (size_t i = begin; i < end; ++i)
+	{
+		float vx = a[FA_VX][i] * damp;
+		float vy = (a[FA_VY][i] - a[FA_GRAVITY][i] * dt) * damp;
+		float vz = a[FA_VZ][i] * damp;
+		a[FA_VX][i] = vx;
+		a[FA_VY][i] = vy;
+		a[FA_VZ][i] = vz;
+		a[FA_X][i] += vx * dt;
+		a[FA_Y][i] += vy * dt;
+		a[FA_Z][i] += vz * dt;
+		a[FA_AGE][i] += a[FA_AGE_RATE][i] * dt;
+	}
+}
+
+// The displaced point and J of samples (u0 + i * step, v) for i in [0, n),
+// into f[FF_X..FF_Z] and f[FF_J] from begin.
+static void foamChainScalar(const GerstnerTerm *terms, int numTerms, float u0, float v, float step,
+							float *const *f, size_t begin, int n)
+{
+	for (int i = 0; i < n; ++i)
+	{
+		float p[WD_COUNT] = {u0 + i * step, 0.0f, v, 1.0f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+		gerstnerChainScalar(terms, numTerms, p);
+		f[FF_X][begin + i] = p[WD_X];
+		f[FF_Y][begin + i] = p[WD_Y];
+		f[FF_Z][begin + i] = p[WD_Z];
+		f[FF_J][begin + i] = p[WD_XU] * p[WD_ZV] - p[WD_XV] * p[WD_ZU];
+	}
+}
+
+#ifdef WAVE_FIELD_X86
+
+// foamUpdateScalar for 4 particles at a time.
+static void foamUpdateSSE(float *const *a, size_t begin, size_t end, float dt, float damp)
+{
+	const __m128 vdt = _mm_set1_ps(dt), vdamp = _mm_set1_ps(damp);
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 vx = _mm_mul_ps(_mm_loadu_ps(a[FA_VX] + i), vdamp);
+		__m128 vy = _mm_sub_ps(_mm_loadu_ps(a[FA_VY] + i), _mm_mul_ps(_mm_loadu_ps(a[FA_GRAVITY] + i), vdt));
+		vy = _mm_mul_ps(vy, vdamp);
+		__m128 vz = _mm_mul_ps(_mm_loadu_ps(a[FA_VZ] + i), vdamp);
+		_mm_storeu_ps(a[FA_VX] + i, vx);
+		_mm_storeu_ps(a[FA_VY] + i, vy);
+		_mm_storeu_ps(a[FA_VZ] + i, vz);
+		_mm_storeu_ps(a[FA_X] + i, _mm_add_ps(_mm_loadu_ps(a[FA_X] + i), _mm_mul_ps(vx, vdt)));
+		_mm_storeu_ps(a[FA_Y] + i, _mm_add_ps(_mm_loadu_ps(a[FA_Y] + i), _mm_mul_ps(vy, vdt)));
+		_mm_storeu_ps(a[FA_Z] + i, _mm_add_ps(_mm_loadu_ps(a[FA_Z] + i), _mm_mul_ps(vz, vdt)));
+		_mm_storeu_ps(a[FA_AGE] + i,
+					  _mm_add_ps(_mm_loadu_ps(a[FA_AGE] + i), _mm_mul_ps(_mm_loadu_ps(a[FA_AGE_RATE] + i), vdt)));
+	}
+	foamUpdateScalar(a, i, end, dt, damp);
+}
+
+// foamChainScalar for 4 samples at a time.
+static void foamChainSSE(const GerstnerTerm *terms, int numTerms, float u0, float v, float step,
+						 float *const *f, size_t begin, int n)
+{
+	const __m128 lane = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+	int i = 0;
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128 p[WD_COUNT];
+		p[WD_X] = _mm_add_ps(_mm_set1_ps(u0 + i * step), _mm_mul_ps(lane, _mm_set1_ps(step)));
+		p[WD_Y] = _mm_setzero_ps();
+		p[WD_Z] = _mm_set1_ps(v);
+		p[WD_XU] = p[WD_ZV] = _mm_set1_ps(1.0f);
+		p[WD_XV] = p[WD_YU] = p[WD_YV] = p[WD_ZU] = _mm_setzero_ps();
+		gerstnerChainSSE(terms, numTerms, p);
+		_mm_storeu_ps(f[FF_X] + begin + i, p[WD_X]);
+		_mm_storeu_ps(f[FF_Y] + begin + i, p[WD_Y]);
+		_mm_storeu_ps(f[FF_Z] + begin + i, p[WD_Z]);
+		_mm_storeu_ps(f[FF_J] + begin + i,
+					  _mm_sub_ps(_mm_mul_ps(p[WD_XU], p[WD_ZV]), _mm_mul_ps(p[WD_XV], p[WD_ZU])));
+	}
+	foamChainScalar(terms, numTerms, u0 + i * step, v, step, f, begin + i, n - i);
+}
+
+// foamUpdateScalar for 8 particles at a time.
+__attribute__((target("avx2,fma"))) static void foamUpdateAVX2(float *const *a, size_t begin, size_t end, float dt,
+															   float damp)
+{
+	const __m256 vdt = _mm256_set1_ps(dt), vdamp = _mm256_set1_ps(damp);
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 vx = _mm256_mul_ps(_mm256_loadu_ps(a[FA_VX] + i), vdamp);
+		__m256 vy = _mm256_fnmadd_ps(_mm256_loadu_ps(a[FA_GRAVITY] + i), vdt, _mm256_loadu_ps(a[FA_VY] + i));
+		vy = _mm256_mul_ps(vy, vdamp);
+		__m256 vz = _mm256_mul_ps(_mm256_loadu_ps(a[FA_VZ] + i), vdamp);
+		_mm256_storeu_ps(a[FA_VX] + i, vx);
+		_mm256_storeu_ps(a[FA_VY] + i, vy);
+		_mm256_storeu_ps(a[FA_VZ] + i, vz);
+		_mm256_storeu_ps(a[FA_X] + i, _mm256_fmadd_ps(vx, vdt, _mm256_loadu_ps(a[FA_X] + i)));
+		_mm256_storeu_ps(a[FA_Y] + i, _mm256_fmadd_ps(vy, vdt, _mm256_loadu_ps(a[FA_Y] + i)));
+		_mm256_storeu_ps(a[FA_Z] + i, _mm256_fmadd_ps(vz, vdt, _mm256_loadu_ps(a[FA_Z] + i)));
+		_mm256_storeu_ps(a[FA_AGE] + i,
+						 _mm256_fmadd_ps(_mm256_loadu_ps(a[FA_AGE_RATE] + i), vdt, _mm256_loadu_ps(a[FA_AGE] + i)));
+	}
+	foamUpdateSSE(a, i, end, dt, damp);
+}
+
+// foamChainScalar for 8 samples at a time.
+__attribute__((target("avx2,fma"))) static void foamChainAVX2(const GerstnerTerm *terms, int numTerms, float u0,
+															  float v, float step, float *const *f, size_t begin, int n)
+{
+	const __m256 lane = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f);
+	int i = 0;
+	for (; i + 8 <= n; i += 8)
+	{
+		__m256 p[WD_COUNT];
+		p[WD_X] = _mm256_fmadd_ps(lane, _mm256_set1_ps(step), _mm256_set1_ps(u0 + i * step));
+		p[WD_Y] = _mm256_setzero_ps();
+		p[WD_Z] = _mm256_set1_ps(v);
+		p[WD_XU] = p[WD_ZV] = _mm256_set1_ps(1.0f);
+		p[WD_XV] = p[WD_YU] = p[WD_YV] = p[WD_ZU] = _mm256_setzero_ps();
+		gerstnerChainAVX2(terms, numTerms, p);
+		_mm256_storeu_ps(f[FF_X] + begin + i, p[WD_X]);
+		_mm256_storeu_ps(f[FF_Y] + begin + i, p[WD_Y]);
+		_mm256_storeu_ps(f[FF_Z] + begin + i, p[WD_Z]);
+		_mm256_storeu_ps(f[FF_J] + begin + i, _mm256_fmsub_ps(p[WD_XU], p[WD_ZV], _mm256_mul_ps(p[WD_XV], p[WD_ZU])));
+	}
+	foamChainSSE(terms, numTerms, u0 + i * step, v, step, f, begin + i, n - i);
+}
+
+#endif
+
+class FoamParticles
+{
+	FoamSettings settings;
+	const WaveField &field;
+	ThreadPool *pool;
+
+	std::vector<float> data[FA_COUNT];
+	float *arrays[FA_COUNT];
+	size_t live;
+	// survivors of each chunk during update()
+	std::vector<size_t> chunkLive;
+
+	std::vector<float> surface[FF_COUNT];
+	float *channels[FF_COUNT];
+	float originX, originZ;
+	std::vector<GerstnerTerm> terms, earlierTerms;
+
+	uint32_t state;
+	size_t emitted;
+	double lastFieldMs, lastUpdateMs;
+
+	float random()
+	{
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	}
+
+	template <typename Fn>
+	void run(size_t tasks, Fn fn)
+	{
+		if (pool && tasks > 1)
+			pool->parallelFor(tasks, [&](size_t t, unsigned) { fn(t); });
+		else
+			for (size_t t = 0; t < tasks; ++t)
+				fn(t);
+	}
+
+	// Row j of the surface: the points as they are now and 1/60 s earlier,
+	// their difference giving the velocity.
+	void sampleRow(size_t j)
+	{
+		const float h = 1.0f / 60.0f;
+		const int n = settings.fieldSize;
+		const size_t begin = j * n, end = begin + n;
+		const float step = settings.fieldSpacing, v = originZ + j * step;
+		float *ex = channels[FF_VX], *ey = channels[FF_VY], *ez = channels[FF_VZ];
+		for (int i = 0; i < n; ++i)
+		{
+			ex[begin + i] = originX + i * step;
+			ey[begin + i] = 0.0f;
+			ez[begin + i] = v;
+		}
+		field.displace(earlierTerms, ex, ey, ez, begin, end);
+
+		switch (field.getKernel())
+		{
+#ifdef WAVE_FIELD_X86
+		case WaveField::KERNEL_AVX2:
+			foamChainAVX2(terms.data(), (int)terms.size(), originX, v, step, channels, begin, n);
+			break;
+		case WaveField::KERNEL_SSE:
+			foamChainSSE(terms.data(), (int)terms.size(), originX, v, step, channels, begin, n);
+			break;
+#endif
+		default:
+			foamChainScalar(terms.data(), (int)terms.size(), originX, v, step, channels, begin, n);
+			break;
+		}
+
+		for (size_t i = begin; i < end; ++i)
+		{
+			ex[i] = (channels[FF_X][i] - ex[i]) / h;
+			ey[i] = (channels[FF_Y][i] - ey[i]) / h;
+			ez[i] = (channels[FF_Z][i] - ez[i]) / h;
+		}
+	}
+
+	// Moves chunk c forward by dt and its survivors to the chunk's front.
+	// Each dead particle is replaced by the chunk's last, so only as many
+	// are copied as die.
+	void updateChunk(size_t c, float dt, float damp)
+	{
+		size_t begin = c * FOAM_CHUNK, end = std::min(live, begin + FOAM_CHUNK);
+		switch (field.getKernel())
+		{
+#ifdef WAVE_FIELD_X86
+		case WaveField::KERNEL_AVX2:
+			foamUpdateAVX2(arrays, begin, end, dt, damp);
+			break;
+		case WaveField::KERNEL_SSE:
+			foamUpdateSSE(arrays, begin, end, dt, damp);
+			break;
+#endif
+		default:
+			foamUpdateScalar(arrays, begin, end, dt, damp);
+			break;
+		}
+
+		const float *age = arrays[FA_AGE];
+		for (size_t i = begin; i < end;)
+		{
+			if (age[i] < 1.0f)
+			{
+				++i;
+				continue;
+			}
+			--end;
+			for (int k = 0; k < FA_COUNT; ++k)
+				arrays[k][i] = arrays[k][end];
+		}
+		chunkLive[c] = end - begin;
+	}
+
+	// After updateChunk() on each of chunks: fills the dead tails of the
+	// chunks below the new live count with the live particles above it,
+	// lowest holes from the highest particles, and returns the count.
+	size_t gather(size_t chunks)
+	{
+		size_t total = 0;
+		for (size_t c = 0; c < chunks; ++c)
+			total += chunkLive[c];
+
+		// Hole run [h, hEnd) in chunk hc - 1, source run [sBegin, s) in chunk sc.
+		size_t hc = 0, h = 0, hEnd = 0, sc = chunks, sBegin = 0, s = 0;
+		for (;;)
+		{
+			while (h == hEnd && hc < chunks)
+			{
+				h = hc * FOAM_CHUNK + chunkLive[hc];
+				hEnd = std::max(h, std::min((hc + 1) * FOAM_CHUNK, total));
+				++hc;
+			}
+			while (s == sBegin && sc > 0)
+			{
+				--sc;
+				sBegin = std::max(sc * FOAM_CHUNK, total);
+				s = std::max(sBegin, sc * FOAM_CHUNK + chunkLive[sc]);
+			}
+			if (h == hEnd || s == sBegin)
+				break;
+			size_t n = std::min(hEnd - h, s - sBegin);
+			for (int k = 0; k < FA_COUNT; ++k)
+				memcpy(arrays[k] + h, arrays[k] + s - n, n * sizeof(float));
+			h += n;
+			s -= n;
+		}
+		return total;
+	}
+
+	void spawn(size_t s, bool spray)
+	{
+		size_t i = live++;
+		float jitter = settings.fieldSpacing;
+		arrays[FA_X][i] = channels[FF_X][s] + (random() - 0.5f) * jitter;
+		arrays[FA_Y][i] = channels[FF_Y][s];
+		arrays[FA_Z][i] = channels[FF_Z][s] + (random() - 0.5f) * jitter;
+		arrays[FA_VX][i] = channels[FF_VX][s];
+		arrays[FA_VY][i] = spray ? channels[FF_VY][s] + settings.sprayLift * (0.5f + random()) : 0.0f;
+		arrays[FA_VZ][i] = channels[FF_VZ][s];
+		float life = (spray ? settings.sprayLife : settings.foamLife) * (0.5f + 0.5f * random());
+		arrays[FA_AGE][i] = 0.0f;
+		arrays[FA_AGE_RATE][i] = 1.0f / life;
+		arrays[FA_GRAVITY][i] = spray ? FOAM_GRAVITY : 0.0f;
+	}
+
+	void emit(float dt)
+	{
+		emitted = 0;
+		const size_t samples = (size_t)settings.fieldSize * settings.fieldSize;
+		for (size_t s = 0; s < samples && live < settings.capacity; ++s)
+		{
+			float J = channels[FF_J][s];
+			if (J >= settings.threshold)
+				continue;
+			// Whole particles plus one more with the leftover as probability.
+			float expected = settings.rate * dt * std::min(settings.threshold - J, 1.0f);
+			int count = (int)(expected + random());
+			bool sprays = J < settings.sprayThreshold;
+			for (int k = 0; k < count && live < settings.capacity; ++k)
+				spawn(s, sprays && random() < settings.sprayShare);
+			emitted += count;
+		}
+	}
+
+public:
+	// The pool runs the surface rows and particle chunks; without one,
+	// everything runs on the calling thread.
+	FoamParticles(const WaveField &field, const FoamSettings &s = FoamSettings(), ThreadPool *pool = nullptr)
+		: settings(s), field(field), pool(pool), live(0), originX(0.0f), originZ(0.0f), state(1), emitted(0),
+		  lastFieldMs(0.0), lastUpdateMs(0.0)
+	{
+		for (int k = 0; k < FA_COUNT; ++k)
+		{
+			data[k].resize(settings.capacity);
+			arrays[k] = data[k].data();
+		}
+		chunkLive.resize((settings.capacity + FOAM_CHUNK - 1) / FOAM_CHUNK);
+		for (int k = 0; k < FF_COUNT; ++k)
+		{
+			surface[k].resize((size_t)settings.fieldSize * settings.fieldSize);
+			channels[k] = surface[k].data();
+		}
+		setFocus(0.0f, 0.0f);
+	}
+
+	FoamParticles(const FoamParticles &) = delete;
+	FoamParticles &operator=(const FoamParticles &) = delete;
+
+	// Centres the surface samples on (x, z), on whole samples so the
+	// emission doesn't shimmer as the focus moves.
+	void setFocus(float x, float z)
+	{
+		float step = settings.fieldSpacing, half = 0.5f * settings.fieldSize * step;
+		originX = floorf((x - half) / step) * step;
+		originZ = floorf((z - half) / step) * step;
+	}
+
+	// Ages and moves the particles by dt, drops the dead ones and emits from
+	// the surface at time.
+	void update(float time, float dt)
+	{
+		auto start = std::chrono::steady_clock::now();
+		foldGerstnerTerms(field.getWaves(), time, terms);
+		foldGerstnerTerms(field.getWaves(), time - 1.0f / 60.0f, earlierTerms);
+		run(settings.fieldSize, [&](size_t j) { sampleRow(j); });
+		auto sampled = std::chrono::steady_clock::now();
+
+		const float damp = std::max(0.0f, 1.0f - settings.drag * dt);
+		size_t chunks = (live + FOAM_CHUNK - 1) / FOAM_CHUNK;
+		run(chunks, [&](size_t c) { updateChunk(c, dt, damp); });
+		live = gather(chunks);
+		emit(dt);
+
+		auto end = std::chrono::steady_clock::now();
+		lastFieldMs = std::chrono::duration<double, std::milli>(sampled - start).count();
+		lastUpdateMs = std::chrono::duration<double, std::milli>(end - sampled).count();
+	}
+
+	const FoamSettings &getSettings() const { return settings; }
+	size_t numLive() const { return live; }
+	size_t capacity() const { return settings.capacity; }
+	// Particles the last update() wanted to emit (some may not have fit).
+	size_t numEmitted() const { return emitted; }
+	// One of the FA_* arrays, numLive() long.
+	const float *attribute(FoamAttribute a) const { return arrays[a]; }
+	// One of the FF_* channels, fieldSize x fieldSize, rows along z.
+	const float *fieldChannel(FoamFieldChannel c) const { return channels[c]; }
+	double getLastFieldMs() const { return lastFieldMs; }
+	double getLastUpdateMs() const { return lastUpdateMs; }
+};
+
+#endif
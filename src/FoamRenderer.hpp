@@ -0,0 +1,116 @@
+#ifndef FOAM_RENDERER_HPP
+#define FOAM_RENDERER_HPP
+
+#include <algorithm>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "shader.hpp"
+#include "GLState.hpp"
+#include "Profiler.hpp"
+#include "FoamParticles.hpp"
+
+// Binding point of FoamData, after the mesh's (see TextureMesh.hpp).
+#define FOAM_UBO_BINDING 5
+
+// Mirrors "uniform FoamData" in foam_vertex.glsl (std140).
+struct FoamUniforms
+{
+	glm::mat4 VP;
+	glm::vec4 right; // camera right in world space, w = sprite radius
+	glm::vec4 up;    // camera up in world space
+	glm::vec4 color;
+};
+static_assert(sizeof(FoamUniforms) == 112, "FoamUniforms must match the std140 FoamData block");
+
+// Draws the live particles of a FoamParticles as camera-facing sprites in one
+// glDrawArraysInstanced: four vertices per instance, corners from
+// gl_VertexID. The x, y, z and age arrays are copied as they are into four
+// runs of one buffer each frame, read as attributes 0-3 advanced per
+// instance, so the SoA layout never gets interleaved on the CPU. Sprites are
+// blended without writing depth and fade out with age.
+class FoamRenderer
+{
+	GLuint vao, vbo;
+	size_t capacity; // particles per run in vbo
+	UniformBuffer foamUBO;
+	float radius;
+
+	static GLuint program()
+	{
+		static GLuint id = 0;
+		if (!id)
+		{
+			id = LoadShaders("shaders/foam_vertex.glsl", "shaders/foam_fragment.glsl");
+			bindUniformBlock(id, "FoamData", FOAM_UBO_BINDING);
+		}
+		return id;
+	}
+
+public:
+	FoamRenderer() : vao(0), vbo(0), capacity(0), radius(0.08f)
+	{
+		foamUBO.create(FOAM_UBO_BINDING, sizeof(FoamUniforms));
+		glGenVertexArrays(1, &vao);
+		glGenBuffers(1, &vbo);
+	}
+
+	~FoamRenderer()
+	{
+		glDeleteBuffers(1, &vbo);
+		glDeleteVertexArrays(1, &vao);
+		glState().forgetVertexArray(vao);
+	}
+
+	FoamRenderer(const FoamRenderer &) = delete;
+	FoamRenderer &operator=(const FoamRenderer &) = delete;
+
+	void setRadius(float r) { radius = r; }
+
+	void draw(const FoamParticles &foam, glm::mat4 V, glm::mat4 P)
+	{
+		size_t n = foam.numLive();
+		if (n == 0)
+			return;
+		PROFILE_CPU("foam");
+
+		// The runs sit capacity apart, so the attribute offsets only change
+		// when the pool grows; orphan the storage every frame so the driver
+		// doesn't wait for last frame's draw.
+		glState().bindVertexArray(vao);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		if (foam.capacity() != capacity)
+		{
+			capacity = foam.capacity();
+			for (int a = 0; a < 4; ++a)
+			{
+				glVertexAttribPointer(a, 1, GL_FLOAT, GL_FALSE, 0, (void *)(a * capacity * sizeof(float)));
+				glVertexAttribDivisor(a, 1);
+				glEnableVertexAttribArray(a);
+			}
+		}
+		glBufferData(GL_ARRAY_BUFFER, 4 * capacity * sizeof(float), NULL, GL_STREAM_DRAW);
+		const FoamAttribute runs[4] = {FA_X, FA_Y, FA_Z, FA_AGE};
+		for (int a = 0; a < 4; ++a)
+			glBufferSubData(GL_ARRAY_BUFFER, a * capacity * sizeof(float), n * sizeof(float), foam.attribute(runs[a]));
+
+		FoamUniforms u;
+		u.VP = P * V;
+		u.right = glm::vec4(V[0][0], V[1][0], V[2][0], radius);
+		u.up = glm::vec4(V[0][1], V[1][1], V[2][1], 0.0f);
+		u.color = glm::vec4(0.95f, 0.97f, 1.0f, 0.8f);
+		foamUBO.update(&u, sizeof(u));
+		foamUBO.bind();
+
+		glState().useProgram(program());
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		glDepthMask(GL_FALSE);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei)n);
+		glDepthMask(GL_TRUE);
+		glDisable(GL_BLEND);
+	}
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef FRUSTUM_HPP
+#define FRUSTUM_HPP
+
+#include <glm/glm.hpp>
+
+// The six clip planes of a view-projection matrix, in world space, for
+// conservative culling on the CPU. Planes point inwards and are not
+// normalised, which is fine for inside/outside tests.
+struct Frustum
+{
+	glm::vec4 planes[6];
+
+	Frustum() {}
+	explicit Frustum(const glm::mat4 &MVP) { set(MVP); }
+
+	// Gribb/Hartmann: each plane is the last row of the matrix plus or minus
+	// one of the others (glm is column-major, so row i is m[0][i]..m[3][i]).
+	void set(const glm::mat4 &m)
+	{
+		for (int i = 0; i < 3; ++i)
+		{
+			glm::vec4 row(m[0][i], m[1][i], m[2][i], m[3][i]);
+			glm::vec4 w(m[0][3], m[1][3], m[2][3], m[3][3]);
+			planes[2 * i] = w + row;
+			planes[2 * i + 1] = w - row;
+		}
+	}
+
+	// False only if the box is entirely behind one plane. Boxes near a
+	// frustum corner can pass without being visible; that is the usual
+	// trade-off for testing the planes independently.
+	bool intersectsBox(const glm::vec3 &lo, const glm::vec3 &hi) const
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			const glm::vec4 &p = planes[i];
+			// The corner furthest along the plane normal.
+			float x = p.x >= 0.0f ? hi.x : lo.x;
+			float y = p.y >= 0.0f ? hi.y : lo.y;
+			float z = p.z >= 0.0f ? hi.z : lo.z;
+			if (p.x * x + p.y * y + p.z * z + p.w < 0.0f)
+				return false;
+		}
+		return true;
+	}
+};
+
+#endif
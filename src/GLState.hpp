@@ -0,0 +1,220 @@
+#ifndef GL_STATE_HPP
+#define GL_STATE_HPP
+
+#include <string.h>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Shadows the bits of GL state that draws keep re-setting and skips calls
+// that would not change anything. Code that changes this state behind the
+// cache's back must call invalidate().
+
+#define GL_STATE_TEXTURE_UNITS 16
+#define GL_STATE_UNIFORM_BINDINGS 16
+
+class GLStateCache
+{
+	GLuint program;
+	GLuint vertexArray;
+	GLint patchVertices;
+	GLenum activeUnit;
+	GLuint textures[GL_STATE_TEXTURE_UNITS];
+	GLenum textureTargets[GL_STATE_TEXTURE_UNITS];
+	GLuint uniformBuffers[GL_STATE_UNIFORM_BINDINGS];
+
+	// Redundant calls skipped since the last invalidate(), for profiling.
+	size_t skipped;
+
+	void activeTexture(GLenum unit)
+	{
+		if (activeUnit != unit)
+		{
+			glActiveTexture(GL_TEXTURE0 + unit);
+			activeUnit = unit;
+		}
+	}
+
+public:
+	GLStateCache() { invalidate(); }
+
+	void invalidate()
+	{
+		program = ~0u;
+		vertexArray = ~0u;
+		patchVertices = -1;
+		activeUnit = ~0u;
+		for (int i = 0; i < GL_STATE_TEXTURE_UNITS; ++i)
+		{
+			textures[i] = ~0u;
+			textureTargets[i] = 0;
+		}
+		for (int i = 0; i < GL_STATE_UNIFORM_BINDINGS; ++i)
+			uniformBuffers[i] = ~0u;
+		skipped = 0;
+	}
+
+	void useProgram(GLuint id)
+	{
+		if (program == id)
+		{
+			++skipped;
+			return;
+		}
+		glUseProgram(id);
+		program = id;
+	}
+
+	void bindVertexArray(GLuint id)
+	{
+		if (vertexArray == id)
+		{
+			++skipped;
+			return;
+		}
+		glBindVertexArray(id);
+		vertexArray = id;
+	}
+
+	// Leaves unit active even when the bind is skipped, so glTex* calls
+	// after it always reach id.
+	void bindTexture(GLenum unit, GLenum target, GLuint id)
+	{
+		activeTexture(unit);
+		if (unit < GL_STATE_TEXTURE_UNITS && textures[unit] == id && textureTargets[unit] == target)
+		{
+			++skipped;
+			return;
+		}
+		glBindTexture(target, id);
+		if (unit < GL_STATE_TEXTURE_UNITS)
+		{
+			textures[unit] = id;
+			textureTargets[unit] = target;
+		}
+	}
+
+	void bindUniformBuffer(GLuint binding, GLuint buffer)
+	{
+		if (binding < GL_STATE_UNIFORM_BINDINGS && uniformBuffers[binding] == buffer)
+		{
+			++skipped;
+			return;
+		}
+		glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+		if (binding < GL_STATE_UNIFORM_BINDINGS)
+			uniformBuffers[binding] = buffer;
+	}
+
+	void patchParameter(GLint vertices)
+	{
+		if (patchVertices == vertices)
+		{
+			++skipped;
+			return;
+		}
+		glPatchParameteri(GL_PATCH_VERTICES, vertices);
+		patchVertices = vertices;
+	}
+
+	// Drops a deleted object so a later object reusing its name gets rebound.
+	void forgetProgram(GLuint id)
+	{
+		if (program == id)
+			program = ~0u;
+	}
+
+	void forgetTexture(GLuint id)
+	{
+		for (int i = 0; i < GL_STATE_TEXTURE_UNITS; ++i)
+			if (textures[i] == id)
+				textures[i] = ~0u;
+	}
+
+	void forgetVertexArray(GLuint id)
+	{
+		if (vertexArray == id)
+			vertexArray = ~0u;
+	}
+
+	void forgetUniformBuffer(GLuint id)
+	{
+		for (int i = 0; i < GL_STATE_UNIFORM_BINDINGS; ++i)
+			if (uniformBuffers[i] == id)
+				uniformBuffers[i] = ~0u;
+	}
+
+	size_t skippedCalls() const { return skipped; }
+};
+
+GLStateCache &glState()
+{
+	static GLStateCache instance;
+	return instance;
+}
+
+// A std140 uniform block backed by its own buffer, bound to a fixed binding
+// point. update() only uploads when the contents actually changed, so blocks
+// whose values rarely change (materials) cost nothing per frame.
+class UniformBuffer
+{
+	GLuint buffer = 0;
+	GLuint binding = 0;
+	std::vector<unsigned char> shadow;
+	bool written = false;
+
+public:
+	UniformBuffer() {}
+	UniformBuffer(const UniformBuffer &) = delete;
+	UniformBuffer &operator=(const UniformBuffer &) = delete;
+
+	~UniformBuffer()
+	{
+		if (buffer)
+		{
+			glDeleteBuffers(1, &buffer);
+			glState().forgetUniformBuffer(buffer);
+		}
+	}
+
+	void create(GLuint bindingPoint, size_t size)
+	{
+		binding = bindingPoint;
+		shadow.assign(size, 0);
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+	// Returns true if anything was uploaded.
+	bool update(const void *data, size_t size)
+	{
+		if (written && size == shadow.size() && memcmp(shadow.data(), data, size) == 0)
+			return false;
+		memcpy(shadow.data(), data, size);
+		glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, size, data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		written = true;
+		return true;
+	}
+
+	// Binding points are global, so bind before every draw that uses the
+	// block; the state cache drops the call when it is already bound.
+	void bind() const { glState().bindUniformBuffer(binding, buffer); }
+
+	GLuint getBinding() const { return binding; }
+};
+
+// Points the named block in a freshly linked program at a binding point.
+// GLSL 4.10 has no layout(binding = N) for blocks, so this is done once after
+// linking. Blocks that the program doesn't use are silently skipped.
+void bindUniformBlock(GLuint program, const char *blockName, GLuint bindingPoint)
+{
+	GLuint index = glGetUniformBlockIndex(program, blockName);
+	if (index != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, index, bindingPoint);
+}
+
+#endif
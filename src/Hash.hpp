@@ -0,0 +1,20 @@
+#ifndef HASH_HPP
+#define HASH_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FNV1A64_SEED 1469598103934665603ull
+
+// 64-bit FNV-1a, for cache keys. Pass the previous result as seed to hash
+// several pieces as one.
+uint64_t fnv1a64(const void *data, size_t size, uint64_t seed = FNV1A64_SEED)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	uint64_t h = seed;
+	for (size_t i = 0; i < size; ++i)
+		h = (h ^ p[i]) * 1099511628211ull;
+	return h;
+}
+
+#endif
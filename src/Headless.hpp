@@ -0,0 +1,178 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+
+#include <GL/glew.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+// An OpenGL 4.1 core context with no window, rendering into an FBO.
+//
+// Uses EGL on Mesa's surfaceless platform when it is available (no X server
+// and no GPU needed; llvmpipe does the work), otherwise the default EGL
+// display. Either way nothing is ever presented: frames go to an offscreen
+// colour + depth framebuffer that can be read back.
+class HeadlessContext
+{
+	EGLDisplay display = EGL_NO_DISPLAY;
+	EGLContext context = EGL_NO_CONTEXT;
+
+	GLuint fbo = 0, colorRB = 0, depthRB = 0;
+	int width = 0, height = 0;
+
+	static EGLDisplay openDisplay()
+	{
+		const char *clientExts = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+			(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay && clientExts && strstr(clientExts, "EGL_MESA_platform_surfaceless"))
+		{
+			EGLDisplay d = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+			if (d != EGL_NO_DISPLAY)
+				return d;
+		}
+		return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	}
+
+public:
+	~HeadlessContext() { destroy(); }
+
+	bool create(int w, int h)
+	{
+		width = w;
+		height = h;
+
+		display = openDisplay();
+		EGLint major, minor;
+		if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+		{
+			fprintf(stderr, "Failed to initialize EGL\n");
+			return false;
+		}
+
+		const EGLint configAttribs[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_RED_SIZE, 8,
+			EGL_GREEN_SIZE, 8,
+			EGL_BLUE_SIZE, 8,
+			EGL_DEPTH_SIZE, 24,
+			EGL_NONE};
+		EGLConfig config;
+		EGLint numConfigs = 0;
+		if (!eglChooseConfig(display, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+		{
+			fprintf(stderr, "No suitable EGL config\n");
+			return false;
+		}
+
+		if (!eglBindAPI(EGL_OPENGL_API))
+		{
+			fprintf(stderr, "EGL has no desktop OpenGL\n");
+			return false;
+		}
+
+		const EGLint contextAttribs[] = {
+			EGL_CONTEXT_MAJOR_VERSION, 4,
+			EGL_CONTEXT_MINOR_VERSION, 1,
+			EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+			EGL_NONE};
+		context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttribs);
+		if (context == EGL_NO_CONTEXT)
+		{
+			fprintf(stderr, "Failed to create a GL 4.1 core context through EGL\n");
+			return false;
+		}
+
+		// Needs EGL_KHR_surfaceless_context; all rendering goes to our FBO.
+		if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+		{
+			fprintf(stderr, "Failed to make the EGL context current without a surface\n");
+			return false;
+		}
+
+		// GLEW built against GLX reports "no GLX display" here even though
+		// every entry point was loaded fine, so that one is not an error.
+		glewExperimental = true;
+		GLenum err = glewInit();
+		if (err != GLEW_OK && err != GLEW_ERROR_NO_GLX_DISPLAY)
+		{
+			fprintf(stderr, "Failed to initialize GLEW\n");
+			return false;
+		}
+		glGetError(); // glewInit can leave GL_INVALID_ENUM behind
+
+		glGenRenderbuffers(1, &colorRB);
+		glBindRenderbuffer(GL_RENDERBUFFER, colorRB);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+		glGenRenderbuffers(1, &depthRB);
+		glBindRenderbuffer(GL_RENDERBUFFER, depthRB);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+
+		glGenFramebuffers(1, &fbo);
+		glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRB);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRB);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			fprintf(stderr, "Offscreen framebuffer is incomplete\n");
+			return false;
+		}
+
+		glViewport(0, 0, width, height);
+		fprintf(stderr, "Headless GL: %s / %s\n", glGetString(GL_RENDERER), glGetString(GL_VERSION));
+		return true;
+	}
+
+	void destroy()
+	{
+		if (display == EGL_NO_DISPLAY)
+			return;
+		if (context != EGL_NO_CONTEXT)
+		{
+			if (fbo)
+			{
+				glDeleteFramebuffers(1, &fbo);
+				glDeleteRenderbuffers(1, &colorRB);
+				glDeleteRenderbuffers(1, &depthRB);
+				fbo = 0;
+			}
+			eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			eglDestroyContext(display, context);
+			context = EGL_NO_CONTEXT;
+		}
+		eglTerminate(display);
+		display = EGL_NO_DISPLAY;
+	}
+
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+
+	// Writes the current contents of the FBO as a binary PPM.
+	bool writePPM(const char *path) const
+	{
+		std::vector<unsigned char> pixels((size_t)width * height * 3);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+		FILE *file = fopen(path, "wb");
+		if (!file)
+		{
+			fprintf(stderr, "Could not write %s\n", path);
+			return false;
+		}
+		fprintf(file, "P6\n%d %d\n255\n", width, height);
+		// GL rows are bottom-up, PPM rows are top-down.
+		for (int row = height - 1; row >= 0; --row)
+			fwrite(&pixels[(size_t)row * width * 3], 1, (size_t)width * 3, file);
+		fclose(file);
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,181 @@
+#ifndef INSTANCED_MESH_HPP
+#define INSTANCED_MESH_HPP
+
+#include <math.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "TextureMesh.hpp"
+#include "Frustum.hpp"
+
+// count transforms on a square grid centred on the origin, spacing apart,
+// each nudged and turned by a fixed pseudo-random amount so the fleet
+// doesn't look tiled.
+std::vector<glm::mat4> fleetLayout(int count, float spacing)
+{
+	std::vector<glm::mat4> fleet;
+	fleet.reserve(count);
+	int side = (int)ceilf(sqrtf((float)count));
+	uint32_t state = 12345;
+	auto random = [&state]()
+	{
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	};
+	for (int i = 0; i < count; ++i)
+	{
+		float x = ((i % side) - 0.5f * (side - 1) + 0.6f * (random() - 0.5f)) * spacing;
+		float z = ((i / side) - 0.5f * (side - 1) + 0.6f * (random() - 0.5f)) * spacing;
+		glm::mat4 m = glm::translate(glm::mat4(1.0f), glm::vec3(x, 0.0f, z));
+		fleet.push_back(glm::rotate(m, random() * 6.2831853f, glm::vec3(0.0f, 1.0f, 0.0f)));
+	}
+	return fleet;
+}
+
+// Many copies of one textured PLY mesh, each with its own model matrix, in a
+// single glDrawElementsInstanced per frame. draw() packs the matrices of the
+// instances whose box touches the view frustum into one buffer (attributes
+// 3-6, advanced per instance), so culled instances cost the GPU nothing and
+// the per-frame uniform work is one block for the whole fleet.
+class InstancedMesh
+{
+	GLuint vao, instanceVbo, textureID;
+	MeshGeometry geometry;
+	UniformBuffer meshUBO;
+	std::vector<glm::mat4> transforms;
+	std::vector<glm::mat4> visible;
+	GLsizeiptr instanceCapacity; // bytes allocated in instanceVbo
+	double lastCullMs;
+
+	static GLuint program()
+	{
+		static GLuint id = 0;
+		if (!id)
+		{
+			id = LoadShaders("shaders/mesh_instanced_vertex.glsl", "shaders/mesh_fragment.glsl");
+			bindUniformBlock(id, "MeshData", MESH_UBO_BINDING);
+			glState().useProgram(id);
+			glUniform1i(glGetUniformLocation(id, "meshTexture"), 0);
+		}
+		return id;
+	}
+
+	// Keeps the transforms whose world box (the model box carried through
+	// the matrix, Arvo's method) is at least partly inside the frustum.
+	void cull(const glm::mat4 &VP)
+	{
+		auto start = std::chrono::steady_clock::now();
+		Frustum frustum(VP);
+		glm::vec3 center = 0.5f * (geometry.boundsMin + geometry.boundsMax);
+		glm::vec3 extent = 0.5f * (geometry.boundsMax - geometry.boundsMin);
+		visible.clear();
+		for (const glm::mat4 &m : transforms)
+		{
+			glm::vec3 c = glm::vec3(m * glm::vec4(center, 1.0f));
+			glm::vec3 e = glm::abs(glm::vec3(m[0])) * extent.x + glm::abs(glm::vec3(m[1])) * extent.y +
+						  glm::abs(glm::vec3(m[2])) * extent.z;
+			if (frustum.intersectsBox(c - e, c + e))
+				visible.push_back(m);
+		}
+		lastCullMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+public:
+	InstancedMesh(const char *plyPath, const char *bmpPath)
+		: vao(0), instanceVbo(0), textureID(0), instanceCapacity(0), lastCullMs(0.0)
+	{
+		meshUBO.create(MESH_UBO_BINDING, sizeof(MeshUniforms));
+		glGenVertexArrays(1, &vao);
+		glState().bindVertexArray(vao);
+		if (!geometry.load(plyPath))
+			std::cerr << "Failed to load mesh: " << plyPath << std::endl;
+
+		// A mat4 attribute takes four locations, one column each.
+		glGenBuffers(1, &instanceVbo);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+		for (int c = 0; c < 4; ++c)
+		{
+			glVertexAttribPointer(3 + c, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(c * sizeof(glm::vec4)));
+			glVertexAttribDivisor(3 + c, 1);
+			glEnableVertexAttribArray(3 + c);
+		}
+		textureID = loadTextureFromBMP(bmpPath);
+	}
+
+	~InstancedMesh()
+	{
+		geometry.release();
+		if (instanceVbo)
+			glDeleteBuffers(1, &instanceVbo);
+		if (vao)
+		{
+			glDeleteVertexArrays(1, &vao);
+			glState().forgetVertexArray(vao);
+		}
+		if (textureID)
+		{
+			glDeleteTextures(1, &textureID);
+			glState().forgetTexture(textureID);
+		}
+	}
+
+	InstancedMesh(const InstancedMesh &) = delete;
+	InstancedMesh &operator=(const InstancedMesh &) = delete;
+
+	bool isLoaded() const { return geometry.numIndices > 0; }
+	const MeshGeometry &getGeometry() const { return geometry; }
+
+	// One model matrix per instance (rotation, translation and uniform
+	// scale); change them freely between frames.
+	std::vector<glm::mat4> &getTransforms() { return transforms; }
+	void setTransforms(const std::vector<glm::mat4> &m) { transforms = m; }
+
+	size_t numInstances() const { return transforms.size(); }
+	// Instances drawn by the last draw().
+	size_t numVisible() const { return visible.size(); }
+	double getLastCullMs() const { return lastCullMs; }
+
+	void draw(glm::vec3 lightPos, glm::mat4 V, glm::mat4 P)
+	{
+		if (!isLoaded())
+			return;
+		PROFILE_CPU("instances");
+		glm::mat4 VP = P * V;
+		cull(VP);
+		if (visible.empty())
+			return;
+
+		// Orphan the old storage so the driver doesn't wait for last frame's draw.
+		GLsizeiptr bytes = visible.size() * sizeof(glm::mat4);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+		if (bytes > instanceCapacity)
+			instanceCapacity = std::max(bytes, 2 * instanceCapacity);
+		glBufferData(GL_ARRAY_BUFFER, instanceCapacity, NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, bytes, visible.data());
+
+		glState().useProgram(program());
+		glState().bindVertexArray(vao);
+		glState().bindTexture(0, GL_TEXTURE_2D, textureID);
+
+		MeshUniforms u;
+		u.MVP = VP;
+		u.model = glm::mat4(1.0f);
+		u.lightPos = lightPos;
+		u.pad0 = 0.0f;
+		u.viewPos = glm::vec3(glm::inverse(V)[3]);
+		u.pad1 = 0.0f;
+		meshUBO.update(&u, sizeof(u));
+		meshUBO.bind();
+
+		glDrawElementsInstanced(GL_TRIANGLES, geometry.numIndices, GL_UNSIGNED_INT, (void *)0, (GLsizei)visible.size());
+	}
+};
+
+#endif
@@ -1,66 +1,157 @@
-void loadBMP(const char* imagepath, unsigned char** data, unsigned int* width, unsigned int* height) {
-
-    // printf("Reading image %s\n", imagepath);
-
-    // Data read from the header of the BMP file
-    unsigned char header[54];
-    unsigned int dataPos;
-    unsigned int imageSize;
-    // Actual RGB data
-
-    // Open the file
-    FILE * file = fopen(imagepath,"rb");
-    if (!file){
-        printf("%s could not be opened. Are you in the right directory?\n", imagepath);
-        getchar();
-        return;
-    }
-
-    // Read the header, i.e. the 54 first bytes
-
-    // If less than 54 bytes are read, problem
-    if ( fread(header, 1, 54, file)!=54 ){
-        printf("Not a correct BMP file\n");
-        fclose(file);
-        return;
-    }
-    // A BMP files always begins with "BM"
-    if ( header[0]!='B' || header[1]!='M' ){
-        printf("Not a correct BMP file\n");
-        fclose(file);
-        return;
-    }
-    // Make sure this is a 24bpp file
-    if ( *(int*)&(header[0x1E])!=0  ) {
-    	printf("Not a correct BMP file\n");
-	    fclose(file);
-	    return;
+#ifndef LOAD_BMP_HPP
+#define LOAD_BMP_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "MappedFile.hpp"
+
+// Memory-mapped BMP reader. The file is mapped read-only and the pixel rows
+// are handed out in place, so a texture upload reads straight from the page
+// cache without an intermediate copy.
+//
+// Accepts uncompressed 8 (paletted), 24 and 32 bpp images with any
+// BITMAPINFOHEADER or later header, bottom-up or top-down, and 32 bpp
+// BI_BITFIELDS files with the standard BGRA masks. Sizes are 64-bit
+// throughout, so 16k x 16k maps are fine.
+
+// What a MappedBMP describes. Rows are stored BMP-style: padded to four
+// bytes, blue first, and bottom-up unless topDown is set.
+struct BMPImage
+{
+	const unsigned char *pixels; // first stored row
+	unsigned int width, height;
+	int bitsPerPixel;			  // 8, 24 or 32
+	size_t rowStride;			  // bytes from one stored row to the next
+	bool topDown;				  // first stored row is the top of the image
+	const unsigned char *palette; // 8 bpp only: BGRA entries
+	unsigned int paletteSize;
+
+	size_t pixelBytes() const { return rowStride * height; }
+
+	// An 8 bpp image whose palette is the identity ramp, i.e. plain grey levels.
+	bool isGreyscale() const
+	{
+		if (bitsPerPixel != 8)
+			return false;
+		for (unsigned int i = 0; i < paletteSize; ++i)
+		{
+			const unsigned char *c = palette + 4 * i;
+			if (c[0] != i || c[1] != i || c[2] != i)
+				return false;
+		}
+		return true;
 	}
-    if ( *(int*)&(header[0x1C])!=24 ) {
-    	printf("Not a correct BMP file\n");
-	    fclose(file);
-	    return;
+};
+
+static inline uint32_t bmpRead32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint16_t bmpRead16(const unsigned char *p)
+{
+	return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+class MappedBMP
+{
+	MappedFile file;
+	BMPImage img;
+
+	bool fail(const char *path, const char *why)
+	{
+		fprintf(stderr, "%s: %s\n", path, why);
+		close();
+		return false;
 	}
 
-    // Read the information about the image
-    dataPos    = *(int*)&(header[0x0A]);
-    imageSize  = *(int*)&(header[0x22]);
-    *width      = *(int*)&(header[0x12]);
-    *height     = *(int*)&(header[0x16]);
+public:
+	MappedBMP() { memset(&img, 0, sizeof(img)); }
+	explicit MappedBMP(const char *path) : MappedBMP() { open(path); }
+	~MappedBMP() { close(); }
+
+	MappedBMP(const MappedBMP &) = delete;
+	MappedBMP &operator=(const MappedBMP &) = delete;
+
+	// Maps and validates the file. Prints why and returns false if it is not
+	// a BMP this reader supports.
+	bool open(const char *path)
+	{
+		close();
+		if (!file.open(path))
+			return fail(path, "could not be opened. Are you in the right directory?");
+		size_t mappedBytes = file.size();
+		if (mappedBytes < 54)
+			return fail(path, "not a BMP file (too short)");
+		const unsigned char *data = file.data();
+
+		if (data[0] != 'B' || data[1] != 'M')
+			return fail(path, "not a BMP file (no BM signature)");
+		uint32_t dataPos = bmpRead32(data + 0x0A);
+		uint32_t headerSize = bmpRead32(data + 0x0E);
+		if (headerSize < 40 || 14 + (size_t)headerSize > mappedBytes)
+			return fail(path, "unsupported BMP header (OS/2 or truncated)");
+		int32_t w = (int32_t)bmpRead32(data + 0x12);
+		int32_t h = (int32_t)bmpRead32(data + 0x16);
+		uint16_t planes = bmpRead16(data + 0x1A);
+		uint16_t bpp = bmpRead16(data + 0x1C);
+		uint32_t compression = bmpRead32(data + 0x1E);
+		uint32_t colorsUsed = bmpRead32(data + 0x2E);
 
-    // Some BMP files are misformatted, guess missing information
-    if (imageSize==0)    imageSize=(*width)* (*height)*3; // 3 : one byte for each Red, Green and Blue component
-    if (dataPos==0)      dataPos=54; // The BMP header is done that way
+		if (planes != 1 || w <= 0 || h == 0 || h == INT32_MIN)
+			return fail(path, "invalid BMP dimensions");
+		if (bpp != 8 && bpp != 24 && bpp != 32)
+			return fail(path, "only 8, 24 and 32 bpp BMPs are supported");
+		if (compression == 3 && bpp == 32)
+		{
+			// BI_BITFIELDS: fine as long as the masks are the usual BGRA ones.
+			// They follow a 40 byte header, or sit inside a V4/V5 one.
+			if (14 + 40 + 12 > mappedBytes)
+				return fail(path, "truncated BMP bitfields");
+			if (bmpRead32(data + 0x36) != 0x00FF0000 || bmpRead32(data + 0x3A) != 0x0000FF00 ||
+				bmpRead32(data + 0x3E) != 0x000000FF)
+				return fail(path, "only BGRA channel masks are supported");
+		}
+		else if (compression != 0)
+		{
+			return fail(path, "compressed BMPs are not supported");
+		}
 
-    // Create a buffer
-    *data = new unsigned char [imageSize];
+		img.width = (unsigned int)w;
+		img.height = (unsigned int)(h < 0 ? -(int64_t)h : h);
+		img.topDown = h < 0;
+		img.bitsPerPixel = bpp;
+		img.rowStride = (((size_t)img.width * bpp + 31) / 32) * 4;
 
-    // Read the actual data from the file into the buffer
-    fread(*data,1,imageSize,file);
+		if (bpp == 8)
+		{
+			img.paletteSize = colorsUsed ? colorsUsed : 256;
+			if (img.paletteSize > 256 || 14 + (size_t)headerSize + 4 * (size_t)img.paletteSize > mappedBytes)
+				return fail(path, "invalid BMP palette");
+			img.palette = data + 14 + headerSize;
+		}
+
+		if (dataPos == 0)
+			dataPos = 14 + headerSize + 4 * img.paletteSize;
+		if (dataPos > mappedBytes || img.pixelBytes() > mappedBytes - dataPos)
+			return fail(path, "BMP pixel data is truncated");
+		img.pixels = data + dataPos;
+		return true;
+	}
+
+	void close()
+	{
+		file.close();
+		memset(&img, 0, sizeof(img));
+	}
 
-    fprintf(stderr, "Done reading!\n");
+	bool isOpen() const { return file.isOpen(); }
+	const BMPImage &image() const { return img; }
 
-    // Everything is in memory now, the file can be closed.
-    fclose (file);
+	// Reads the whole file ahead; safe from any thread.
+	void prefetch() const { file.prefetch(); }
+};
 
-}
\ No newline at end of file
+#endif
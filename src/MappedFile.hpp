@@ -0,0 +1,80 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <stddef.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A whole file mapped read-only. Loaders parse straight out of the mapping
+// instead of reading into buffers of their own.
+class MappedFile
+{
+	void *mapping;
+	size_t bytes;
+
+public:
+	MappedFile() : mapping(NULL), bytes(0) {}
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	// False if the file can't be opened or is empty.
+	bool open(const char *path)
+	{
+		close();
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0)
+			return false;
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size <= 0)
+		{
+			::close(fd);
+			return false;
+		}
+		void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd); // the mapping keeps the file alive
+		if (m == MAP_FAILED)
+			return false;
+		mapping = m;
+		bytes = (size_t)st.st_size;
+		return true;
+	}
+
+	void close()
+	{
+		if (mapping)
+			munmap(mapping, bytes);
+		mapping = NULL;
+		bytes = 0;
+	}
+
+	bool isOpen() const { return mapping != NULL; }
+	const unsigned char *data() const { return (const unsigned char *)mapping; }
+	size_t size() const { return bytes; }
+
+	// Tells the kernel the file will be read front to back.
+	void adviseSequential() const
+	{
+		if (mapping)
+			madvise(mapping, bytes, MADV_SEQUENTIAL);
+	}
+
+	// Asks the kernel to read the whole file ahead, and touches every page so
+	// later readers don't fault them in one by one. Safe from any thread.
+	void prefetch() const
+	{
+		if (!mapping)
+			return;
+		madvise(mapping, bytes, MADV_WILLNEED);
+		volatile unsigned char sink = 0;
+		size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		for (size_t off = 0; off < bytes; off += page)
+			sink ^= data()[off];
+		(void)sink;
+	}
+};
+
+#endif
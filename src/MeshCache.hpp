@@ -0,0 +1,188 @@
+#ifndef MESH_CACHE_HPP
+#define MESH_CACHE_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <string>
+#include <vector>
+
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+#include "PlyLoader.hpp"
+
+// Cooked meshes: the final interleaved vertex buffer (PLY_VERTEX_FLOATS per
+// vertex, see PlyLoader.hpp), 32-bit triangle indices and bounds, written
+// once by build/cook (src/CookMeshes.cpp) and mapped at startup so the data
+// goes from the page cache straight into glBufferData.
+//
+// Layout: a CookedMeshHeader, then the vertices, then the indices, each
+// starting on a MESH_CACHE_ALIGN boundary. Everything is little-endian.
+//
+// Each file records the size, mtime and a 64-bit FNV-1a hash of the PLY it
+// was cooked from. A cooked mesh is used when its source is unchanged (same
+// size and mtime, or same hash when only the mtime moved, e.g. after a fresh
+// checkout) or when the source isn't there at all, as in a deploy that only
+// ships cooked assets. Anything else is stale and the PLY is parsed instead.
+
+#define MESH_CACHE_MAGIC "OCNMESH"
+#define MESH_CACHE_VERSION 1
+#define MESH_CACHE_ALIGN 64
+#define MESH_CACHE_DIR "build/cooked"
+
+struct CookedMeshHeader
+{
+	char magic[8]; // MESH_CACHE_MAGIC, NUL padded
+	uint32_t version;
+	uint32_t headerBytes;
+	uint64_t sourceSize;
+	int64_t sourceMtime; // seconds
+	uint64_t sourceHash;
+	uint32_t vertexCount;
+	uint32_t vertexStride; // bytes
+	uint32_t indexCount;
+	uint32_t pad0;
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	float boundsMin[3];
+	float boundsMax[3];
+	uint8_t pad1[32];
+};
+static_assert(sizeof(CookedMeshHeader) == 128, "CookedMeshHeader is part of the file format");
+
+// build/cooked/<name>.mesh for a source like assets/<name>.ply.
+std::string cookedMeshPath(const char *sourcePath)
+{
+	std::string name = sourcePath;
+	size_t slash = name.find_last_of('/');
+	if (slash != std::string::npos)
+		name = name.substr(slash + 1);
+	size_t dot = name.find_last_of('.');
+	if (dot != std::string::npos)
+		name = name.substr(0, dot);
+	return std::string(MESH_CACHE_DIR) + "/" + name + ".mesh";
+}
+
+static size_t meshCacheAlign(size_t offset)
+{
+	return (offset + MESH_CACHE_ALIGN - 1) & ~(size_t)(MESH_CACHE_ALIGN - 1);
+}
+
+// Parses sourcePath and writes the cooked mesh to outPath (via a temporary
+// file, so a reader never sees half of it). Returns false with a message on
+// stderr on failure.
+bool cookMesh(const char *sourcePath, const char *outPath)
+{
+	MappedFile source;
+	if (!source.open(sourcePath))
+	{
+		fprintf(stderr, "%s could not be opened\n", sourcePath);
+		return false;
+	}
+	struct stat st;
+	if (stat(sourcePath, &st) != 0)
+		return false;
+
+	PlyMesh mesh;
+	if (!loadPly(sourcePath, mesh))
+		return false;
+
+	CookedMeshHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+	header.version = MESH_CACHE_VERSION;
+	header.headerBytes = sizeof(header);
+	header.sourceSize = (uint64_t)st.st_size;
+	header.sourceMtime = (int64_t)st.st_mtime;
+	header.sourceHash = fnv1a64(source.data(), source.size());
+	header.vertexCount = (uint32_t)mesh.vertexCount();
+	header.vertexStride = PLY_VERTEX_FLOATS * sizeof(float);
+	header.indexCount = (uint32_t)mesh.indices.size();
+	header.vertexOffset = meshCacheAlign(sizeof(header));
+	header.indexOffset = meshCacheAlign(header.vertexOffset + mesh.vertices.size() * sizeof(float));
+	mesh.bounds(header.boundsMin, header.boundsMax);
+
+	std::vector<unsigned char> file(header.indexOffset + mesh.indices.size() * sizeof(uint32_t), 0);
+	memcpy(file.data(), &header, sizeof(header));
+	memcpy(file.data() + header.vertexOffset, mesh.vertices.data(), mesh.vertices.size() * sizeof(float));
+	memcpy(file.data() + header.indexOffset, mesh.indices.data(), mesh.indices.size() * sizeof(uint32_t));
+
+	std::string tmp = std::string(outPath) + ".tmp";
+	FILE *out = fopen(tmp.c_str(), "wb");
+	if (!out)
+	{
+		fprintf(stderr, "Could not write %s\n", tmp.c_str());
+		return false;
+	}
+	bool ok = fwrite(file.data(), 1, file.size(), out) == file.size();
+	ok = fclose(out) == 0 && ok;
+	if (!ok || rename(tmp.c_str(), outPath) != 0)
+	{
+		fprintf(stderr, "Could not write %s\n", outPath);
+		remove(tmp.c_str());
+		return false;
+	}
+	return true;
+}
+
+// A mapped cooked mesh. vertices() and indices() point into the mapping.
+class CookedMesh
+{
+	MappedFile file;
+	const CookedMeshHeader *header;
+
+public:
+	CookedMesh() : header(NULL) {}
+
+	// Maps cookedPath and checks it against sourcePath (see the top of this
+	// file). False, quietly, when there is no cooked file; with a message
+	// when it is corrupt or stale.
+	bool open(const char *cookedPath, const char *sourcePath)
+	{
+		header = NULL;
+		if (!file.open(cookedPath))
+			return false;
+		const CookedMeshHeader *h = (const CookedMeshHeader *)file.data();
+		if (file.size() < sizeof(CookedMeshHeader) || memcmp(h->magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) != 0 ||
+			h->version != MESH_CACHE_VERSION || h->headerBytes != sizeof(CookedMeshHeader) ||
+			h->vertexStride != PLY_VERTEX_FLOATS * sizeof(float) ||
+			h->vertexOffset % MESH_CACHE_ALIGN || h->indexOffset % MESH_CACHE_ALIGN ||
+			h->vertexOffset + (uint64_t)h->vertexCount * h->vertexStride > h->indexOffset ||
+			h->indexOffset + (uint64_t)h->indexCount * sizeof(uint32_t) > file.size())
+		{
+			fprintf(stderr, "%s is not a valid version %d cooked mesh, rerun make cook\n", cookedPath, MESH_CACHE_VERSION);
+			file.close();
+			return false;
+		}
+
+		struct stat st;
+		if (sourcePath && stat(sourcePath, &st) == 0 &&
+			((uint64_t)st.st_size != h->sourceSize || (int64_t)st.st_mtime != h->sourceMtime))
+		{
+			// A new size is stale for sure; a new mtime alone needs the hash.
+			MappedFile source;
+			if ((uint64_t)st.st_size != h->sourceSize || !source.open(sourcePath) ||
+				fnv1a64(source.data(), source.size()) != h->sourceHash)
+			{
+				fprintf(stderr, "%s is older than %s, rerun make cook\n", cookedPath, sourcePath);
+				file.close();
+				return false;
+			}
+		}
+		header = h;
+		return true;
+	}
+
+	bool isOpen() const { return header != NULL; }
+	size_t vertexCount() const { return header->vertexCount; }
+	size_t indexCount() const { return header->indexCount; }
+	size_t vertexBytes() const { return (size_t)header->vertexCount * header->vertexStride; }
+	size_t indexBytes() const { return (size_t)header->indexCount * sizeof(uint32_t); }
+	const float *vertices() const { return (const float *)(file.data() + header->vertexOffset); }
+	const uint32_t *indices() const { return (const uint32_t *)(file.data() + header->indexOffset); }
+	const float *boundsMin() const { return header->boundsMin; }
+	const float *boundsMax() const { return header->boundsMax; }
+};
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef OCEAN_QUADTREE_HPP
+#define OCEAN_QUADTREE_HPP
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "Frustum.hpp"
+
+// Continuous-LOD quadtree (CDLOD) for an ocean that follows the camera.
+//
+// Every frame select() walks a quadtree over a worldSize x worldSize square
+// centred under the camera and returns the nodes to draw. Each node is drawn
+// with the same patchQuads x patchQuads patch mesh scaled to its size, so a
+// level L node has vertices every gridUnit * 2^L. Level L is used up to
+// lodRange(L) = lodRatio * nodeSize(L) from the camera; in the last
+// (1 - morphStart) of that range cdlod_vertex.glsl morphs the vertices onto
+// the next level's grid, so switching levels never pops.
+//
+// The morph only depends on a vertex's world position and the camera, never
+// on which node it came from, so nodes of different levels always meet
+// without cracks. The selection only has to guarantee that no node is coarser
+// than its nearest point needs, which it does by splitting every node that
+// reaches into the next finer level's range.
+
+#define OCEAN_MAX_LEVELS 24
+
+struct OceanSettings
+{
+	float worldSize = 100000.0f; // side of the square of sea kept around the camera
+	float gridUnit = 1.0f;       // vertex spacing of the finest level
+	int patchQuads = 16;         // quads per side of the shared patch mesh, a power of two
+	float lodRatio = 2.0f;       // level L is used up to lodRatio * nodeSize(L) away
+	float morphStart = 0.7f;     // fraction of each range where morphing to the next level starts
+};
+
+// Per-instance data for one selected node: min corner, side and level.
+struct OceanNode
+{
+	float x, z, size, level;
+};
+
+class OceanQuadtree
+{
+	OceanSettings settings;
+	int levels;
+	float nodeSizes[OCEAN_MAX_LEVELS];
+	float ranges[OCEAN_MAX_LEVELS];
+
+	// Per-select() state.
+	std::vector<OceanNode> selection;
+	std::vector<Frustum> frusta;
+	glm::vec3 camera;
+	float maxDisplacement;
+	size_t visited;
+	double selectMs;
+
+	// Whether any point of the node (on the flat y = 0 sea) is within r of the camera.
+	bool nearerThan(float x, float z, float size, float r) const
+	{
+		float dx = std::max(std::max(x - camera.x, camera.x - (x + size)), 0.0f);
+		float dz = std::max(std::max(z - camera.z, camera.z - (z + size)), 0.0f);
+		return dx * dx + camera.y * camera.y + dz * dz < r * r;
+	}
+
+	void selectNode(float x, float z, int level)
+	{
+		++visited;
+		float size = nodeSizes[level];
+
+		// Waves move the surface by up to maxDisplacement. Morphing moves a
+		// vertex by less than one spacing of the grid it morphs to, and a
+		// node's far corner is at most two levels coarser than the node.
+		float grow = maxDisplacement + 8.0f * size / settings.patchQuads;
+		glm::vec3 lo(x - grow, -maxDisplacement, z - grow);
+		glm::vec3 hi(x + size + grow, maxDisplacement, z + size + grow);
+		bool seen = false;
+		for (size_t i = 0; i < frusta.size() && !seen; ++i)
+			seen = frusta[i].intersectsBox(lo, hi);
+		if (!seen)
+			return;
+
+		if (level == 0 || !nearerThan(x, z, size, ranges[level - 1]))
+		{
+			selection.push_back(OceanNode{x, z, size, (float)level});
+			return;
+		}
+
+		float half = 0.5f * size;
+		selectNode(x, z, level - 1);
+		selectNode(x + half, z, level - 1);
+		selectNode(x, z + half, level - 1);
+		selectNode(x + half, z + half, level - 1);
+	}
+
+public:
+	explicit OceanQuadtree(const OceanSettings &s) : settings(s)
+	{
+		// Smaller ratios let a node's far corner get more than two levels
+		// coarser than the node, which the culling margin in selectNode()
+		// doesn't cover.
+		settings.lodRatio = std::max(settings.lodRatio, 1.5f);
+		settings.morphStart = std::min(std::max(settings.morphStart, 0.0f), 0.95f);
+
+		float leafSize = settings.gridUnit * settings.patchQuads;
+		levels = 1;
+		while (levels < OCEAN_MAX_LEVELS && leafSize * (1 << (levels - 1)) < settings.worldSize)
+			++levels;
+		for (int l = 0; l < levels; ++l)
+		{
+			nodeSizes[l] = leafSize * (1 << l);
+			ranges[l] = settings.lodRatio * nodeSizes[l];
+		}
+
+		camera = glm::vec3(0.0f, 0.0f, 0.0f);
+		maxDisplacement = 0.0f;
+		visited = 0;
+		selectMs = 0.0;
+	}
+
+	const OceanSettings &getSettings() const { return settings; }
+	int numLevels() const { return levels; }
+	float lodRange(int level) const { return ranges[level]; }
+	float rootSize() const { return nodeSizes[levels - 1]; }
+
+	// Picks the nodes to draw this frame. MVP is the view-projection the
+	// nodes will be drawn with; maxDisplacement bounds how far the waves move
+	// the surface (see maxWaveDisplacement()).
+	const std::vector<OceanNode> &select(const glm::vec3 &cameraPos, const glm::mat4 &MVP, float maxDisp)
+	{
+		return select(cameraPos, &MVP, 1, maxDisp);
+	}
+
+	// The same for count views drawn together: a node is kept if any of the
+	// view-projections can see it. The levels still follow cameraPos alone,
+	// as the morph in cdlod_vertex.glsl does.
+	const std::vector<OceanNode> &select(const glm::vec3 &cameraPos, const glm::mat4 *MVPs, int count, float maxDisp)
+	{
+		auto start = std::chrono::steady_clock::now();
+		camera = cameraPos;
+		frusta.resize(count);
+		for (int i = 0; i < count; ++i)
+			frusta[i].set(MVPs[i]);
+		maxDisplacement = maxDisp;
+		visited = 0;
+		selection.clear();
+
+		// Centre the root on the camera, snapped to the root's own vertex
+		// spacing so that every node corner stays on its level's grid and the
+		// vertices don't swim as the camera moves.
+		float spacing = rootSize() / settings.patchQuads;
+		float half = 0.5f * rootSize();
+		float x = floorf(camera.x / spacing) * spacing - half;
+		float z = floorf(camera.z / spacing) * spacing - half;
+		selectNode(x, z, levels - 1);
+
+		selectMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return selection;
+	}
+
+	const std::vector<OceanNode> &lastSelection() const { return selection; }
+	// Nodes visited and wall time of the last select().
+	size_t lastVisited() const { return visited; }
+	double lastSelectMs() const { return selectMs; }
+};
+
+#endif
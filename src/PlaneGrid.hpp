@@ -0,0 +1,98 @@
+#ifndef PLANE_GRID_HPP
+#define PLANE_GRID_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// A regular grid of quads in the xz plane (y = 0).
+//
+// Same layout PlaneMesh has always used: (min, 0, min) is the origin, one
+// "row" of vertices has a fixed x and increasing z, and each quad is emitted
+// as 4 indices (i,j), (i,j+1), (i+1,j+1), (i+1,j) for use with GL_PATCHES.
+struct PlaneGrid
+{
+	int nRows = 0; // vertex rows (samples along x)
+	int nCols = 0; // vertices per row (samples along z)
+
+	// Tightly packed xyz positions. The normal is always (0,1,0) so it is not stored.
+	std::vector<float> positions;
+
+	// Exactly one of these is filled, depending on the vertex count.
+	std::vector<uint16_t> indices16;
+	std::vector<uint32_t> indices32;
+
+	size_t numVerts() const { return (size_t)nRows * nCols; }
+	size_t numQuads() const { return (size_t)(nRows - 1) * (nCols - 1); }
+	size_t numIndices() const { return numQuads() * 4; }
+	bool uses16BitIndices() const { return !indices16.empty(); }
+
+	const void *indexData() const
+	{
+		return uses16BitIndices() ? (const void *)indices16.data() : (const void *)indices32.data();
+	}
+	size_t indexBytes() const
+	{
+		return uses16BitIndices() ? indices16.size() * sizeof(uint16_t) : indices32.size() * sizeof(uint32_t);
+	}
+};
+
+// Number of samples from min to max (inclusive) at the given step.
+// Computed directly instead of by accumulating floats; the small tolerance
+// keeps e.g. (10 - -10) / 0.1 from losing its last sample to rounding.
+inline int planeGridSamples(float min, float max, float stepsize)
+{
+	if (stepsize <= 0.0f || max < min)
+		return 1;
+	return (int)std::floor((max - min) / stepsize + 1e-3f) + 1;
+}
+
+template <typename Index>
+inline void fillPlaneGridIndices(std::vector<Index> &indices, int nRows, int nCols)
+{
+	indices.resize((size_t)(nRows - 1) * (nCols - 1) * 4);
+	Index *out = indices.data();
+	for (int i = 0; i < nRows - 1; ++i)
+	{
+		Index row = (Index)(i * nCols);
+		Index next = (Index)((i + 1) * nCols);
+		for (int j = 0; j < nCols - 1; ++j)
+		{
+			*out++ = row + j;
+			*out++ = row + j + 1;
+			*out++ = next + j + 1;
+			*out++ = next + j;
+		}
+	}
+}
+
+// Builds the grid into preallocated buffers, with 16-bit indices whenever
+// every vertex fits.
+inline void buildPlaneGrid(float min, float max, float stepsize, PlaneGrid &grid)
+{
+	int n = planeGridSamples(min, max, stepsize);
+	grid.nRows = n;
+	grid.nCols = n;
+
+	grid.positions.resize(grid.numVerts() * 3);
+	float *p = grid.positions.data();
+	for (int i = 0; i < grid.nRows; ++i)
+	{
+		float x = min + i * stepsize;
+		for (int j = 0; j < grid.nCols; ++j)
+		{
+			*p++ = x;
+			*p++ = 0.0f;
+			*p++ = min + j * stepsize;
+		}
+	}
+
+	grid.indices16.clear();
+	grid.indices32.clear();
+	if (grid.numVerts() <= 65536)
+		fillPlaneGridIndices(grid.indices16, grid.nRows, grid.nCols);
+	else
+		fillPlaneGridIndices(grid.indices32, grid.nRows, grid.nCols);
+}
+
+#endif
@@ -1,9 +1,21 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/matrix_transform.hpp>
 #include "shader.hpp"
-#include "LoadBMP.hpp"
+#include "BMPTexture.hpp"
+#include "PlaneGrid.hpp"
+#include "Profiler.hpp"
+#include "GLState.hpp"
+#include "WaveField.hpp"
+#include "WaveBake.hpp"
+#include "OceanQuadtree.hpp"
+#include "TextureStreamer.hpp"
 
 #include <iostream>
+#include <algorithm>
+#include <memory>
+#include <chrono>
+#include <string.h>
 #include <GL/glew.h>
 
 void checkGLError(const char *stmt, const char *fname, int line)
@@ -50,141 +62,713 @@ void checkProgramLink(GLuint program)
 	}
 }
 
-// Example function to load a BMP file and create an OpenGL texture.
-GLuint loadTextureFromBMP(const char *imagePath)
+// Uniform block binding points shared by every program.
+#define FRAME_UBO_BINDING 0
+#define MATERIAL_UBO_BINDING 1
+#define WAVE_UBO_BINDING 2
+#define LOD_UBO_BINDING 3
+// after TextureMesh's (4) and FoamRenderer's (5)
+#define VIEW_UBO_BINDING 6
+
+// Size of the wave table in the shaders; longer sea states are truncated.
+#define MAX_WAVES 64
+
+// Views PlaneMesh::drawViews() draws in one pass; the shaders size ViewData
+// and the geometry shader's output by it.
+#define MAX_VIEWS 8
+
+// Mirrors "uniform FrameData" in the shaders (std140). Rewritten every frame.
+struct FrameUniforms
+{
+	glm::mat4 MVP;
+	glm::vec3 lightPos;
+	float time;
+	glm::vec3 viewPos;
+	float pad0;
+};
+static_assert(sizeof(FrameUniforms) == 96, "FrameUniforms must match the std140 FrameData block");
+
+// Mirrors "uniform MaterialData" in the shaders (std140). Only uploaded when it changes.
+struct MaterialUniforms
+{
+	glm::vec4 objectColor;
+	float texOffset[2];
+	float texScale;
+	float innerTess;
+	float outerTess;
+	float adaptiveTess;    // 1 for screen-space levels, 0 for innerTess/outerTess everywhere
+	float pixelsPerEdge;   // target size of a tessellated edge on screen
+	float maxDisplacement; // how far the waves and distext can move a point, for culling
+	float projScale;       // P[1][1] * viewport height / 2: world size at distance 1 -> pixels
+	float choppy;          // scale of distext's horizontal offsets (g, b), 0 for a height-only map
+	float pad0[2];
+};
+static_assert(sizeof(MaterialUniforms) == 64, "MaterialUniforms must match the std140 MaterialData block");
+
+// Mirrors "uniform WaveData" in the shaders (std140). Each wave is stored
+// with its time-independent constants folded (see GerstnerTerm), so the
+// shaders don't evaluate pow() per vertex:
+//   waveK[i]   = (w*Dx, w*Dz, phi, A)
+//   waveAmp[i] = (Dx*A*Qi, Dz*A*Qi, 0, 0) with Qi = w*A*Q^N
+struct WaveUniforms
+{
+	glm::vec4 waveK[MAX_WAVES];
+	glm::vec4 waveAmp[MAX_WAVES];
+	int waveCount;
+	int pad0[3];
+};
+static_assert(sizeof(WaveUniforms) == MAX_WAVES * 32 + 16, "WaveUniforms must match the std140 WaveData block");
+
+void packWaveUniforms(const std::vector<GerstnerWave> &waves, WaveUniforms &out)
+{
+	out = WaveUniforms();
+	if (waves.size() > MAX_WAVES)
+		std::cerr << "Sea state has " << waves.size() << " waves, only the first " << MAX_WAVES << " are drawn" << std::endl;
+	out.waveCount = (int)std::min(waves.size(), (size_t)MAX_WAVES);
+
+	std::vector<GerstnerTerm> terms;
+	foldGerstnerTerms(waves, 0.0f, terms);
+	for (int i = 0; i < out.waveCount; ++i)
+	{
+		out.waveK[i] = glm::vec4(terms[i].kx, terms[i].kz, waves[i].phi, terms[i].A);
+		out.waveAmp[i] = glm::vec4(terms[i].ax, terms[i].az, 0.0f, 0.0f);
+	}
+}
+
+// Mirrors "uniform LodData" in cdlod_vertex.glsl (std140). Set once per ocean.
+struct LodUniforms
+{
+	float lodRange0;
+	float morphStart;
+	float gridUnit;
+	float maxLevel;
+};
+static_assert(sizeof(LodUniforms) == 16, "LodUniforms must match the std140 LodData block");
+
+// Mirrors "uniform ViewData" in the multi-view shaders (std140): one entry
+// per viewport of PlaneMesh::drawViews().
+struct ViewUniforms
 {
-	// Variables to hold image data and dimensions.
-	unsigned char *data = nullptr;
-	unsigned int width, height;
+	glm::mat4 viewMVP[MAX_VIEWS];
+	glm::vec4 viewEye[MAX_VIEWS]; // eye position, w = the view's projScale (see MaterialUniforms)
+	int viewCount;
+	int pad0[3];
+};
+static_assert(sizeof(ViewUniforms) == MAX_VIEWS * 80 + 16, "ViewUniforms must match the std140 ViewData block");
 
-	// Load BMP data from the file.
-	loadBMP(imagePath, &data, &width, &height);
+// One viewport of a multi-view draw: its camera and where it lands in the
+// framebuffer, in pixels from the bottom left.
+struct WaterView
+{
+	glm::mat4 V, P;
+	int x, y, width, height;
+};
 
-	if (!data)
+// Tiles a width x height framebuffer with count views of the camera V, in
+// rows from the top left: the camera itself (the bridge), a top-down chart
+// around it, then side monitors turned 90 degrees either way and further
+// round. At most MAX_VIEWS.
+void layoutMonitorViews(const glm::mat4 &V, int count, int width, int height, std::vector<WaterView> &views)
+{
+	static const float yaws[MAX_VIEWS - 2] = {90.0f, -90.0f, 180.0f, 45.0f, -45.0f, 135.0f};
+	count = std::min(std::max(count, 1), MAX_VIEWS);
+	int cols = (int)ceilf(sqrtf((float)count));
+	int rows = (count + cols - 1) / cols;
+	int tileW = width / cols, tileH = height / rows;
+	glm::vec3 eye = glm::vec3(glm::inverse(V)[3]);
+
+	views.resize(count);
+	for (int i = 0; i < count; ++i)
 	{
-		std::cerr << "Failed to load BMP: " << imagePath << std::endl;
-		return 0;
+		WaterView &view = views[i];
+		view.x = (i % cols) * tileW;
+		view.y = height - (i / cols + 1) * tileH;
+		view.width = tileW;
+		view.height = tileH;
+		view.P = glm::perspective(glm::radians(45.0f), (float)tileW / tileH, 0.001f, 1000.0f);
+		if (i == 0)
+			view.V = V;
+		else if (i == 1)
+			view.V = glm::lookAt(glm::vec3(eye.x, 25.0f, eye.z), glm::vec3(eye.x, 0.0f, eye.z), glm::vec3(0.0f, 0.0f, -1.0f));
+		else
+			view.V = glm::rotate(glm::mat4(1.0f), glm::radians(yaws[i - 2]), glm::vec3(0.0f, 1.0f, 0.0f)) * V;
 	}
+}
+
+// Upper bound on how far the waves can move a point of the flat grid in any
+// direction. Patch bounds are grown by this plus the displacement map's own
+// bound before frustum culling.
+float maxWaveDisplacement(const std::vector<GerstnerWave> &waves)
+{
+	std::vector<GerstnerTerm> terms;
+	foldGerstnerTerms(waves, 0.0f, terms);
+	float bound = 0.0f;
+	for (size_t i = 0; i < terms.size() && i < MAX_WAVES; ++i)
+		bound += fabsf(terms[i].A) + sqrtf(terms[i].ax * terms[i].ax + terms[i].az * terms[i].az);
+	return bound;
+}
 
-	// Generate a texture ID.
-	GLuint textureID;
-	glGenTextures(1, &textureID);
+// Frames between issuing a triangle count query and reading it back.
+#define TESS_BUDGET_LATENCY 3
 
-	// Bind the texture so we can set parameters and upload data.
-	glBindTexture(GL_TEXTURE_2D, textureID);
+// Where the wave displacement happens.
+enum WaterPipeline
+{
+	// geo.glsl displaces every triangle corner and uses the flat face normal.
+	PIPELINE_GEOMETRY,
+	// tess_eval_displace.glsl displaces each tessellated vertex once with
+	// analytic normals; there is no geometry stage (except on llvmpipe, see
+	// tessNeedsGeometryStage()).
+	PIPELINE_TESS_EVAL,
+	// tess_eval_baked.glsl reads the waves from a looped bake (see
+	// WaveBake.hpp and setWaveBake()) instead of evaluating them.
+	PIPELINE_TESS_BAKED,
+	// wave_compute.glsl fills displacement and normal maps once per frame
+	// and tess_eval_compute.glsl fetches from them. Needs GL 4.3.
+	PIPELINE_TESS_COMPUTE,
+	PIPELINE_COUNT
+};
 
-	// Set texture parameters: wrapping mode and filtering.
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+const char *pipelineName(WaterPipeline p)
+{
+	static const char *names[PIPELINE_COUNT] = {"geo", "tes", "baked", "compute"};
+	return names[p];
+}
 
-	// BMP files typically store pixel data in BGR format.
-	// Upload the texture data to the GPU.
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
+// Accepts the names pipelineName() returns. Unknown names fall back to the geometry pipeline.
+WaterPipeline parsePipeline(const char *name)
+{
+	for (int p = 0; p < PIPELINE_COUNT; ++p)
+		if (strcmp(name, pipelineName((WaterPipeline)p)) == 0)
+			return (WaterPipeline)p;
+	std::cerr << "Unknown pipeline " << name << ", using " << pipelineName(PIPELINE_GEOMETRY) << std::endl;
+	return PIPELINE_GEOMETRY;
+}
 
-	// Generate mipmaps.
-	glGenerateMipmap(GL_TEXTURE_2D);
+// Mesa's llvmpipe is pathologically slow when a tessellation evaluation
+// shader feeds the rasterizer directly: with fixed levels on 400 patches the
+// tes pipeline takes 0.45 s a frame at level 16 but 10 s at 32 (4.9 s with a
+// shader that only interpolates), against 0.11 s and 0.57 s with an empty
+// geometry stage behind it. The pipelines without a geometry shader get one
+// there.
+bool tessNeedsGeometryStage()
+{
+	static int needed = -1;
+	if (needed < 0)
+	{
+		const char *renderer = (const char *)glGetString(GL_RENDERER);
+		needed = renderer && strstr(renderer, "llvmpipe") ? 1 : 0;
+		if (needed)
+			std::cerr << "llvmpipe: adding a pass-through geometry stage to the tessellation pipelines" << std::endl;
+	}
+	return needed == 1;
+}
 
-	// Unbind the texture.
-	glBindTexture(GL_TEXTURE_2D, 0);
+// The stages of a pipeline's program, with the quadtree ocean's vertex
+// shader or the fixed grid's; procedural selects the fixed grid's
+// attribute-less variant and multiView the program drawViews() uses, which
+// sends every triangle to each view from a geometry stage. Not started yet.
+ShaderBuilder *waterProgramBuilder(WaterPipeline p, bool cdlod, bool procedural = false, bool multiView = false)
+{
+	ShaderBuilder *b = new ShaderBuilder();
+	b->stage(GL_VERTEX_SHADER, cdlod ? "shaders/cdlod_vertex.glsl" : "shaders/vertex.glsl");
+	if (procedural)
+		b->define("PROCEDURAL_GRID");
+	if (multiView)
+		b->define("MULTI_VIEW");
+	b->stage(GL_TESS_CONTROL_SHADER, "shaders/tess_control.glsl");
+	if (p == PIPELINE_TESS_EVAL)
+	{
+		b->stage(GL_TESS_EVALUATION_SHADER, "shaders/tess_eval_displace.glsl");
+	}
+	else if (p == PIPELINE_TESS_BAKED)
+	{
+		b->stage(GL_TESS_EVALUATION_SHADER, "shaders/tess_eval_baked.glsl");
+	}
+	else if (p == PIPELINE_TESS_COMPUTE)
+	{
+		b->stage(GL_TESS_EVALUATION_SHADER, "shaders/tess_eval_compute.glsl");
+	}
+	else
+	{
+		b->stage(GL_TESS_EVALUATION_SHADER, "shaders/tess_eval.glsl");
+		b->stage(GL_GEOMETRY_SHADER, "shaders/geo.glsl");
+	}
+	// geo.glsl fans out to the views itself
+	if (multiView && p != PIPELINE_GEOMETRY)
+	{
+		b->stage(GL_GEOMETRY_SHADER, "shaders/multiview_geo.glsl");
+	}
+	else if (p != PIPELINE_GEOMETRY && tessNeedsGeometryStage())
+	{
+		b->define("GEOMETRY_PASSTHROUGH");
+		b->stage(GL_GEOMETRY_SHADER, "shaders/passthrough_geo.glsl");
+	}
+	b->stage(GL_FRAGMENT_SHADER, "shaders/fragment.glsl");
+	return b;
+}
 
-	// Free the BMP data now that it has been uploaded to the GPU.
-	delete[] data;
+// PIPELINE_TESS_COMPUTE's compute pass. Not started yet.
+ShaderBuilder *waveComputeBuilder()
+{
+	ShaderBuilder *b = new ShaderBuilder();
+	b->stage(GL_COMPUTE_SHADER, "shaders/wave_compute.glsl");
+	return b;
+}
 
-	return textureID;
+// Compute shaders and image stores; a 4.1 context has neither.
+bool computeShadersSupported()
+{
+	return GLEW_VERSION_4_3;
 }
 
+// Texels per side of the compute pipeline's maps.
+#define WAVE_MAP_SIZE 256
+
+// The water surface. Either one fixed grid from min to max drawn whole, or
+// (with OceanSettings) a CDLOD quadtree around the camera that draws one
+// shared patch mesh per selected node.
 class PlaneMesh
 {
 	GLfloat min, max;
 	glm::vec4 modelColor;
 
-	std::vector<float> verts;
-	std::vector<float> normals;
-	std::vector<GLuint> indices;
-
 	GLsizei numVerts, numIndices;
+	GLenum indexType;
+
+	// Fixed grid without vertex or index buffers: vertex.glsl rebuilds the
+	// patch corners from gl_VertexID, gridQuads quads per row gridStep apart.
+	bool proceduralGrid;
+	int gridQuads;
+	float gridStep;
+	// building and uploading the fixed grid, for the benchmark
+	double gridSetupMs;
+
+	// tessellation levels for every patch when not adaptive
+	float innerTess, outerTess;
+
+	// Screen-space tessellation: each patch edge is split into segments of
+	// about pixelsPerEdge pixels, and patches outside the frustum are dropped.
+	bool adaptiveTess;
+	float pixelsPerEdge;
+	int viewportHeight;
+
+	// How far the waves and distext can move a point, for culling.
+	float waveBound, mapBound;
+
+	// Optional triangle budget: pixelsPerEdge is steered so that the
+	// generated triangle count stays near it. The counts come back through a
+	// ring of queries read TESS_BUDGET_LATENCY frames later, so the CPU never
+	// waits for them.
+	GLuint64 triangleBudget;
+	GLuint budgetQueries[TESS_BUDGET_LATENCY];
+	int budgetFrame;
+	GLuint64 lastTriangles;
 
 	// buffer
-	GLuint vao;
+	GLuint vao, vbo, ebo;
 	GLuint shaderProgramID;
+	// one program per pipeline, linked the first time it is selected
+	GLuint programs[PIPELINE_COUNT];
+	// builds started ahead of time when the driver compiles in parallel
+	std::unique_ptr<ShaderBuilder> pendingPrograms[PIPELINE_COUNT];
+	WaterPipeline pipeline;
+	UniformBuffer frameUBO, materialUBO, waveUBO;
+
+	// drawViews()' programs, linked the first time a pipeline draws views
+	GLuint multiViewPrograms[PIPELINE_COUNT];
+	UniformBuffer viewUBO;
+
+	// quadtree ocean, NULL for the fixed grid
+	std::unique_ptr<OceanQuadtree> ocean;
+	GLuint instanceVbo;
+	GLsizei numInstances;
+	UniformBuffer lodUBO;
 
 	// texture
 	GLuint distextID, waterTextureID;
+	// distext covers texScale x texScale world units; a map set with
+	// setDisplacementMap() also carries horizontal offsets.
+	float texScale;
+	bool choppyMap;
+	int mapSize;
+	// replaces distextID while streaming (see streamDisplacementMap())
+	std::unique_ptr<TextureStreamer> mapStream;
+
+	// what PIPELINE_TESS_BAKED samples, not owned
+	const WaveBake *waveBake;
+	// in programs[PIPELINE_TESS_BAKED] and multiViewPrograms[PIPELINE_TESS_BAKED]
+	GLint bakeScaleLocations[2];
 
-	void planeMeshQuads(float min, float max, float stepsize)
+	// PIPELINE_TESS_COMPUTE's pass and its displacement and normal maps,
+	// made the first time the pipeline is selected
+	GLuint computeProgramID;
+	GLuint waveMapIDs[2];
+	int waveMapSize;
+
+public:
+	// procedural draws the same grid without any buffers (see proceduralGrid).
+	// With a pool, the textures are read on its threads.
+	PlaneMesh(float min, float max, float stepsize, bool procedural = false, ThreadPool *pool = nullptr)
 	{
+		this->min = min;
+		this->max = max;
+		instanceVbo = 0;
+		numInstances = 1;
+		proceduralGrid = procedural;
+		gridStep = stepsize;
+
+		auto start = std::chrono::steady_clock::now();
+		if (procedural)
+		{
+			int n = planeGridSamples(min, max, stepsize);
+			gridQuads = n - 1;
+			numVerts = 0;
+			numIndices = 4 * gridQuads * gridQuads;
+			indexType = GL_NONE;
+			vbo = ebo = 0;
+			// core profiles still need a vertex array to draw from
+			glGenVertexArrays(1, &vao);
+		}
+		else
+		{
+			// The CPU copy only lives until it has been uploaded.
+			PlaneGrid grid;
+			buildPlaneGrid(min, max, stepsize, grid);
+			uploadGrid(grid);
+		}
+		gridSetupMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		init(pool);
+	}
 
-		// The following coordinate system works as if (min, 0, min) is the origin
-		// And then builds up the mesh from that origin down (in z)
-		// and then to the right (in x).
-		// So, one "row" of the mesh's vertices have a fixed x and increasing z
+	// Unbounded ocean: a quadtree of settings.worldSize around the camera.
+	// pool is as above.
+	explicit PlaneMesh(const OceanSettings &settings, ThreadPool *pool = nullptr)
+	{
+		ocean.reset(new OceanQuadtree(settings));
+		proceduralGrid = false;
+		gridSetupMs = 0.0;
+		min = -0.5f * settings.worldSize;
+		max = 0.5f * settings.worldSize;
+		numInstances = 0;
 
-		// manually create a first column of vertices
-		float x = min;
-		float y = 0;
-		for (float z = min; z <= max; z += stepsize)
+		// The shared patch: a unit grid the vertex shader scales to each node.
 		{
-			verts.push_back(x);
-			verts.push_back(y);
-			verts.push_back(z);
-			normals.push_back(0);
-			normals.push_back(1);
-			normals.push_back(0);
+			PlaneGrid grid;
+			buildPlaneGrid(0.0f, 1.0f, 1.0f / ocean->getSettings().patchQuads, grid);
+			uploadGrid(grid);
 		}
 
-		for (float x = min + stepsize; x <= max; x += stepsize)
+		// One OceanNode per instance, refilled every frame.
+		glGenBuffers(1, &instanceVbo);
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+		glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(OceanNode), (void *)0);
+		glVertexAttribDivisor(1, 1);
+		glEnableVertexAttribArray(1);
+
+		LodUniforms lod;
+		lod.lodRange0 = ocean->lodRange(0);
+		lod.morphStart = ocean->getSettings().morphStart;
+		lod.gridUnit = ocean->getSettings().gridUnit;
+		lod.maxLevel = (float)(ocean->numLevels() - 1);
+		lodUBO.create(LOD_UBO_BINDING, sizeof(LodUniforms));
+		lodUBO.update(&lod, sizeof(lod));
+
+		init(pool);
+	}
+
+	~PlaneMesh()
+	{
+		glDeleteBuffers(1, &vbo);
+		glDeleteBuffers(1, &ebo);
+		if (instanceVbo)
+			glDeleteBuffers(1, &instanceVbo);
+		glDeleteVertexArrays(1, &vao);
+		glState().forgetVertexArray(vao);
+		for (int p = 0; p < PIPELINE_COUNT; ++p)
 		{
-			for (float z = min; z <= max; z += stepsize)
+			for (GLuint id : {programs[p], multiViewPrograms[p]})
 			{
-				verts.push_back(x);
-				verts.push_back(y);
-				verts.push_back(z);
-				normals.push_back(0);
-				normals.push_back(1);
-				normals.push_back(0);
+				if (id)
+				{
+					glDeleteProgram(id);
+					glState().forgetProgram(id);
+				}
 			}
 		}
+		glDeleteTextures(1, &distextID);
+		glDeleteTextures(1, &waterTextureID);
+		glState().forgetTexture(distextID);
+		glState().forgetTexture(waterTextureID);
+		releaseWaveMaps();
+		if (computeProgramID)
+		{
+			glDeleteProgram(computeProgramID);
+			glState().forgetProgram(computeProgramID);
+		}
+		mapStream.reset();
+		if (budgetQueries[0])
+			glDeleteQueries(TESS_BUDGET_LATENCY, budgetQueries);
+	}
+
+	PlaneMesh(const PlaneMesh &) = delete;
+	PlaneMesh &operator=(const PlaneMesh &) = delete;
+
+	// Fixed levels for every patch; turns adaptive tessellation off.
+	void setTessLevels(float inner, float outer)
+	{
+		innerTess = inner;
+		outerTess = outer;
+		adaptiveTess = false;
+	}
+
+	// Screen-space levels: each patch edge gets about one segment per
+	// pixelsPerEdge pixels (clamped to [1, 64]), and patches outside the
+	// frustum are culled in the control shader.
+	void setAdaptiveTess(float pixels)
+	{
+		pixelsPerEdge = std::max(pixels, 0.5f);
+		adaptiveTess = true;
+	}
+
+	bool isAdaptiveTess() const { return adaptiveTess; }
+	float getPixelsPerEdge() const { return pixelsPerEdge; }
+
+	// Height of the viewport being drawn into, for the pixel metric.
+	void setViewportHeight(int height) { viewportHeight = height; }
 
-		int nCols = (max - min) / stepsize + 1;
-		int i = 0, j = 0;
-		for (float x = min; x < max; x += stepsize)
+	// Keeps the generated triangle count near the given number by adjusting
+	// pixelsPerEdge each frame (0 turns it off). Only meaningful with adaptive
+	// tessellation. It uses a GL_PRIMITIVES_GENERATED query around the draw,
+	// so don't set a budget while another one is active (bench does that).
+	void setTriangleBudget(GLuint64 triangles)
+	{
+		triangleBudget = triangles;
+		if (triangleBudget && !budgetQueries[0])
 		{
-			j = 0;
-			for (float z = min; z < max; z += stepsize)
-			{
-				indices.push_back(i * nCols + j);
-				indices.push_back(i * nCols + j + 1);
-				indices.push_back((i + 1) * nCols + j + 1);
-				indices.push_back((i + 1) * nCols + j);
-				++j;
-			}
-			++i;
+			glGenQueries(TESS_BUDGET_LATENCY, budgetQueries);
+			budgetFrame = 0;
 		}
 	}
 
-public:
-	PlaneMesh(float min, float max, float stepsize)
+	// Triangles generated by a recent frame, when a budget is set.
+	GLuint64 getLastTriangles() const { return lastTriangles; }
+
+	// Replaces the wave table the shaders evaluate. Pass the same waves to any
+	// WaveField that needs to agree with what is drawn.
+	void setWaves(const std::vector<GerstnerWave> &waves)
 	{
-		this->min = min;
-		this->max = max;
-		modelColor = glm::vec4(0.6f, 0.9f, 1.0f, 1.0f);
+		WaveUniforms packed;
+		packWaveUniforms(waves, packed);
+		waveUBO.update(&packed, sizeof(packed));
+		waveBound = maxWaveDisplacement(waves);
+	}
+
+	// Replaces distext with a size x size float map of (height, x offset,
+	// z offset) tiling every tileSize world units, such as SpectralOcean
+	// produces. bound is the longest offset in it. Call every frame to animate;
+	// the texture is only reallocated when the size changes.
+	void setDisplacementMap(const float *rgb, int size, float tileSize, float bound)
+	{
+		PROFILE_CPU("map upload");
+		mapStream.reset();
+		if (size != mapSize)
+		{
+			glDeleteTextures(1, &distextID);
+			glState().forgetTexture(distextID);
+			glGenTextures(1, &distextID);
+			glState().bindTexture(0, GL_TEXTURE_2D, distextID);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB32F, size, size, 0, GL_RGB, GL_FLOAT, rgb);
+			mapSize = size;
+		}
+		else
+		{
+			glState().bindTexture(0, GL_TEXTURE_2D, distextID);
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RGB, GL_FLOAT, rgb);
+		}
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		texScale = tileSize;
+		choppyMap = true;
+		mapBound = bound;
+	}
 
-		planeMeshQuads(min, max, stepsize);
-		numVerts = verts.size() / 3;
-		numIndices = indices.size();
+	// Asynchronous version of setDisplacementMap(): returns a streamer whose
+	// slots take size x size RGB float images from any thread, and draw()
+	// uploads the newest one without stalling. Report each image's bound with
+	// setDisplacementBound().
+	TextureStreamer *streamDisplacementMap(int size, float tileSize)
+	{
+		mapStream.reset(new TextureStreamer(GL_RGB32F, size, size, GL_RGB, GL_FLOAT, 3 * sizeof(float)));
+		texScale = tileSize;
+		choppyMap = true;
+		return mapStream.get();
+	}
+
+	void setDisplacementBound(float bound) { mapBound = bound; }
+
+	// The bake PIPELINE_TESS_BAKED reads, which must outlive the mesh. Pass
+	// its looped waves to setWaves() too, so the culling bound matches.
+	void setWaveBake(const WaveBake *bake) { waveBake = bake; }
+
+	// Side of the compute pipeline's maps in texels. They span the
+	// displacement map's tile (getMapTileSize()), so the waves must repeat
+	// over it too (see tileGerstnerWaves()).
+	void setWaveMapSize(int size)
+	{
+		if (size == waveMapSize)
+			return;
+		releaseWaveMaps();
+		waveMapSize = size;
+	}
+
+	float getMapTileSize() const { return texScale; }
+
+	// Without GL 4.3, PIPELINE_TESS_COMPUTE falls back to PIPELINE_GEOMETRY.
+	void setPipeline(WaterPipeline p)
+	{
+		if (p == PIPELINE_TESS_BAKED && !(waveBake && waveBake->isBaked()))
+			std::cerr << "The baked pipeline has no wave bake, the water stays flat" << std::endl;
+		if (p == PIPELINE_TESS_COMPUTE && !computeShadersSupported())
+		{
+			std::cerr << "The compute pipeline needs OpenGL 4.3, using " << pipelineName(PIPELINE_GEOMETRY) << std::endl;
+			p = PIPELINE_GEOMETRY;
+		}
+		if (p == PIPELINE_TESS_COMPUTE && !computeProgramID)
+			computeProgramID = finishComputeProgram();
+		if (!programs[p])
+			programs[p] = finishProgram(p);
+		pipeline = p;
+		shaderProgramID = programs[p];
+	}
+
+	WaterPipeline getPipeline() const { return pipeline; }
+
+	// Patches drawn per frame (for the ocean, in the last frame).
+	GLsizei numPatches() const { return numIndices / 4 * numInstances; }
+
+	bool isProceduralGrid() const { return proceduralGrid; }
+	double getGridSetupMs() const { return gridSetupMs; }
+
+	// GPU memory the fixed grid's vertex and index buffers take (0 when procedural).
+	size_t gridBytes() const
+	{
+		if (ocean || proceduralGrid)
+			return 0;
+		return (size_t)numVerts * 3 * sizeof(float) + (size_t)numIndices * (indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+	}
+
+	// NULL unless this is the quadtree ocean.
+	const OceanQuadtree *getOcean() const { return ocean.get(); }
+
+	void draw(glm::vec3 lightPos, glm::mat4 V, glm::mat4 P, float time)
+	{
+		if (mapStream)
+		{
+			PROFILE_CPU("map upload");
+			mapStream->upload();
+		}
+		setUniforms(false, lightPos, V, P, time);
+		if (pipeline == PIPELINE_TESS_COMPUTE)
+			updateWaveMaps(false);
+		if (ocean)
+		{
+			glm::mat4 MVP = P * V;
+			selectNodes(glm::vec3(glm::inverse(V)[3]), &MVP, 1);
+		}
+		submit();
+	}
+
+	// Draws the surface into up to MAX_VIEWS viewports in one pass: the
+	// patches are tessellated and displaced once, in world space, and a
+	// geometry stage sends each triangle to every view that can see it
+	// (gl_ViewportIndex). Each edge's adaptive level is the finest of the
+	// views whose frustum it reaches, chosen per edge so neighbouring patches
+	// still agree, and a patch is culled only when every view misses it.
+	// The quadtree ocean selects one set of nodes for the union of the views'
+	// frusta, with its levels around the first view's eye. The viewports stay
+	// set; the next glViewport() resets them all.
+	void drawViews(glm::vec3 lightPos, const WaterView *views, int count, float time)
+	{
+		if (count > MAX_VIEWS)
+		{
+			std::cerr << "Only the first " << MAX_VIEWS << " of " << count << " views are drawn" << std::endl;
+			count = MAX_VIEWS;
+		}
+		if (count <= 0)
+			return;
+
+		if (mapStream)
+		{
+			PROFILE_CPU("map upload");
+			mapStream->upload();
+		}
+		if (!multiViewPrograms[pipeline])
+			multiViewPrograms[pipeline] = finishProgram(pipeline, true);
+		// FrameData gets the first view, for whatever doesn't read ViewData.
+		setUniforms(true, lightPos, views[0].V, views[0].P, time);
+
+		ViewUniforms packed = {};
+		packed.viewCount = count;
+		for (int i = 0; i < count; ++i)
+		{
+			const WaterView &view = views[i];
+			packed.viewMVP[i] = view.P * view.V;
+			packed.viewEye[i] = glm::vec4(glm::vec3(glm::inverse(view.V)[3]), view.P[1][1] * view.height * 0.5f);
+			glViewportIndexedf(i, (float)view.x, (float)view.y, (float)view.width, (float)view.height);
+		}
+		viewUBO.update(&packed, sizeof(packed));
+		viewUBO.bind();
+
+		if (pipeline == PIPELINE_TESS_COMPUTE)
+			updateWaveMaps(true);
+		if (ocean)
+			selectNodes(glm::vec3(glm::inverse(views[0].V)[3]), packed.viewMVP, count);
+		submit();
+	}
+
+private:
+	// Sets the patch size and issues the draw for the bound program.
+	void submit()
+	{
+		PROFILE_CPU("submit");
+		PROFILE_GPU("water");
+		glState().patchParameter(4);
+		bool budget = triangleBudget && adaptiveTess;
+		if (budget)
+			glBeginQuery(GL_PRIMITIVES_GENERATED, budgetQueries[budgetFrame]);
+		if (ocean)
+			GL_CHECK(glDrawElementsInstanced(GL_PATCHES, numIndices, indexType, (void *)0, numInstances));
+		else if (proceduralGrid)
+			GL_CHECK(glDrawArrays(GL_PATCHES, 0, numIndices));
+		else
+			GL_CHECK(glDrawElements(GL_PATCHES, numIndices, indexType, (void *)0));
+		if (budget)
+		{
+			glEndQuery(GL_PRIMITIVES_GENERATED);
+			updateBudget();
+		}
+	}
+
+	void uploadGrid(const PlaneGrid &grid)
+	{
+		numVerts = grid.numVerts();
+		numIndices = grid.numIndices();
+		indexType = grid.uses16BitIndices() ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
 
 		// gen and fill buffers
 		// create vao
 		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
+		glState().bindVertexArray(vao);
 
-		// create vertex buffer
-		GLuint vboVerts;
-		glGenBuffers(1, &vboVerts);
-		glBindBuffer(GL_ARRAY_BUFFER, vboVerts);
-		glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(float), verts.data(), GL_STATIC_DRAW);
+		// create vertex buffer (positions only, the normal is always up)
+		glGenBuffers(1, &vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, grid.positions.size() * sizeof(float), grid.positions.data(), GL_STATIC_DRAW);
 		glVertexAttribPointer(
 			0,
 			3,
@@ -194,109 +778,260 @@ public:
 			(void *)0);
 		glEnableVertexAttribArray(0);
 
-		// create normal buffer
-		GLuint vboNormals;
-		glGenBuffers(1, &vboNormals);
-		glBindBuffer(GL_ARRAY_BUFFER, vboNormals);
-		glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(float), normals.data(), GL_STATIC_DRAW);
-		glVertexAttribPointer(
-			1,
-			3,
-			GL_FLOAT,
-			GL_FALSE,
-			0,
-			(void *)0);
-
 		// index buffer
-		GLuint ebo;
 		glGenBuffers(1, &ebo);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, grid.indexBytes(), grid.indexData(), GL_STATIC_DRAW);
+	}
+
+	// Everything after the geometry that both kinds of surface share.
+	void init(ThreadPool *pool)
+	{
+		modelColor = glm::vec4(0.6f, 0.9f, 1.0f, 1.0f);
+		innerTess = 64;
+		outerTess = 64;
+		adaptiveTess = true;
+		pixelsPerEdge = 8.0f;
+		viewportHeight = 1500;
+		waveBound = 0.0f;
+		waveBake = NULL;
+		bakeScaleLocations[0] = bakeScaleLocations[1] = -1;
+		computeProgramID = 0;
+		waveMapIDs[0] = waveMapIDs[1] = 0;
+		waveMapSize = WAVE_MAP_SIZE;
+		triangleBudget = 0;
+		budgetFrame = 0;
+		lastTriangles = 0;
+		for (int i = 0; i < TESS_BUDGET_LATENCY; ++i)
+			budgetQueries[i] = 0;
+
+		// shaders and uniforms; with parallel compiles every pipeline builds
+		// on the driver's threads while the textures load
+		for (int p = 0; p < PIPELINE_COUNT; ++p)
+		{
+			programs[p] = 0;
+			multiViewPrograms[p] = 0;
+			if (enableParallelShaderCompile())
+				startProgram((WaterPipeline)p);
+		}
+
+		frameUBO.create(FRAME_UBO_BINDING, sizeof(FrameUniforms));
+		materialUBO.create(MATERIAL_UBO_BINDING, sizeof(MaterialUniforms));
+		waveUBO.create(WAVE_UBO_BINDING, sizeof(WaveUniforms));
+		viewUBO.create(VIEW_UBO_BINDING, sizeof(ViewUniforms));
+		setWaves(defaultGerstnerWaves());
+
+		// generate texture; the BMP's heights are in [0, 1]
+		{
+			const char *paths[2] = {"assets/displacement-map1.bmp", "assets/water.bmp"};
+			GLuint ids[2];
+			loadTexturesFromBMP(paths, ids, 2, pool);
+			distextID = ids[0];
+			waterTextureID = ids[1];
+		}
+		texScale = 50.0f;
+		choppyMap = false;
+		mapSize = 0;
+		mapBound = 1.0f;
+
+		setPipeline(PIPELINE_GEOMETRY);
+	}
+
+	// Runs the quadtree selection around eye for the given views and uploads
+	// the nodes.
+	void selectNodes(const glm::vec3 &eye, const glm::mat4 *MVPs, int count)
+	{
+		PROFILE_CPU("lod select");
+		const std::vector<OceanNode> &nodes = ocean->select(eye, MVPs, count, waveBound + mapBound);
+		numInstances = (GLsizei)nodes.size();
+
+		// Orphan the old storage so the driver doesn't wait for last frame's draw.
+		glBindBuffer(GL_ARRAY_BUFFER, instanceVbo);
+		glBufferData(GL_ARRAY_BUFFER, nodes.size() * sizeof(OceanNode), NULL, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, nodes.size() * sizeof(OceanNode), nodes.data());
+	}
+
+	// Reads the oldest query in the ring (issued TESS_BUDGET_LATENCY - 1
+	// frames ago) if it is done, and scales pixelsPerEdge toward the budget.
+	// Triangles go roughly with the inverse square of the edge length, hence
+	// the square root; the step is damped so the level doesn't oscillate.
+	void updateBudget()
+	{
+		budgetFrame = (budgetFrame + 1) % TESS_BUDGET_LATENCY;
+		GLuint query = budgetQueries[budgetFrame];
+		if (!glIsQuery(query))
+			return; // not issued yet, the ring is still filling
+		GLint available = 0;
+		glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available)
+			return;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &lastTriangles);
+		if (lastTriangles == 0)
+			return;
+
+		float ratio = sqrtf((float)lastTriangles / (float)triangleBudget);
+		ratio = std::min(std::max(ratio, 0.8f), 1.25f);
+		pixelsPerEdge = std::min(std::max(pixelsPerEdge * ratio, 0.5f), 256.0f);
+	}
+
+	void startProgram(WaterPipeline p)
+	{
+		pendingPrograms[p].reset(waterProgramBuilder(p, ocean != nullptr, proceduralGrid));
+		pendingPrograms[p]->start();
+	}
+
+	// The multi-view programs are only ever built on demand.
+	GLuint finishProgram(WaterPipeline p, bool multiView = false)
+	{
+		std::unique_ptr<ShaderBuilder> b;
+		if (multiView)
+		{
+			b.reset(waterProgramBuilder(p, ocean != nullptr, proceduralGrid, true));
+			b->start();
+		}
+		else
+		{
+			if (!pendingPrograms[p])
+				startProgram(p);
+			b = std::move(pendingPrograms[p]);
+		}
+		GLuint id = b->finish();
+
+		if (id == 0)
+		{
+			std::cerr << "Couldn't generate shader..." << std::endl;
+			exit(1);
+		}
 
-		// shaders and uniforms
-		shaderProgramID = createShaderProgram(
-			"shaders/vertex.glsl",
-			"shaders/tess_control.glsl",
-			"shaders/tess_eval.glsl",
-			"shaders/geo.glsl",
-			"shaders/fragment.glsl");
+		// Resolve everything about the program once: block bindings and the
+		// sampler units never change after linking.
+		bindUniformBlock(id, "FrameData", FRAME_UBO_BINDING);
+		bindUniformBlock(id, "MaterialData", MATERIAL_UBO_BINDING);
+		bindUniformBlock(id, "WaveData", WAVE_UBO_BINDING);
+		bindUniformBlock(id, "LodData", LOD_UBO_BINDING);
+		bindUniformBlock(id, "ViewData", VIEW_UBO_BINDING);
+		glState().useProgram(id);
+		glUniform1i(glGetUniformLocation(id, "distext"), 0);
+		glUniform1i(glGetUniformLocation(id, "waterTexture"), 1);
+		glUniform1i(glGetUniformLocation(id, "waveBake"), 2);
+		glUniform1i(glGetUniformLocation(id, "waveDisplacement"), 2);
+		glUniform1i(glGetUniformLocation(id, "waveNormal"), 3);
+		if (proceduralGrid)
+		{
+			glUniform1f(glGetUniformLocation(id, "gridMin"), min);
+			glUniform1f(glGetUniformLocation(id, "gridStep"), gridStep);
+			glUniform1i(glGetUniformLocation(id, "gridQuads"), gridQuads);
+		}
+		if (p == PIPELINE_TESS_BAKED)
+			bakeScaleLocations[multiView] = glGetUniformLocation(id, "bakeScale");
+		return id;
+	}
 
-		if (shaderProgramID == 0)
+	GLuint finishComputeProgram()
+	{
+		std::unique_ptr<ShaderBuilder> b(waveComputeBuilder());
+		b->start();
+		GLuint id = b->finish();
+		if (id == 0)
 		{
 			std::cerr << "Couldn't generate shader..." << std::endl;
 			exit(1);
 		}
+		bindUniformBlock(id, "FrameData", FRAME_UBO_BINDING);
+		bindUniformBlock(id, "MaterialData", MATERIAL_UBO_BINDING);
+		bindUniformBlock(id, "WaveData", WAVE_UBO_BINDING);
+		glState().useProgram(id);
+		glUniform1i(glGetUniformLocation(id, "distext"), 0);
+		return id;
+	}
+
+	void releaseWaveMaps()
+	{
+		for (GLuint &id : waveMapIDs)
+		{
+			if (id)
+			{
+				glDeleteTextures(1, &id);
+				glState().forgetTexture(id);
+				id = 0;
+			}
+		}
+	}
 
-		// generate texture
-		distextID = loadTextureFromBMP("assets/displacement-map1.bmp");
-        waterTextureID = loadTextureFromBMP("assets/water.bmp");
+	// The program draw() (or with multiView, drawViews()) uses.
+	GLuint drawProgram(bool multiView) const
+	{
+		return multiView ? multiViewPrograms[pipeline] : shaderProgramID;
+	}
+
+	// Runs the compute pass over this frame's uniforms (set by setUniforms())
+	// and binds its maps for the tessellation evaluation shader.
+	void updateWaveMaps(bool multiView)
+	{
+		PROFILE_CPU("wave maps");
+		if (!waveMapIDs[0])
+		{
+			glGenTextures(2, waveMapIDs);
+			for (int i = 0; i < 2; ++i)
+			{
+				glState().bindTexture(2 + i, GL_TEXTURE_2D, waveMapIDs[i]);
+				glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA16F, waveMapSize, waveMapSize);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+				glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			}
+		}
+		glState().useProgram(computeProgramID);
+		glBindImageTexture(0, waveMapIDs[0], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+		glBindImageTexture(1, waveMapIDs[1], 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+		GLuint groups = (waveMapSize + 7) / 8; // local_size in wave_compute.glsl
+		glDispatchCompute(groups, groups, 1);
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
 
-		GL_CHECK(glUseProgram(shaderProgramID));
+		glState().useProgram(drawProgram(multiView));
+		glState().bindTexture(2, GL_TEXTURE_2D, waveMapIDs[0]);
+		glState().bindTexture(3, GL_TEXTURE_2D, waveMapIDs[1]);
 	}
 
-	void draw(glm::vec3 lightPos, glm::mat4 V, glm::mat4 P)
+	void setUniforms(bool multiView, glm::vec3 lightPos, glm::mat4 V, glm::mat4 P, float time)
 	{
-		// calculate MVP
-		glm::mat4 M = glm::mat4(1.0f);
-		glm::mat4 MVP = P * V * M;
+		PROFILE_CPU("uniforms");
 
 		// Bind some stuff
-		GL_CHECK(glUseProgram(shaderProgramID));
-		GL_CHECK(glBindVertexArray(vao));
-
-		// set the mvp
-		GLint mvpLocation = glGetUniformLocation(shaderProgramID, "MVP");
-		glUniformMatrix4fv(mvpLocation, 1, GL_FALSE, glm::value_ptr(MVP));
-
-		// set the tess levels
-		GLint innerTessLocation = glGetUniformLocation(shaderProgramID, "innerTess");
-		GLint outerTessLocation = glGetUniformLocation(shaderProgramID, "outerTess");
-		glUniform1f(innerTessLocation, 64);
-		glUniform1f(outerTessLocation, 64);
-
-		// set the time
-		GLint timeLocation = glGetUniformLocation(shaderProgramID, "time");
-		glUniform1f(timeLocation, (float)glfwGetTime());
-
-		// Set up displacement texture
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, distextID);
-        GLint distextSamplerLocation = glGetUniformLocation(shaderProgramID, "distext");
-        glUniform1i(distextSamplerLocation, 0);
-
-        // Set up water texture
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_2D, waterTextureID);
-        GLint waterTexLocation = glGetUniformLocation(shaderProgramID, "waterTexture");
-        glUniform1i(waterTexLocation, 1);
-
-		// Compute view position from the view matrix.
-		glm::mat4 invV = glm::inverse(V);
-		glm::vec3 viewPos = glm::vec3(invV[3]);
-
-		// Set light position uniform.
-		GLint lightPosLocation = glGetUniformLocation(shaderProgramID, "lightPos");
-		glUniform3f(lightPosLocation, lightPos.x, lightPos.y, lightPos.z);
-
-		// Set view position uniform.
-		GLint viewPosLocation = glGetUniformLocation(shaderProgramID, "viewPos");
-		glUniform3f(viewPosLocation, viewPos.x, viewPos.y, viewPos.z);
-
-		// Set object color uniform.
-		glm::vec4 objectColor(modelColor.x, modelColor.y, modelColor.z, 1.0f); // using PlaneMesh::modelColor
-		GLint objectColorLocation = glGetUniformLocation(shaderProgramID, "objectColor");
-		glUniform4f(objectColorLocation, objectColor.x, objectColor.y, objectColor.z, objectColor.w);
-
-		// Set texScale uniform.
-		GLint texScaleLocation = glGetUniformLocation(shaderProgramID, "texScale");
-		glUniform1f(texScaleLocation, 50.0f);
-		
-		// Set texOffset uniform.
-		GLint texOffsetLocation = glGetUniformLocation(shaderProgramID, "texOffset");
-		glUniform2f(texOffsetLocation, 0.0f, 0.0f);
-
-		// set the patch and draw
-		GL_CHECK(glPatchParameteri(GL_PATCH_VERTICES, 4));
-		GL_CHECK(glDrawElements(GL_PATCHES, numIndices, GL_UNSIGNED_INT, (void *)0));
+		glState().useProgram(drawProgram(multiView));
+		glState().bindVertexArray(vao);
+		glState().bindTexture(0, GL_TEXTURE_2D, mapStream ? mapStream->getTexture() : distextID);
+		glState().bindTexture(1, GL_TEXTURE_2D, waterTextureID);
+		if (pipeline == PIPELINE_TESS_BAKED && waveBake)
+		{
+			glState().bindTexture(2, GL_TEXTURE_3D, waveBake->getTexture());
+			glUniform2f(bakeScaleLocations[multiView], 1.0f / waveBake->getTileSize(), 1.0f / waveBake->getPeriod());
+		}
+
+		FrameUniforms frame;
+		frame.MVP = P * V; // the plane's model matrix is the identity
+		frame.lightPos = lightPos;
+		frame.time = time;
+		frame.viewPos = glm::vec3(glm::inverse(V)[3]);
+		frame.pad0 = 0.0f;
+		frameUBO.update(&frame, sizeof(frame));
+		frameUBO.bind();
+
+		MaterialUniforms material = {};
+		material.objectColor = glm::vec4(modelColor.x, modelColor.y, modelColor.z, 1.0f);
+		material.texScale = texScale;
+		material.innerTess = innerTess;
+		material.outerTess = outerTess;
+		material.adaptiveTess = adaptiveTess ? 1.0f : 0.0f;
+		material.pixelsPerEdge = pixelsPerEdge;
+		material.maxDisplacement = waveBound + mapBound;
+		material.projScale = P[1][1] * viewportHeight * 0.5f;
+		material.choppy = choppyMap ? 1.0f : 0.0f;
+		materialUBO.update(&material, sizeof(material));
+		materialUBO.bind();
+		waveUBO.bind();
+		if (ocean)
+			lodUBO.bind();
 	}
 };
@@ -0,0 +1,577 @@
+#ifndef PLY_LOADER_HPP
+#define PLY_LOADER_HPP
+
+#include <math.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "MappedFile.hpp"
+
+// PLY mesh reader for ascii and binary_little_endian files, as Blender writes
+// them. The file is mapped and parsed in place: numbers are read by hand
+// rather than through iostreams, vertices go straight into the caller's
+// interleaved buffer (which can be a mapped GL buffer) and faces are
+// triangulated into a 32-bit index list.
+//
+// Vertex layout, PLY_VERTEX_FLOATS per vertex:
+//   x y z  nx ny nz  u v
+// Attributes the file doesn't have are left at 0. u/v also accept the
+// s/t and texture_u/texture_v spellings.
+
+#define PLY_VERTEX_FLOATS 8
+
+enum PlyType
+{
+	PLY_INT8,
+	PLY_UINT8,
+	PLY_INT16,
+	PLY_UINT16,
+	PLY_INT32,
+	PLY_UINT32,
+	PLY_FLOAT32,
+	PLY_FLOAT64,
+	PLY_INVALID
+};
+
+static PlyType plyParseType(const std::string &name)
+{
+	static const char *names[][2] = {
+		{"char", "int8"}, {"uchar", "uint8"}, {"short", "int16"}, {"ushort", "uint16"},
+		{"int", "int32"}, {"uint", "uint32"}, {"float", "float32"}, {"double", "float64"}};
+	for (int t = 0; t < PLY_INVALID; ++t)
+		if (name == names[t][0] || name == names[t][1])
+			return (PlyType)t;
+	return PLY_INVALID;
+}
+
+static int plyTypeSize(PlyType t)
+{
+	static const int sizes[PLY_INVALID] = {1, 1, 2, 2, 4, 4, 4, 8};
+	return t < PLY_INVALID ? sizes[t] : 0;
+}
+
+// Reads one binary little-endian value as a double (exact for every type
+// but large 64-bit doubles, which PLY meshes don't use for indices).
+static inline double plyReadBinary(const unsigned char *p, PlyType t)
+{
+	switch (t)
+	{
+	case PLY_INT8:
+		return (int8_t)p[0];
+	case PLY_UINT8:
+		return p[0];
+	case PLY_INT16:
+	{
+		int16_t v;
+		memcpy(&v, p, 2);
+		return v;
+	}
+	case PLY_UINT16:
+	{
+		uint16_t v;
+		memcpy(&v, p, 2);
+		return v;
+	}
+	case PLY_INT32:
+	{
+		int32_t v;
+		memcpy(&v, p, 4);
+		return v;
+	}
+	case PLY_UINT32:
+	{
+		uint32_t v;
+		memcpy(&v, p, 4);
+		return v;
+	}
+	case PLY_FLOAT32:
+	{
+		float v;
+		memcpy(&v, p, 4);
+		return v;
+	}
+	case PLY_FLOAT64:
+	{
+		double v;
+		memcpy(&v, p, 8);
+		return v;
+	}
+	default:
+		return 0.0;
+	}
+}
+
+static inline bool plyIsSpace(char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Decimal number parser for the ascii body: optional sign, digits, optional
+// fraction and exponent. Up to 19 significant digits are kept exactly and
+// scaled once by a power of ten, which is well within float precision.
+static inline bool plyParseNumber(const char *&p, const char *end, double &out)
+{
+	static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+								   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+	while (p < end && plyIsSpace(*p))
+		++p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+'))
+		negative = *p++ == '-';
+
+	uint64_t mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool any = false;
+	for (; p < end && (unsigned)(*p - '0') < 10; ++p, any = true)
+	{
+		if (digits < 19)
+		{
+			mantissa = mantissa * 10 + (unsigned)(*p - '0');
+			digits += mantissa != 0;
+		}
+		else
+		{
+			++exponent;
+		}
+	}
+	if (p < end && *p == '.')
+	{
+		for (++p; p < end && (unsigned)(*p - '0') < 10; ++p, any = true)
+		{
+			if (digits < 19)
+			{
+				mantissa = mantissa * 10 + (unsigned)(*p - '0');
+				digits += mantissa != 0;
+				--exponent;
+			}
+		}
+	}
+	if (!any)
+		return false;
+	if (p < end && (*p == 'e' || *p == 'E'))
+	{
+		++p;
+		bool expNegative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			expNegative = *p++ == '-';
+		int e = 0;
+		for (; p < end && (unsigned)(*p - '0') < 10; ++p)
+			e = e < 10000 ? e * 10 + (*p - '0') : e;
+		exponent += expNegative ? -e : e;
+	}
+
+	double v = (double)mantissa;
+	if (exponent < 0)
+		v = exponent >= -22 ? v / pow10[-exponent] : v * pow(10.0, exponent);
+	else if (exponent > 0)
+		v = exponent <= 22 ? v * pow10[exponent] : v * pow(10.0, exponent);
+	out = negative ? -v : v;
+	return true;
+}
+
+class PlyReader
+{
+	struct Property
+	{
+		std::string name;
+		PlyType type;
+		PlyType countType; // PLY_INVALID unless this is a list
+		int slot;		   // vertex float it goes to, -1 if none
+	};
+
+	struct Element
+	{
+		std::string name;
+		size_t count;
+		std::vector<Property> props;
+	};
+
+	MappedFile file;
+	std::string path;
+	bool binary;
+	size_t bodyOffset;
+	std::vector<Element> elements;
+	int vertexElement, faceElement;
+
+	bool fail(const char *why)
+	{
+		fprintf(stderr, "%s: %s\n", path.c_str(), why);
+		return false;
+	}
+
+	static int vertexSlot(const std::string &name)
+	{
+		static const char *names[][3] = {
+			{"x", "", ""}, {"y", "", ""}, {"z", "", ""}, {"nx", "", ""}, {"ny", "", ""}, {"nz", "", ""},
+			{"u", "s", "texture_u"}, {"v", "t", "texture_v"}};
+		for (int slot = 0; slot < PLY_VERTEX_FLOATS; ++slot)
+			for (int i = 0; i < 3; ++i)
+				if (names[slot][i][0] && name == names[slot][i])
+					return slot;
+		return -1;
+	}
+
+	bool parseHeader()
+	{
+		const char *begin = (const char *)file.data();
+		const char *end = begin + file.size();
+		const char *line = begin;
+		bool formatSeen = false;
+		for (int lineNo = 0; line < end; ++lineNo)
+		{
+			const char *eol = (const char *)memchr(line, '\n', end - line);
+			if (!eol)
+				return fail("PLY header has no end_header");
+			std::string text(line, eol);
+			if (!text.empty() && text.back() == '\r')
+				text.pop_back();
+			line = eol + 1;
+
+			std::vector<std::string> words;
+			for (size_t i = 0; i < text.size();)
+			{
+				while (i < text.size() && plyIsSpace(text[i]))
+					++i;
+				size_t j = i;
+				while (j < text.size() && !plyIsSpace(text[j]))
+					++j;
+				if (j > i)
+					words.push_back(text.substr(i, j - i));
+				i = j;
+			}
+
+			if (lineNo == 0)
+			{
+				if (words.size() != 1 || words[0] != "ply")
+					return fail("not a PLY file");
+				continue;
+			}
+			if (words.empty() || words[0] == "comment" || words[0] == "obj_info")
+				continue;
+			if (words[0] == "end_header")
+			{
+				bodyOffset = line - begin;
+				if (!formatSeen)
+					return fail("PLY header has no format line");
+				return true;
+			}
+			if (words[0] == "format" && words.size() >= 2)
+			{
+				if (words[1] == "ascii")
+					binary = false;
+				else if (words[1] == "binary_little_endian")
+					binary = true;
+				else
+					return fail("only ascii and binary_little_endian PLY files are supported");
+				formatSeen = true;
+			}
+			else if (words[0] == "element" && words.size() == 3)
+			{
+				Element e;
+				e.name = words[1];
+				e.count = strtoull(words[2].c_str(), NULL, 10);
+				elements.push_back(e);
+			}
+			else if (words[0] == "property" && !elements.empty())
+			{
+				Property prop;
+				prop.slot = -1;
+				prop.countType = PLY_INVALID;
+				if (words.size() == 5 && words[1] == "list")
+				{
+					prop.countType = plyParseType(words[2]);
+					prop.type = plyParseType(words[3]);
+					prop.name = words[4];
+					if (prop.countType == PLY_INVALID || prop.countType == PLY_FLOAT32 || prop.countType == PLY_FLOAT64)
+						return fail("bad PLY list count type");
+				}
+				else if (words.size() == 3)
+				{
+					prop.type = plyParseType(words[1]);
+					prop.name = words[2];
+				}
+				else
+				{
+					return fail("malformed PLY property line");
+				}
+				if (prop.type == PLY_INVALID)
+					return fail("unknown PLY property type");
+				elements.back().props.push_back(prop);
+			}
+			else
+			{
+				return fail("unknown PLY header line");
+			}
+		}
+		return fail("PLY header has no end_header");
+	}
+
+	// ascii: one element instance per line, values separated by spaces.
+	bool readAscii(float *vertices, std::vector<uint32_t> &indices)
+	{
+		const char *p = (const char *)file.data() + bodyOffset;
+		const char *end = (const char *)file.data() + file.size();
+		size_t numVerts = vertexCount();
+		for (size_t e = 0; e < elements.size(); ++e)
+		{
+			const Element &el = elements[e];
+			for (size_t i = 0; i < el.count; ++i)
+			{
+				float *vertex = (int)e == vertexElement ? vertices + i * PLY_VERTEX_FLOATS : NULL;
+				bool firstList = true;
+				for (const Property &prop : el.props)
+				{
+					double value;
+					if (prop.countType == PLY_INVALID)
+					{
+						if (!plyParseNumber(p, end, value))
+							return fail("truncated or malformed PLY data");
+						if (vertex && prop.slot >= 0)
+							vertex[prop.slot] = (float)value;
+						continue;
+					}
+
+					if (!plyParseNumber(p, end, value))
+						return fail("truncated or malformed PLY data");
+					size_t n = (size_t)value;
+					bool isFace = (int)e == faceElement && firstList;
+					firstList = false;
+					uint32_t first = 0, prev = 0;
+					for (size_t k = 0; k < n; ++k)
+					{
+						if (!plyParseNumber(p, end, value))
+							return fail("truncated or malformed PLY data");
+						if (!isFace)
+							continue;
+						uint32_t index = (uint32_t)value;
+						if (index >= numVerts)
+							return fail("PLY face refers to a missing vertex");
+						// Fan-triangulate polygons.
+						if (k == 0)
+							first = index;
+						else if (k >= 2)
+						{
+							indices.push_back(first);
+							indices.push_back(prev);
+							indices.push_back(index);
+						}
+						prev = index;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+	bool readBinary(float *vertices, std::vector<uint32_t> &indices)
+	{
+		const unsigned char *p = file.data() + bodyOffset;
+		const unsigned char *end = file.data() + file.size();
+		size_t numVerts = vertexCount();
+		for (size_t e = 0; e < elements.size(); ++e)
+		{
+			const Element &el = elements[e];
+
+			// Rows of exactly x y z nx ny nz u v floats are the output layout.
+			if ((int)e == vertexElement && el.props.size() == PLY_VERTEX_FLOATS)
+			{
+				bool exact = true;
+				for (int k = 0; k < PLY_VERTEX_FLOATS; ++k)
+					exact = exact && el.props[k].type == PLY_FLOAT32 && el.props[k].slot == k;
+				if (exact)
+				{
+					size_t bytes = el.count * PLY_VERTEX_FLOATS * sizeof(float);
+					if ((size_t)(end - p) < bytes)
+						return fail("truncated PLY data");
+					memcpy(vertices, p, bytes);
+					p += bytes;
+					continue;
+				}
+			}
+
+			// Faces that are all "3 a b c" with uchar counts and 32-bit
+			// indices: copy the indices out with one bounds check at the end.
+			size_t i = 0;
+			if ((int)e == faceElement && el.props.size() == 1 && el.props[0].countType == PLY_UINT8 &&
+				(el.props[0].type == PLY_UINT32 || el.props[0].type == PLY_INT32))
+			{
+				size_t base = indices.size();
+				indices.resize(base + el.count * 3);
+				uint32_t *out = indices.data() + base;
+				uint32_t largest = 0;
+				for (; i < el.count && end - p >= 13 && p[0] == 3; ++i, p += 13)
+				{
+					uint32_t tri[3];
+					memcpy(tri, p + 1, 12);
+					largest = std::max(largest, std::max(tri[0], std::max(tri[1], tri[2])));
+					memcpy(out + 3 * i, tri, 12);
+				}
+				if (i > 0 && largest >= numVerts)
+					return fail("PLY face refers to a missing vertex");
+				// Anything else (polygons, truncation) goes the general way.
+				indices.resize(base + i * 3);
+			}
+
+			for (; i < el.count; ++i)
+			{
+				float *vertex = (int)e == vertexElement ? vertices + i * PLY_VERTEX_FLOATS : NULL;
+				bool firstList = true;
+				for (const Property &prop : el.props)
+				{
+					if (prop.countType == PLY_INVALID)
+					{
+						int size = plyTypeSize(prop.type);
+						if (end - p < size)
+							return fail("truncated PLY data");
+						if (vertex && prop.slot >= 0)
+							vertex[prop.slot] = (float)plyReadBinary(p, prop.type);
+						p += size;
+						continue;
+					}
+
+					int countSize = plyTypeSize(prop.countType), size = plyTypeSize(prop.type);
+					if (end - p < countSize)
+						return fail("truncated PLY data");
+					size_t n = (size_t)plyReadBinary(p, prop.countType);
+					p += countSize;
+					if ((size_t)(end - p) < n * size)
+						return fail("truncated PLY data");
+					bool isFace = (int)e == faceElement && firstList;
+					firstList = false;
+					if (!isFace)
+					{
+						p += n * size;
+						continue;
+					}
+
+					uint32_t first = 0, prev = 0;
+					for (size_t k = 0; k < n; ++k, p += size)
+					{
+						uint32_t index;
+						if (prop.type == PLY_UINT32 || prop.type == PLY_INT32)
+							memcpy(&index, p, 4);
+						else
+							index = (uint32_t)plyReadBinary(p, prop.type);
+						if (index >= numVerts)
+							return fail("PLY face refers to a missing vertex");
+						if (k == 0)
+							first = index;
+						else if (k >= 2)
+						{
+							indices.push_back(first);
+							indices.push_back(prev);
+							indices.push_back(index);
+						}
+						prev = index;
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+public:
+	PlyReader() : binary(false), bodyOffset(0), vertexElement(-1), faceElement(-1) {}
+
+	// Maps the file and parses the header. Prints why and returns false if it
+	// is not a PLY this reader supports or has no vertices.
+	bool open(const char *filePath)
+	{
+		path = filePath;
+		elements.clear();
+		vertexElement = faceElement = -1;
+		if (!file.open(filePath))
+			return fail("could not be opened. Are you in the right directory?");
+		file.adviseSequential();
+		if (!parseHeader())
+			return false;
+
+		for (size_t e = 0; e < elements.size(); ++e)
+		{
+			if (elements[e].name == "vertex" && vertexElement < 0)
+			{
+				vertexElement = (int)e;
+				for (Property &prop : elements[e].props)
+					if (prop.countType == PLY_INVALID)
+						prop.slot = vertexSlot(prop.name);
+			}
+			else if (elements[e].name == "face" && faceElement < 0)
+			{
+				faceElement = (int)e;
+			}
+		}
+		if (vertexElement < 0)
+			return fail("PLY file has no vertex element");
+		return true;
+	}
+
+	size_t vertexCount() const { return vertexElement >= 0 ? elements[vertexElement].count : 0; }
+	size_t faceCount() const { return faceElement >= 0 ? elements[faceElement].count : 0; }
+
+	bool hasAttribute(int slot) const
+	{
+		if (vertexElement < 0)
+			return false;
+		for (const Property &prop : elements[vertexElement].props)
+			if (prop.slot == slot)
+				return true;
+		return false;
+	}
+	bool hasNormals() const { return hasAttribute(3) && hasAttribute(4) && hasAttribute(5); }
+	bool hasTexCoords() const { return hasAttribute(6) && hasAttribute(7); }
+
+	// Parses the body. vertices must hold vertexCount() * PLY_VERTEX_FLOATS
+	// floats; triangle indices are appended to indices (reserve faceCount() * 3
+	// for triangle meshes).
+	bool read(float *vertices, std::vector<uint32_t> &indices)
+	{
+		if (!file.isOpen())
+			return false;
+		memset(vertices, 0, vertexCount() * PLY_VERTEX_FLOATS * sizeof(float));
+		return binary ? readBinary(vertices, indices) : readAscii(vertices, indices);
+	}
+
+	// Bytes of file, for throughput figures.
+	size_t fileSize() const { return file.size(); }
+};
+
+// Whole mesh in CPU memory, for callers that don't need to parse into a
+// buffer of their own.
+struct PlyMesh
+{
+	std::vector<float> vertices; // PLY_VERTEX_FLOATS per vertex
+	std::vector<uint32_t> indices;
+
+	size_t vertexCount() const { return vertices.size() / PLY_VERTEX_FLOATS; }
+
+	// Box around the positions; all zero for an empty mesh.
+	void bounds(float lo[3], float hi[3]) const
+	{
+		for (int k = 0; k < 3; ++k)
+			lo[k] = hi[k] = vertices.empty() ? 0.0f : vertices[k];
+		for (size_t i = 0; i < vertices.size(); i += PLY_VERTEX_FLOATS)
+			for (int k = 0; k < 3; ++k)
+			{
+				lo[k] = std::min(lo[k], vertices[i + k]);
+				hi[k] = std::max(hi[k], vertices[i + k]);
+			}
+	}
+};
+
+bool loadPly(const char *path, PlyMesh &mesh)
+{
+	PlyReader reader;
+	if (!reader.open(path))
+		return false;
+	mesh.vertices.resize(reader.vertexCount() * PLY_VERTEX_FLOATS);
+	mesh.indices.clear();
+	mesh.indices.reserve(reader.faceCount() * 3);
+	return reader.read(mesh.vertices.data(), mesh.indices);
+}
+
+#endif
@@ -0,0 +1,326 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+// Lightweight frame profiler.
+//
+// CPU zones are scoped wall-clock timers. GPU zones wrap GL_TIME_ELAPSED
+// queries (plus per-stage invocation counts when ARB_pipeline_statistics_query
+// is there); their results are read PROFILER_GPU_LATENCY frames later and only
+// if already available, so the profiler never makes the CPU wait on the GPU.
+//
+// Everything recorded can be written as a Chrome/Perfetto trace (open it in
+// chrome://tracing or ui.perfetto.dev), and each zone keeps rolling stats over
+// the last PROFILER_HISTORY samples.
+//
+// Zone names must outlive the profiler (string literals).
+
+#define PROFILER_GPU_LATENCY 3
+#define PROFILER_HISTORY 240
+#define PROFILER_MAX_EVENTS 200000
+
+class Profiler
+{
+	enum Track
+	{
+		TRACK_CPU = 1,
+		TRACK_GPU = 2
+	};
+
+	struct Event
+	{
+		const char *name;
+		int track;
+		double startUs, durUs;
+	};
+
+	struct Counter
+	{
+		const char *name;
+		double tsUs;
+		GLuint64 tes, gs, fs;
+	};
+
+	struct Stats
+	{
+		std::vector<double> samples; // ring buffer, ms
+		size_t next = 0;
+		size_t count = 0;
+
+		void add(double ms)
+		{
+			if (samples.size() < PROFILER_HISTORY)
+				samples.push_back(ms);
+			else
+				samples[next] = ms;
+			next = (next + 1) % PROFILER_HISTORY;
+			++count;
+		}
+	};
+
+	// Queries for one GPU zone. The statistics queries are 0 when unsupported.
+	struct GpuZone
+	{
+		const char *name;
+		double cpuStartUs;
+		GLuint time, tes, gs, fs;
+	};
+
+	bool enabled = false;
+	bool pipelineStats = false;
+	std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	std::vector<Event> events;
+	std::vector<Counter> counters;
+	std::map<std::string, Stats> cpuStats, gpuStats;
+
+	// GPU zones issued in each of the last PROFILER_GPU_LATENCY frames, and
+	// query objects ready for reuse.
+	std::vector<GpuZone> inFlight[PROFILER_GPU_LATENCY];
+	std::vector<GpuZone> freeZones;
+	int frameIndex = 0;
+	bool gpuZoneOpen = false;
+	GpuZone openZone;
+
+	void record(const char *name, int track, double startUs, double durUs)
+	{
+		if (events.size() < PROFILER_MAX_EVENTS)
+			events.push_back(Event{name, track, startUs, durUs});
+		(track == TRACK_CPU ? cpuStats : gpuStats)[name].add(durUs / 1000.0);
+	}
+
+	GpuZone allocZone(const char *name)
+	{
+		GpuZone zone;
+		if (!freeZones.empty())
+		{
+			zone = freeZones.back();
+			freeZones.pop_back();
+		}
+		else
+		{
+			glGenQueries(1, &zone.time);
+			zone.tes = zone.gs = zone.fs = 0;
+			if (pipelineStats)
+			{
+				glGenQueries(1, &zone.tes);
+				glGenQueries(1, &zone.gs);
+				glGenQueries(1, &zone.fs);
+			}
+		}
+		zone.name = name;
+		zone.cpuStartUs = nowUs();
+		return zone;
+	}
+
+	// The timer can finish before the statistics queries that ended with it;
+	// reading those unfinished would stall, so their counters are skipped.
+	static bool statsAvailable(const GpuZone &zone)
+	{
+		for (GLuint query : {zone.tes, zone.gs, zone.fs})
+		{
+			GLint available = 0;
+			glGetQueryObjectiv(query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				return false;
+		}
+		return true;
+	}
+
+	// Collects whatever finished from the frame that used this slot last time.
+	void collect(std::vector<GpuZone> &zones)
+	{
+		for (GpuZone &zone : zones)
+		{
+			GLint available = 0;
+			glGetQueryObjectiv(zone.time, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				GLuint64 ns = 0;
+				glGetQueryObjectui64v(zone.time, GL_QUERY_RESULT, &ns);
+				record(zone.name, TRACK_GPU, zone.cpuStartUs, ns / 1000.0);
+
+				if (zone.tes && counters.size() < PROFILER_MAX_EVENTS && statsAvailable(zone))
+				{
+					Counter c{zone.name, zone.cpuStartUs, 0, 0, 0};
+					glGetQueryObjectui64v(zone.tes, GL_QUERY_RESULT, &c.tes);
+					glGetQueryObjectui64v(zone.gs, GL_QUERY_RESULT, &c.gs);
+					glGetQueryObjectui64v(zone.fs, GL_QUERY_RESULT, &c.fs);
+					counters.push_back(c);
+				}
+			}
+			// Results that are still not in after PROFILER_GPU_LATENCY frames
+			// are dropped rather than waited for. Reusing the query restarts it.
+			freeZones.push_back(zone);
+		}
+		zones.clear();
+	}
+
+	static void printStats(FILE *out, const char *kind, std::map<std::string, Stats> &all)
+	{
+		for (auto &entry : all)
+		{
+			std::vector<double> v = entry.second.samples;
+			if (v.empty())
+				continue;
+			std::sort(v.begin(), v.end());
+			double sum = 0.0;
+			for (double x : v)
+				sum += x;
+			fprintf(out, "  %s %-16s mean %7.3f  p50 %7.3f  p95 %7.3f  max %7.3f ms  (%zu samples)\n",
+					kind, entry.first.c_str(), sum / v.size(), v[v.size() / 2],
+					v[std::min(v.size() - 1, v.size() * 95 / 100)], v.back(), entry.second.count);
+		}
+	}
+
+public:
+	void setEnabled(bool on)
+	{
+		enabled = on;
+		if (on)
+			pipelineStats = GLEW_ARB_pipeline_statistics_query;
+	}
+	bool isEnabled() const { return enabled; }
+
+	double nowUs() const
+	{
+		return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	// Call once per frame before any GPU zone.
+	void beginFrame()
+	{
+		if (!enabled)
+			return;
+		frameIndex = (frameIndex + 1) % PROFILER_GPU_LATENCY;
+		collect(inFlight[frameIndex]);
+	}
+
+	void cpuZone(const char *name, double startUs)
+	{
+		record(name, TRACK_CPU, startUs, nowUs() - startUs);
+	}
+
+	// GPU zones do not nest: GL allows one active GL_TIME_ELAPSED query.
+	void gpuZoneBegin(const char *name)
+	{
+		if (!enabled || gpuZoneOpen)
+			return;
+		openZone = allocZone(name);
+		gpuZoneOpen = true;
+		glBeginQuery(GL_TIME_ELAPSED, openZone.time);
+		if (openZone.tes)
+		{
+			glBeginQuery(GL_TESS_EVALUATION_SHADER_INVOCATIONS_ARB, openZone.tes);
+			glBeginQuery(GL_GEOMETRY_SHADER_INVOCATIONS, openZone.gs);
+			glBeginQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB, openZone.fs);
+		}
+	}
+
+	void gpuZoneEnd()
+	{
+		if (!gpuZoneOpen)
+			return;
+		if (openZone.tes)
+		{
+			glEndQuery(GL_FRAGMENT_SHADER_INVOCATIONS_ARB);
+			glEndQuery(GL_GEOMETRY_SHADER_INVOCATIONS);
+			glEndQuery(GL_TESS_EVALUATION_SHADER_INVOCATIONS_ARB);
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+		inFlight[frameIndex].push_back(openZone);
+		gpuZoneOpen = false;
+	}
+
+	// Rolling mean/p50/p95/max for every zone over the last PROFILER_HISTORY samples.
+	void printSummary(FILE *out)
+	{
+		fprintf(out, "Profile (last %d samples per zone):\n", PROFILER_HISTORY);
+		printStats(out, "cpu", cpuStats);
+		printStats(out, "gpu", gpuStats);
+		if (!counters.empty())
+		{
+			const Counter &c = counters.back();
+			fprintf(out, "  invocations (%s): tess eval %llu, geometry %llu, fragment %llu\n", c.name,
+					(unsigned long long)c.tes, (unsigned long long)c.gs, (unsigned long long)c.fs);
+		}
+	}
+
+	// Chrome trace event format: complete ("X") events per zone on a CPU and a
+	// GPU track, and counter ("C") events for shader invocations. GPU events
+	// are placed at the CPU time they were issued.
+	bool writeChromeTrace(const char *path)
+	{
+		FILE *file = fopen(path, "w");
+		if (!file)
+		{
+			fprintf(stderr, "Could not write %s\n", path);
+			return false;
+		}
+		fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"CPU\"}},\n", TRACK_CPU);
+		fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"GPU\"}}", TRACK_GPU);
+		for (const Event &e : events)
+		{
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+					e.name, e.track, e.startUs, e.durUs);
+		}
+		for (const Counter &c : counters)
+		{
+			fprintf(file, ",\n{\"name\":\"%s invocations\",\"ph\":\"C\",\"pid\":1,\"ts\":%.3f,"
+						  "\"args\":{\"tess_eval\":%llu,\"geometry\":%llu,\"fragment\":%llu}}",
+					c.name, c.tsUs, (unsigned long long)c.tes, (unsigned long long)c.gs, (unsigned long long)c.fs);
+		}
+		fprintf(file, "\n]}\n");
+		fclose(file);
+		return true;
+	}
+};
+
+Profiler &profiler()
+{
+	static Profiler instance;
+	return instance;
+}
+
+// Times the enclosing scope as a CPU zone.
+class ScopedCpuZone
+{
+	const char *name;
+	double startUs;
+
+public:
+	explicit ScopedCpuZone(const char *name) : name(name), startUs(-1.0)
+	{
+		if (profiler().isEnabled())
+			startUs = profiler().nowUs();
+	}
+	~ScopedCpuZone()
+	{
+		if (startUs >= 0.0)
+			profiler().cpuZone(name, startUs);
+	}
+};
+
+// Times the GL commands issued in the enclosing scope as a GPU zone.
+class ScopedGpuZone
+{
+public:
+	explicit ScopedGpuZone(const char *name) { profiler().gpuZoneBegin(name); }
+	~ScopedGpuZone() { profiler().gpuZoneEnd(); }
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_CPU(name) ScopedCpuZone PROFILE_CONCAT(cpuZone_, __LINE__)(name)
+#define PROFILE_GPU(name) ScopedGpuZone PROFILE_CONCAT(gpuZone_, __LINE__)(name)
+
+#endif
@@ -0,0 +1,346 @@
+#ifndef SPECTRAL_OCEAN_HPP
+#define SPECTRAL_OCEAN_HPP
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+#include "FFT.hpp"
+#include "ThreadPool.hpp"
+#include "WaveField.hpp"
+
+// Tessendorf's FFT ocean on the CPU ("Simulating Ocean Water", 2001).
+//
+// A random field h0(k) is drawn once from a wave spectrum. Every frame it is
+// moved to time t with the deep-water dispersion relation,
+//   h(k, t) = h0(k) e^(i w(k) t) + conj(h0(-k)) e^(-i w(k) t),
+// and the height and the choppy horizontal offsets D(k) = i k/|k| h(k, t)
+// are brought back to space with two inverse FFTs. The offsets pull points
+// towards the crests, the same way the Gerstner waves in geo.glsl do. Height and x offset share
+// one complex transform (both outputs are real, so one goes in the imaginary
+// part); the z offset takes the other.
+//
+// The result is a size x size tile covering patchSize x patchSize metres that
+// repeats seamlessly, laid out as interleaved RGB floats (height, x offset,
+// z offset), rows along z. PlaneMesh::setDisplacementMap() uploads it as
+// distext.
+
+enum OceanSpectrum
+{
+	SPECTRUM_PHILLIPS,
+	SPECTRUM_JONSWAP
+};
+
+// "phillips" or "jonswap"; anything else falls back to Phillips.
+OceanSpectrum parseSpectrum(const char *name)
+{
+	if (strcmp(name, "jonswap") == 0)
+		return SPECTRUM_JONSWAP;
+	if (strcmp(name, "phillips") != 0)
+		fprintf(stderr, "Unknown spectrum %s, using phillips\n", name);
+	return SPECTRUM_PHILLIPS;
+}
+
+struct SpectralOceanParams
+{
+	int size = 256;              // samples per side, a power of two
+	float patchSize = 50.0f;     // metres per tile; match texScale in the shaders
+	float windSpeed = 10.0f;     // m/s, 10 m above the sea
+	float windDirX = 1.0f, windDirZ = 0.0f;
+	OceanSpectrum spectrum = SPECTRUM_PHILLIPS;
+	float amplitude = 1.0f;      // scales every wave height
+	float fetch = 100000.0f;     // JONSWAP: metres of sea the wind has blown over
+	float gamma = 3.3f;          // JONSWAP peak enhancement
+	float choppiness = 1.0f;     // scale of the horizontal offsets, 0 for plain heights
+	float repeatPeriod = 200.0f; // seconds; frequencies are rounded so the sea loops
+	unsigned seed = 1;
+};
+
+#define OCEAN_GRAVITY 9.81f
+
+// Evolves count spectrum entries to phase w*t and writes the two packed
+// transforms: z1 = h * (1 - lambda kx/|k|), z2 = i lambda kz/|k| h.
+// sumR = Re(h0 + h0m), difI = Im(h0m - h0), sumI = Im(h0 + h0m),
+// difR = Re(h0 - h0m), where h0m = conj(h0(-k)).
+struct SpectrumArrays
+{
+	const float *sumR, *difI, *sumI, *difR;
+	const float *omega, *kxn, *kzn;
+	float *z1r, *z1i, *z2r, *z2i;
+};
+
+static void evolveSpectrumScalar(const SpectrumArrays &a, float t, float lambda, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; ++i)
+	{
+		float phase = a.omega[i] * t;
+		float s = sinf(phase), c = cosf(phase);
+		float hr = a.sumR[i] * c + a.difI[i] * s;
+		float hi = a.sumI[i] * c + a.difR[i] * s;
+		float x = 1.0f - lambda * a.kxn[i];
+		float z = lambda * a.kzn[i];
+		a.z1r[i] = hr * x;
+		a.z1i[i] = hi * x;
+		a.z2r[i] = -z * hi;
+		a.z2i[i] = z * hr;
+	}
+}
+
+#ifdef WAVE_FIELD_X86
+
+static void evolveSpectrumSSE(const SpectrumArrays &a, float t, float lambda, size_t begin, size_t end)
+{
+	const __m128 vt = _mm_set1_ps(t), vl = _mm_set1_ps(lambda), one = _mm_set1_ps(1.0f);
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 s, c;
+		sincosSSE(_mm_mul_ps(_mm_loadu_ps(a.omega + i), vt), &s, &c);
+		__m128 hr = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a.sumR + i), c), _mm_mul_ps(_mm_loadu_ps(a.difI + i), s));
+		__m128 hi = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(a.sumI + i), c), _mm_mul_ps(_mm_loadu_ps(a.difR + i), s));
+		__m128 x = _mm_sub_ps(one, _mm_mul_ps(vl, _mm_loadu_ps(a.kxn + i)));
+		__m128 z = _mm_mul_ps(vl, _mm_loadu_ps(a.kzn + i));
+		_mm_storeu_ps(a.z1r + i, _mm_mul_ps(hr, x));
+		_mm_storeu_ps(a.z1i + i, _mm_mul_ps(hi, x));
+		_mm_storeu_ps(a.z2r + i, _mm_sub_ps(_mm_setzero_ps(), _mm_mul_ps(z, hi)));
+		_mm_storeu_ps(a.z2i + i, _mm_mul_ps(z, hr));
+	}
+	evolveSpectrumScalar(a, t, lambda, i, end);
+}
+
+__attribute__((target("avx2,fma"))) static void evolveSpectrumAVX2(const SpectrumArrays &a, float t, float lambda, size_t begin, size_t end)
+{
+	const __m256 vt = _mm256_set1_ps(t), vl = _mm256_set1_ps(lambda), one = _mm256_set1_ps(1.0f);
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 s, c;
+		sincosAVX2(_mm256_mul_ps(_mm256_loadu_ps(a.omega + i), vt), &s, &c);
+		__m256 hr = _mm256_fmadd_ps(_mm256_loadu_ps(a.sumR + i), c, _mm256_mul_ps(_mm256_loadu_ps(a.difI + i), s));
+		__m256 hi = _mm256_fmadd_ps(_mm256_loadu_ps(a.sumI + i), c, _mm256_mul_ps(_mm256_loadu_ps(a.difR + i), s));
+		__m256 x = _mm256_fnmadd_ps(vl, _mm256_loadu_ps(a.kxn + i), one);
+		__m256 z = _mm256_mul_ps(vl, _mm256_loadu_ps(a.kzn + i));
+		_mm256_storeu_ps(a.z1r + i, _mm256_mul_ps(hr, x));
+		_mm256_storeu_ps(a.z1i + i, _mm256_mul_ps(hi, x));
+		_mm256_storeu_ps(a.z2r + i, _mm256_sub_ps(_mm256_setzero_ps(), _mm256_mul_ps(z, hi)));
+		_mm256_storeu_ps(a.z2i + i, _mm256_mul_ps(z, hr));
+	}
+	if (i < end)
+	{
+		// Leaving VEX code: avoid the SSE/AVX transition penalty.
+		_mm256_zeroupper();
+		evolveSpectrumScalar(a, t, lambda, i, end);
+	}
+}
+
+#endif
+
+class SpectralOcean
+{
+	SpectralOceanParams params;
+	ThreadPool &pool;
+	FFT2D fft;
+	WaveField::Kernel kernel;
+
+	// Per wave vector, row-major with rows along kz (see SpectrumArrays).
+	std::vector<float> sumR, difI, sumI, difR;
+	std::vector<float> omega, kxn, kzn;
+	// The two transforms, in place.
+	std::vector<float> z1r, z1i, z2r, z2i;
+
+	std::vector<float> rgb;
+	std::vector<float> rowMax;
+	float bound = 0.0f;
+	double updateMs = 0.0;
+
+	// Wavenumber of FFT index i: 0..n/2-1 are positive, the rest negative.
+	float wavenumber(int i) const
+	{
+		int n = params.size;
+		int m = i < n / 2 ? i : i - n;
+		return 2.0f * (float)M_PI * m / params.patchSize;
+	}
+
+	// Directional wavenumber spectrum Psi(k) in m^4, so that a cell of the
+	// spectrum grid (dk x dk) holds a variance of Psi * dk^2.
+	float spectrum(float kx, float kz) const
+	{
+		float k = sqrtf(kx * kx + kz * kz);
+		if (k < 1e-6f)
+			return 0.0f;
+
+		float wx = params.windDirX, wz = params.windDirZ;
+		float wl = sqrtf(wx * wx + wz * wz);
+		float cosTheta = wl > 0.0f ? (kx * wx + kz * wz) / (k * wl) : 1.0f;
+		// cos^2 spreading; waves running against the wind are mostly damped.
+		float spread = (2.0f / (float)M_PI) * cosTheta * cosTheta * (cosTheta < 0.0f ? 0.07f : 1.0f);
+
+		// Waves much shorter than a texel only alias.
+		float cell = params.patchSize / params.size;
+		float smallWaves = expf(-k * k * cell * cell);
+
+		const float g = OCEAN_GRAVITY;
+		float U = std::max(params.windSpeed, 0.1f);
+		float psi;
+		if (params.spectrum == SPECTRUM_JONSWAP)
+		{
+			// JONSWAP frequency spectrum S(w), moved to wavenumbers with the
+			// deep-water dispersion w^2 = g k: Psi(k) = S(w) dw/dk / k.
+			float F = std::max(params.fetch, 1.0f);
+			float alpha = 0.076f * powf(U * U / (F * g), 0.22f);
+			float wp = 22.0f * powf(g * g / (U * F), 1.0f / 3.0f);
+			float w = sqrtf(g * k);
+			float sigma = w <= wp ? 0.07f : 0.09f;
+			float r = expf(-(w - wp) * (w - wp) / (2.0f * sigma * sigma * wp * wp));
+			float S = alpha * g * g / powf(w, 5.0f) * expf(-1.25f * powf(wp / w, 4.0f)) * powf(params.gamma, r);
+			psi = S * (g / (2.0f * w)) / k;
+		}
+		else
+		{
+			// Phillips: alpha / (2 k^4) with the largest waves the wind can
+			// raise, L = U^2 / g, as a cut-off.
+			float L = U * U / g;
+			psi = 0.0081f / (2.0f * k * k * k * k) * expf(-1.0f / (k * L * k * L));
+		}
+		return params.amplitude * psi * spread * smallWaves;
+	}
+
+	void initSpectrum()
+	{
+		int n = params.size;
+		size_t count = (size_t)n * n;
+		for (std::vector<float> *v : {&sumR, &difI, &sumI, &difR, &omega, &kxn, &kzn, &z1r, &z1i, &z2r, &z2i})
+			v->assign(count, 0.0f);
+		rgb.assign(count * 3, 0.0f);
+		rowMax.assign(n, 0.0f);
+
+		// h0(k) = (xi_r + i xi_i) sqrt(Psi(k) dk^2 / 2) with standard normal xi.
+		std::vector<float> h0r(count), h0i(count);
+		std::mt19937 rng(params.seed);
+		std::normal_distribution<float> gauss(0.0f, 1.0f);
+		float dk = 2.0f * (float)M_PI / params.patchSize;
+		for (int p = 0; p < n; ++p)
+		{
+			for (int q = 0; q < n; ++q)
+			{
+				float amp = sqrtf(spectrum(wavenumber(q), wavenumber(p)) * dk * dk * 0.5f);
+				h0r[(size_t)p * n + q] = gauss(rng) * amp;
+				h0i[(size_t)p * n + q] = gauss(rng) * amp;
+			}
+		}
+
+		// Frequencies are rounded down to multiples of 2 pi / repeatPeriod so
+		// that the whole sea repeats exactly; it also keeps w * t small enough
+		// for the polynomial sincos.
+		float w0 = 2.0f * (float)M_PI / std::max(params.repeatPeriod, 1.0f);
+		for (int p = 0; p < n; ++p)
+		{
+			for (int q = 0; q < n; ++q)
+			{
+				size_t i = (size_t)p * n + q;
+				size_t mirror = (size_t)((n - p) % n) * n + (n - q) % n; // -k
+				float mr = h0r[mirror], mi = -h0i[mirror];				// conj(h0(-k))
+				sumR[i] = h0r[i] + mr;
+				difI[i] = mi - h0i[i];
+				sumI[i] = h0i[i] + mi;
+				difR[i] = h0r[i] - mr;
+
+				float kx = wavenumber(q), kz = wavenumber(p);
+				float k = sqrtf(kx * kx + kz * kz);
+				omega[i] = floorf(sqrtf(OCEAN_GRAVITY * k) / w0) * w0;
+				kxn[i] = k > 0.0f ? kx / k : 0.0f;
+				kzn[i] = k > 0.0f ? kz / k : 0.0f;
+			}
+		}
+	}
+
+	void evolve(const SpectrumArrays &a, float t, size_t begin, size_t end) const
+	{
+		float lambda = params.choppiness;
+		switch (kernel)
+		{
+#ifdef WAVE_FIELD_X86
+		case WaveField::KERNEL_AVX2:
+			evolveSpectrumAVX2(a, t, lambda, begin, end);
+			break;
+		case WaveField::KERNEL_SSE:
+			evolveSpectrumSSE(a, t, lambda, begin, end);
+			break;
+#endif
+		default:
+			evolveSpectrumScalar(a, t, lambda, begin, end);
+			break;
+		}
+	}
+
+public:
+	SpectralOcean(const SpectralOceanParams &p, ThreadPool &pool)
+		: params(p), pool(pool), fft(p.size, pool), kernel(WaveField::bestKernel())
+	{
+		initSpectrum();
+	}
+
+	SpectralOcean(const SpectralOcean &) = delete;
+	SpectralOcean &operator=(const SpectralOcean &) = delete;
+
+	const SpectralOceanParams &getParams() const { return params; }
+
+	// Forces a kernel for the spectrum update (the FFT picks its own).
+	void setKernel(WaveField::Kernel k) { kernel = k > WaveField::bestKernel() ? WaveField::bestKernel() : k; }
+
+	// Only the horizontal scale changes; no need to redraw the spectrum.
+	void setChoppiness(float lambda) { params.choppiness = lambda; }
+
+	// Computes the sea at time t (seconds) into displacement().
+	void update(double time) { update(time, rgb.data()); }
+
+	// Same, but writes the size * size RGB texels to out instead, e.g.
+	// straight into a TextureStreamer slot.
+	void update(double time, float *out)
+	{
+		auto start = std::chrono::steady_clock::now();
+		int n = params.size;
+		float t = (float)fmod(time, (double)std::max(params.repeatPeriod, 1.0f));
+
+		SpectrumArrays a = {sumR.data(), difI.data(), sumI.data(), difR.data(),
+							omega.data(), kxn.data(), kzn.data(),
+							z1r.data(), z1i.data(), z2r.data(), z2i.data()};
+		pool.parallelFor(n, [&](size_t row, unsigned)
+						 { evolve(a, t, row * n, (row + 1) * n); });
+
+		fft.inverse(z1r.data(), z1i.data());
+		fft.inverse(z2r.data(), z2i.data());
+
+		// Interleave for the texture and find the longest offset.
+		pool.parallelFor(n, [&](size_t row, unsigned)
+						 {
+			float longest = 0.0f;
+			float *texel = out + row * n * 3;
+			for (size_t i = row * n; i < (row + 1) * n; ++i)
+			{
+				float h = z1r[i], dx = z1i[i], dz = z2r[i];
+				texel[0] = h;
+				texel[1] = dx;
+				texel[2] = dz;
+				texel += 3;
+				longest = std::max(longest, h * h + dx * dx + dz * dz);
+			}
+			rowMax[row] = longest; });
+
+		bound = sqrtf(*std::max_element(rowMax.begin(), rowMax.end()));
+		updateMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	int size() const { return params.size; }
+	// size * size RGB texels: height, x offset, z offset. Rows run along z.
+	const float *displacement() const { return rgb.data(); }
+	// Longest offset in the last update, for culling bounds.
+	float maxDisplacement() const { return bound; }
+	double lastUpdateMs() const { return updateMs; }
+};
+
+#endif
@@ -0,0 +1,540 @@
+#ifndef SURFACE_QUERY_HPP
+#define SURFACE_QUERY_HPP
+
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+#include "LoadBMP.hpp"
+#include "ThreadPool.hpp"
+#include "WaveField.hpp"
+
+// Exact height and normal of the rendered sea at arbitrary world x/z.
+//
+// The shaders move each grid point (u, v) sideways as well as up: first by
+// distext (height r, horizontal offsets g and b scaled by choppy), then by the
+// chained Gerstner waves. So the surface over (x, z) belongs to some other
+// (u, v), and the height there is not the wave function at (x, z). A query
+// solves P(u, v).xz = (x, z) with Newton's method, starting from u = x and
+// v = z. The chain carries the Jacobian of P along (gerstnerChain* in
+// WaveField.hpp), so each iteration is a single pass over the waves, and the
+// last pass also gives the tangents for the normal.
+//
+// The solvers keep 4 or 8 queries in registers for every iteration, using
+// the same kernel as the WaveField. A group stops once all of its queries
+// are within the tolerance, and after a fixed number of iterations in any
+// case; the queries still outside it then are counted.
+
+// Queries per pool task.
+#define SURFACE_QUERY_TASK 4096
+
+// Where query() writes, count floats each. Any of them may be null.
+struct SurfaceQueryOutput
+{
+	float *height = nullptr;
+	float *nx = nullptr, *ny = nullptr, *nz = nullptr; // unit normal
+	float *error = nullptr; // horizontal distance left between P(u, v) and the query
+};
+
+class SurfaceQuery
+{
+	const WaveField &field;
+	ThreadPool *pool;
+	std::vector<GerstnerTerm> terms;
+	float time;
+	// Largest horizontal move the waves and map can make. Newton steps are
+	// clamped to it, as near a steep crest the Jacobian can send them far off.
+	float maxShift;
+
+	// CPU copy of distext, sampled like the GL_LINEAR / GL_REPEAT texture at
+	// uv = (u + time * 0.001) / tileSize, as in vertex.glsl.
+	std::vector<float> map; // rows from the bottom up
+	int mapWidth, mapHeight, mapChannels; // 1 (height only) or 3 (RGB)
+	float mapTile, mapChoppy, mapShift;
+
+	int iterations;
+	float tolerance;
+	double lastMs;
+
+	// Bilinear sample of every channel of the map, and their derivatives in
+	// u and v.
+	void sampleMap(float u, float v, float *f, float *fu, float *fv) const
+	{
+		float drift = time * 0.001f;
+		float sx = (u + drift) / mapTile * mapWidth - 0.5f;
+		float sy = (v + drift) / mapTile * mapHeight - 0.5f;
+		float x0 = floorf(sx), y0 = floorf(sy);
+		float fx = sx - x0, fy = sy - y0;
+		int i0 = (int)x0 % mapWidth, j0 = (int)y0 % mapHeight;
+		i0 += i0 < 0 ? mapWidth : 0;
+		j0 += j0 < 0 ? mapHeight : 0;
+		int i1 = i0 + 1 == mapWidth ? 0 : i0 + 1;
+		int j1 = j0 + 1 == mapHeight ? 0 : j0 + 1;
+		const int n = mapChannels;
+		const float *r0 = &map[(size_t)n * j0 * mapWidth], *r1 = &map[(size_t)n * j1 * mapWidth];
+		for (int c = 0; c < n; ++c)
+		{
+			float f00 = r0[n * i0 + c], f10 = r0[n * i1 + c];
+			float f01 = r1[n * i0 + c], f11 = r1[n * i1 + c];
+			float bottom = f00 + fx * (f10 - f00), top = f01 + fx * (f11 - f01);
+			f[c] = bottom + fy * (top - bottom);
+			fu[c] = ((1.0f - fy) * (f10 - f00) + fy * (f11 - f01)) * (mapWidth / mapTile);
+			fv[c] = (top - bottom) * (mapHeight / mapTile);
+		}
+	}
+
+	// A map with g and b moves the grid sideways, so it takes part in the
+	// solve. A height-only one just adds to y, which no wave depends on, so
+	// it is sampled once at the solution (see addMapHeight()).
+	bool choppyMap() const { return mapChannels == 3 && !map.empty(); }
+
+	// Grid point (u, v) before the waves, with its derivatives.
+	void mapPoint(float u, float v, float *p) const
+	{
+		p[WD_X] = u;
+		p[WD_Y] = 0.0f;
+		p[WD_Z] = v;
+		p[WD_XU] = 1.0f;
+		p[WD_XV] = 0.0f;
+		p[WD_YU] = 0.0f;
+		p[WD_YV] = 0.0f;
+		p[WD_ZU] = 0.0f;
+		p[WD_ZV] = 1.0f;
+		if (!choppyMap())
+			return;
+		float f[3], fu[3], fv[3];
+		sampleMap(u, v, f, fu, fv);
+		p[WD_X] += mapChoppy * f[1];
+		p[WD_Y] = f[0];
+		p[WD_Z] += mapChoppy * f[2];
+		p[WD_XU] += mapChoppy * fu[1];
+		p[WD_XV] = mapChoppy * fv[1];
+		p[WD_YU] = fu[0];
+		p[WD_YV] = fv[0];
+		p[WD_ZU] = mapChoppy * fu[2];
+		p[WD_ZV] += mapChoppy * fv[2];
+	}
+
+	// Adds a height-only map to a solved point p of grid point (u, v).
+	void addMapHeight(float u, float v, float *p) const
+	{
+		if (map.empty() || choppyMap())
+			return;
+		float f, fu, fv;
+		sampleMap(u, v, &f, &fu, &fv);
+		p[WD_Y] += f;
+		p[WD_YU] += fu;
+		p[WD_YV] += fv;
+	}
+
+	size_t solveScalar(const float *qx, const float *qz, size_t begin, size_t end, const SurfaceQueryOutput &out) const
+	{
+		const float tol2 = tolerance * tolerance;
+		size_t misses = 0;
+		for (size_t i = begin; i < end; ++i)
+		{
+			float u = qx[i], v = qz[i], p[WD_COUNT], r2;
+			for (int it = 0;; ++it)
+			{
+				mapPoint(u, v, p);
+				gerstnerChainScalar(terms.data(), (int)terms.size(), p);
+				float ex = p[WD_X] - qx[i], ez = p[WD_Z] - qz[i];
+				r2 = ex * ex + ez * ez;
+				if (r2 <= tol2 || it + 1 >= iterations)
+					break;
+
+				// Newton step on the horizontal residual. Where the surface
+				// nearly folds over the Jacobian is close to singular, so take
+				// a plain fixed-point step there.
+				float det = p[WD_XU] * p[WD_ZV] - p[WD_XV] * p[WD_ZU];
+				float du = ex, dv = ez;
+				if (fabsf(det) > 1e-3f)
+				{
+					du = (p[WD_ZV] * ex - p[WD_XV] * ez) / det;
+					dv = (p[WD_XU] * ez - p[WD_ZU] * ex) / det;
+				}
+				float k = std::min(1.0f, maxShift / sqrtf(std::max(du * du + dv * dv, 1e-30f)));
+				u -= du * k;
+				v -= dv * k;
+			}
+			misses += r2 > tol2;
+			addMapHeight(u, v, p);
+
+			if (out.height)
+				out.height[i] = p[WD_Y];
+			if (out.error)
+				out.error[i] = sqrtf(r2);
+			if (out.nx || out.ny || out.nz)
+			{
+				// cross(dP/dv, dP/du), up for the flat plane
+				float nx = p[WD_YV] * p[WD_ZU] - p[WD_ZV] * p[WD_YU];
+				float ny = p[WD_ZV] * p[WD_XU] - p[WD_XV] * p[WD_ZU];
+				float nz = p[WD_XV] * p[WD_YU] - p[WD_YV] * p[WD_XU];
+				float inv = 1.0f / sqrtf(nx * nx + ny * ny + nz * nz);
+				if (out.nx)
+					out.nx[i] = nx * inv;
+				if (out.ny)
+					out.ny[i] = ny * inv;
+				if (out.nz)
+					out.nz[i] = nz * inv;
+			}
+		}
+		return misses;
+	}
+
+#ifdef WAVE_FIELD_X86
+
+	// solveScalar for 4 queries at a time.
+	size_t solveSSE(const float *qx, const float *qz, size_t begin, size_t end, const SurfaceQueryOutput &out) const
+	{
+		const __m128 tol2 = _mm_set1_ps(tolerance * tolerance);
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		const __m128 one = _mm_set1_ps(1.0f);
+		size_t misses = 0;
+		size_t i = begin;
+		for (; i + 4 <= end; i += 4)
+		{
+			__m128 x = _mm_loadu_ps(qx + i), z = _mm_loadu_ps(qz + i);
+			__m128 u = x, v = z, p[WD_COUNT], r2, miss;
+			for (int it = 0;; ++it)
+			{
+				if (!choppyMap())
+				{
+					p[WD_X] = u;
+					p[WD_Z] = v;
+					p[WD_Y] = p[WD_XV] = p[WD_YU] = p[WD_YV] = p[WD_ZU] = _mm_setzero_ps();
+					p[WD_XU] = p[WD_ZV] = one;
+				}
+				else
+				{
+					float lu[4], lv[4], lp[WD_COUNT][4], tmp[WD_COUNT];
+					_mm_storeu_ps(lu, u);
+					_mm_storeu_ps(lv, v);
+					for (int k = 0; k < 4; ++k)
+					{
+						mapPoint(lu[k], lv[k], tmp);
+						for (int c = 0; c < WD_COUNT; ++c)
+							lp[c][k] = tmp[c];
+					}
+					for (int c = 0; c < WD_COUNT; ++c)
+						p[c] = _mm_loadu_ps(lp[c]);
+				}
+				gerstnerChainSSE(terms.data(), (int)terms.size(), p);
+				__m128 ex = _mm_sub_ps(p[WD_X], x), ez = _mm_sub_ps(p[WD_Z], z);
+				r2 = _mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ez, ez));
+				miss = _mm_cmpgt_ps(r2, tol2);
+				if (!_mm_movemask_ps(miss) || it + 1 >= iterations)
+					break;
+
+				__m128 det = _mm_sub_ps(_mm_mul_ps(p[WD_XU], p[WD_ZV]), _mm_mul_ps(p[WD_XV], p[WD_ZU]));
+				__m128 ok = _mm_cmpgt_ps(_mm_and_ps(det, absMask), _mm_set1_ps(1e-3f));
+				__m128 inv = _mm_div_ps(one, det);
+				__m128 nu = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(p[WD_ZV], ex), _mm_mul_ps(p[WD_XV], ez)), inv);
+				__m128 nv = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(p[WD_XU], ez), _mm_mul_ps(p[WD_ZU], ex)), inv);
+				__m128 du = _mm_or_ps(_mm_and_ps(ok, nu), _mm_andnot_ps(ok, ex));
+				__m128 dv = _mm_or_ps(_mm_and_ps(ok, nv), _mm_andnot_ps(ok, ez));
+				__m128 len = _mm_sqrt_ps(_mm_max_ps(_mm_add_ps(_mm_mul_ps(du, du), _mm_mul_ps(dv, dv)), _mm_set1_ps(1e-30f)));
+				__m128 k = _mm_min_ps(one, _mm_div_ps(_mm_set1_ps(maxShift), len));
+				u = _mm_sub_ps(u, _mm_mul_ps(du, k));
+				v = _mm_sub_ps(v, _mm_mul_ps(dv, k));
+			}
+			misses += __builtin_popcount(_mm_movemask_ps(miss));
+			if (!map.empty() && !choppyMap())
+			{
+				float lu[4], lv[4], ly[3][4];
+				_mm_storeu_ps(lu, u);
+				_mm_storeu_ps(lv, v);
+				_mm_storeu_ps(ly[0], p[WD_Y]);
+				_mm_storeu_ps(ly[1], p[WD_YU]);
+				_mm_storeu_ps(ly[2], p[WD_YV]);
+				for (int k = 0; k < 4; ++k)
+				{
+					float f, fu, fv;
+					sampleMap(lu[k], lv[k], &f, &fu, &fv);
+					ly[0][k] += f;
+					ly[1][k] += fu;
+					ly[2][k] += fv;
+				}
+				p[WD_Y] = _mm_loadu_ps(ly[0]);
+				p[WD_YU] = _mm_loadu_ps(ly[1]);
+				p[WD_YV] = _mm_loadu_ps(ly[2]);
+			}
+
+			if (out.height)
+				_mm_storeu_ps(out.height + i, p[WD_Y]);
+			if (out.error)
+				_mm_storeu_ps(out.error + i, _mm_sqrt_ps(r2));
+			if (out.nx || out.ny || out.nz)
+			{
+				__m128 nx = _mm_sub_ps(_mm_mul_ps(p[WD_YV], p[WD_ZU]), _mm_mul_ps(p[WD_ZV], p[WD_YU]));
+				__m128 ny = _mm_sub_ps(_mm_mul_ps(p[WD_ZV], p[WD_XU]), _mm_mul_ps(p[WD_XV], p[WD_ZU]));
+				__m128 nz = _mm_sub_ps(_mm_mul_ps(p[WD_XV], p[WD_YU]), _mm_mul_ps(p[WD_YV], p[WD_XU]));
+				__m128 len2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+				__m128 inv = _mm_div_ps(one, _mm_sqrt_ps(len2));
+				if (out.nx)
+					_mm_storeu_ps(out.nx + i, _mm_mul_ps(nx, inv));
+				if (out.ny)
+					_mm_storeu_ps(out.ny + i, _mm_mul_ps(ny, inv));
+				if (out.nz)
+					_mm_storeu_ps(out.nz + i, _mm_mul_ps(nz, inv));
+			}
+		}
+		return misses + solveScalar(qx, qz, i, end, out);
+	}
+
+	// Same, 8 wide.
+	__attribute__((target("avx2,fma"))) size_t solveAVX2(const float *qx, const float *qz, size_t begin, size_t end,
+														 const SurfaceQueryOutput &out) const
+	{
+		const __m256 tol2 = _mm256_set1_ps(tolerance * tolerance);
+		const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+		const __m256 one = _mm256_set1_ps(1.0f);
+		size_t misses = 0;
+		size_t i = begin;
+		for (; i + 8 <= end; i += 8)
+		{
+			__m256 x = _mm256_loadu_ps(qx + i), z = _mm256_loadu_ps(qz + i);
+			__m256 u = x, v = z, p[WD_COUNT], r2, miss;
+			for (int it = 0;; ++it)
+			{
+				if (!choppyMap())
+				{
+					p[WD_X] = u;
+					p[WD_Z] = v;
+					p[WD_Y] = p[WD_XV] = p[WD_YU] = p[WD_YV] = p[WD_ZU] = _mm256_setzero_ps();
+					p[WD_XU] = p[WD_ZV] = one;
+				}
+				else
+				{
+					float lu[8], lv[8], lp[WD_COUNT][8], tmp[WD_COUNT];
+					_mm256_storeu_ps(lu, u);
+					_mm256_storeu_ps(lv, v);
+					for (int k = 0; k < 8; ++k)
+					{
+						mapPoint(lu[k], lv[k], tmp);
+						for (int c = 0; c < WD_COUNT; ++c)
+							lp[c][k] = tmp[c];
+					}
+					for (int c = 0; c < WD_COUNT; ++c)
+						p[c] = _mm256_loadu_ps(lp[c]);
+				}
+				gerstnerChainAVX2(terms.data(), (int)terms.size(), p);
+				__m256 ex = _mm256_sub_ps(p[WD_X], x), ez = _mm256_sub_ps(p[WD_Z], z);
+				r2 = _mm256_fmadd_ps(ex, ex, _mm256_mul_ps(ez, ez));
+				miss = _mm256_cmp_ps(r2, tol2, _CMP_GT_OQ);
+				if (!_mm256_movemask_ps(miss) || it + 1 >= iterations)
+					break;
+
+				__m256 det = _mm256_fmsub_ps(p[WD_XU], p[WD_ZV], _mm256_mul_ps(p[WD_XV], p[WD_ZU]));
+				__m256 ok = _mm256_cmp_ps(_mm256_and_ps(det, absMask), _mm256_set1_ps(1e-3f), _CMP_GT_OQ);
+				__m256 inv = _mm256_div_ps(one, det);
+				__m256 nu = _mm256_mul_ps(_mm256_fmsub_ps(p[WD_ZV], ex, _mm256_mul_ps(p[WD_XV], ez)), inv);
+				__m256 nv = _mm256_mul_ps(_mm256_fmsub_ps(p[WD_XU], ez, _mm256_mul_ps(p[WD_ZU], ex)), inv);
+				__m256 du = _mm256_blendv_ps(ex, nu, ok);
+				__m256 dv = _mm256_blendv_ps(ez, nv, ok);
+				__m256 len = _mm256_sqrt_ps(_mm256_max_ps(_mm256_fmadd_ps(du, du, _mm256_mul_ps(dv, dv)),
+														  _mm256_set1_ps(1e-30f)));
+				__m256 k = _mm256_min_ps(one, _mm256_div_ps(_mm256_set1_ps(maxShift), len));
+				u = _mm256_fnmadd_ps(du, k, u);
+				v = _mm256_fnmadd_ps(dv, k, v);
+			}
+			misses += __builtin_popcount(_mm256_movemask_ps(miss));
+			if (!map.empty() && !choppyMap())
+			{
+				float lu[8], lv[8], ly[3][8];
+				_mm256_storeu_ps(lu, u);
+				_mm256_storeu_ps(lv, v);
+				_mm256_storeu_ps(ly[0], p[WD_Y]);
+				_mm256_storeu_ps(ly[1], p[WD_YU]);
+				_mm256_storeu_ps(ly[2], p[WD_YV]);
+				for (int k = 0; k < 8; ++k)
+				{
+					float f, fu, fv;
+					sampleMap(lu[k], lv[k], &f, &fu, &fv);
+					ly[0][k] += f;
+					ly[1][k] += fu;
+					ly[2][k] += fv;
+				}
+				p[WD_Y] = _mm256_loadu_ps(ly[0]);
+				p[WD_YU] = _mm256_loadu_ps(ly[1]);
+				p[WD_YV] = _mm256_loadu_ps(ly[2]);
+			}
+
+			if (out.height)
+				_mm256_storeu_ps(out.height + i, p[WD_Y]);
+			if (out.error)
+				_mm256_storeu_ps(out.error + i, _mm256_sqrt_ps(r2));
+			if (out.nx || out.ny || out.nz)
+			{
+				__m256 nx = _mm256_fmsub_ps(p[WD_YV], p[WD_ZU], _mm256_mul_ps(p[WD_ZV], p[WD_YU]));
+				__m256 ny = _mm256_fmsub_ps(p[WD_ZV], p[WD_XU], _mm256_mul_ps(p[WD_XV], p[WD_ZU]));
+				__m256 nz = _mm256_fmsub_ps(p[WD_XV], p[WD_YU], _mm256_mul_ps(p[WD_YV], p[WD_XU]));
+				__m256 len2 = _mm256_fmadd_ps(nx, nx, _mm256_fmadd_ps(ny, ny, _mm256_mul_ps(nz, nz)));
+				__m256 inv = _mm256_div_ps(one, _mm256_sqrt_ps(len2));
+				if (out.nx)
+					_mm256_storeu_ps(out.nx + i, _mm256_mul_ps(nx, inv));
+				if (out.ny)
+					_mm256_storeu_ps(out.ny + i, _mm256_mul_ps(ny, inv));
+				if (out.nz)
+					_mm256_storeu_ps(out.nz + i, _mm256_mul_ps(nz, inv));
+			}
+		}
+		return misses + solveSSE(qx, qz, i, end, out);
+	}
+
+#endif
+
+	// Queries [begin, end) with the field's kernel.
+	size_t solve(const float *qx, const float *qz, size_t begin, size_t end, const SurfaceQueryOutput &out) const
+	{
+		switch (field.getKernel())
+		{
+#ifdef WAVE_FIELD_X86
+		case WaveField::KERNEL_AVX2:
+			return solveAVX2(qx, qz, begin, end, out);
+		case WaveField::KERNEL_SSE:
+			return solveSSE(qx, qz, begin, end, out);
+#endif
+		default:
+			return solveScalar(qx, qz, begin, end, out);
+		}
+	}
+
+public:
+	// Without a pool every query runs on the calling thread.
+	explicit SurfaceQuery(const WaveField &field, ThreadPool *pool = nullptr)
+		: field(field), pool(pool), time(0.0f), maxShift(0.0f), mapWidth(0), mapHeight(0), mapChannels(1), mapTile(1.0f),
+		  mapChoppy(0.0f), mapShift(0.0f), iterations(4), tolerance(1e-3f), lastMs(0.0)
+	{
+		setTime(0.0f);
+	}
+
+	// Folds the waves for time; call again when the field's waves change.
+	void setTime(float t)
+	{
+		time = t;
+		foldGerstnerTerms(field.getWaves(), time, terms);
+		maxShift = mapShift;
+		for (const GerstnerTerm &g : terms)
+			maxShift += sqrtf(g.ax * g.ax + g.az * g.az);
+		maxShift = std::max(maxShift, 0.01f);
+	}
+	float getTime() const { return time; }
+
+	// At most n passes over the waves per query (at least 1). Newton
+	// converges fast: with the default waves 2 get within 10 micrometres.
+	void setIterations(int n) { iterations = std::max(n, 1); }
+	int getIterations() const { return iterations; }
+	// Horizontal distance, in world units, a solution may be off by.
+	void setTolerance(float t) { tolerance = t; }
+	float getTolerance() const { return tolerance; }
+
+	// Takes a copy of a map given to PlaneMesh::setDisplacementMap(): size x
+	// size RGB floats covering tileSize x tileSize world units. choppy scales
+	// g and b like the material's choppy does (0 for a height-only map).
+	void setDisplacementMap(const float *rgb, int size, float tileSize, float choppy = 1.0f)
+	{
+		size_t texels = (size_t)size * size;
+		mapChannels = choppy != 0.0f ? 3 : 1;
+		map.resize(mapChannels * texels);
+		mapShift = 0.0f;
+		for (size_t i = 0; i < texels; ++i)
+		{
+			const float *t = rgb + 3 * i;
+			for (int c = 0; c < mapChannels; ++c)
+				map[mapChannels * i + c] = t[c];
+			if (mapChannels == 3)
+				mapShift = std::max(mapShift, fabsf(choppy) * sqrtf(t[1] * t[1] + t[2] * t[2]));
+		}
+		mapWidth = mapHeight = size;
+		mapTile = tileSize;
+		mapChoppy = choppy;
+		setTime(time);
+	}
+
+	// The BMP height map PlaneMesh starts with: grey levels in [0, 1] as
+	// heights over tileSize world units. False with a message on failure.
+	bool loadDisplacementMap(const char *bmpPath, float tileSize)
+	{
+		MappedBMP bmp;
+		if (!bmp.open(bmpPath))
+			return false;
+		const BMPImage &img = bmp.image();
+		bool grey = img.isGreyscale();
+		map.resize((size_t)img.width * img.height);
+		for (unsigned int y = 0; y < img.height; ++y)
+		{
+			// texture rows go up from the bottom, as stored unless topDown
+			const unsigned char *row = img.pixels + img.rowStride * (img.topDown ? img.height - 1 - y : y);
+			for (unsigned int x = 0; x < img.width; ++x)
+			{
+				unsigned char red;
+				if (img.bitsPerPixel == 8)
+					red = grey ? row[x] : img.palette[4 * row[x] + 2];
+				else
+					red = row[x * (img.bitsPerPixel / 8) + 2];
+				map[(size_t)y * img.width + x] = red / 255.0f;
+			}
+		}
+		mapWidth = img.width;
+		mapHeight = img.height;
+		mapChannels = 1;
+		mapTile = tileSize;
+		mapChoppy = 0.0f;
+		mapShift = 0.0f;
+		setTime(time);
+		return true;
+	}
+
+	// Back to the Gerstner waves alone.
+	void clearDisplacementMap()
+	{
+		map.clear();
+		mapChoppy = mapShift = 0.0f;
+		setTime(time);
+	}
+
+	// The surface over each of the count points (x[i], z[i]) at the time
+	// given to setTime(). Returns how many are outside the tolerance after
+	// the last iteration.
+	size_t query(const float *x, const float *z, size_t count, const SurfaceQueryOutput &out)
+	{
+		auto start = std::chrono::steady_clock::now();
+		size_t tasks = (count + SURFACE_QUERY_TASK - 1) / SURFACE_QUERY_TASK;
+		size_t misses = 0;
+		if (pool && tasks > 1)
+		{
+			std::atomic<size_t> total(0);
+			pool->parallelFor(tasks, [&](size_t t, unsigned)
+							  {
+								  size_t begin = t * SURFACE_QUERY_TASK;
+								  size_t m = solve(x, z, begin, std::min(count, begin + SURFACE_QUERY_TASK), out);
+								  if (m)
+									  total += m;
+							  });
+			misses = total;
+		}
+		else
+		{
+			misses = solve(x, z, 0, count, out);
+		}
+		lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return misses;
+	}
+
+	// Height of the surface over one point.
+	float heightAt(float x, float z) const
+	{
+		float h;
+		SurfaceQueryOutput out;
+		out.height = &h;
+		solve(&x, &z, 0, 1, out);
+		return h;
+	}
+
+	double getLastMs() const { return lastMs; }
+};
+
+#endif
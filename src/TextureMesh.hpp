@@ -0,0 +1,192 @@
+#ifndef TEXTURE_MESH_HPP
+#define TEXTURE_MESH_HPP
+
+#include <iostream>
+#include <vector>
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "shader.hpp"
+#include "GLState.hpp"
+#include "Profiler.hpp"
+#include "BMPTexture.hpp"
+#include "PlyLoader.hpp"
+#include "MeshCache.hpp"
+
+// Binding point of MeshData, after the water's blocks (see PlaneMesh.hpp).
+#define MESH_UBO_BINDING 4
+
+// Mirrors "uniform MeshData" in mesh_vertex.glsl / mesh_fragment.glsl (std140).
+struct MeshUniforms
+{
+	glm::mat4 MVP;
+	glm::mat4 model;
+	glm::vec3 lightPos;
+	float pad0;
+	glm::vec3 viewPos;
+	float pad1;
+};
+static_assert(sizeof(MeshUniforms) == 160, "MeshUniforms must match the std140 MeshData block");
+
+// The vertex and index buffers of a PLY mesh (x y z nx ny nz u v vertices)
+// as attributes 0, 1 and 2 of the bound vertex array. A fresh cooked copy of
+// the PLY (see MeshCache.hpp) is uploaded straight from its mapping;
+// otherwise the PLY is parsed and uploaded from client memory.
+struct MeshGeometry
+{
+	GLuint vbo, ebo;
+	GLsizei numIndices;
+	// model-space box around the vertices, for culling
+	glm::vec3 boundsMin, boundsMax;
+
+	MeshGeometry() : vbo(0), ebo(0), numIndices(0), boundsMin(0.0f), boundsMax(0.0f) {}
+
+	bool load(const char *plyPath)
+	{
+		CookedMesh cooked;
+		PlyMesh mesh;
+		const void *vertices, *indices;
+		size_t vertexBytes, indexCount;
+		if (cooked.open(cookedMeshPath(plyPath).c_str(), plyPath))
+		{
+			vertices = cooked.vertices();
+			vertexBytes = cooked.vertexBytes();
+			indices = cooked.indices();
+			indexCount = cooked.indexCount();
+			const float *lo = cooked.boundsMin(), *hi = cooked.boundsMax();
+			boundsMin = glm::vec3(lo[0], lo[1], lo[2]);
+			boundsMax = glm::vec3(hi[0], hi[1], hi[2]);
+		}
+		else
+		{
+			PlyReader reader;
+			if (!reader.open(plyPath))
+				return false;
+			if (!reader.hasNormals() || !reader.hasTexCoords())
+				std::cerr << plyPath << " has no normals or texture coordinates, they are left at 0" << std::endl;
+			if (!loadPly(plyPath, mesh))
+				return false;
+			mesh.bounds(&boundsMin[0], &boundsMax[0]);
+			vertices = mesh.vertices.data();
+			vertexBytes = mesh.vertices.size() * sizeof(float);
+			indices = mesh.indices.data();
+			indexCount = mesh.indices.size();
+		}
+
+		glGenBuffers(1, &vbo);
+		glBindBuffer(GL_ARRAY_BUFFER, vbo);
+		glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertices, GL_STATIC_DRAW);
+		GLsizei stride = PLY_VERTEX_FLOATS * sizeof(float);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void *)(6 * sizeof(float)));
+		glEnableVertexAttribArray(0);
+		glEnableVertexAttribArray(1);
+		glEnableVertexAttribArray(2);
+
+		glGenBuffers(1, &ebo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(uint32_t), indices, GL_STATIC_DRAW);
+		numIndices = (GLsizei)indexCount;
+		return true;
+	}
+
+	void release()
+	{
+		if (vbo)
+			glDeleteBuffers(1, &vbo);
+		if (ebo)
+			glDeleteBuffers(1, &ebo);
+		vbo = ebo = 0;
+		numIndices = 0;
+	}
+};
+
+// A textured, lit mesh from a PLY file and a BMP.
+class TextureMesh
+{
+	GLuint vao, textureID;
+	MeshGeometry geometry;
+	glm::mat4 model;
+	UniformBuffer meshUBO;
+
+	// One program for every mesh, built on first use.
+	static GLuint program()
+	{
+		static GLuint id = 0;
+		if (!id)
+		{
+			id = LoadShaders("shaders/mesh_vertex.glsl", "shaders/mesh_fragment.glsl");
+			bindUniformBlock(id, "MeshData", MESH_UBO_BINDING);
+			glState().useProgram(id);
+			glUniform1i(glGetUniformLocation(id, "meshTexture"), 0);
+		}
+		return id;
+	}
+
+public:
+	// scale is applied through the model matrix (see setTransform()).
+	TextureMesh(const char *plyPath, const char *bmpPath, float scale = 1.0f)
+		: vao(0), textureID(0)
+	{
+		model = glm::scale(glm::mat4(1.0f), glm::vec3(scale));
+		meshUBO.create(MESH_UBO_BINDING, sizeof(MeshUniforms));
+		glGenVertexArrays(1, &vao);
+		glState().bindVertexArray(vao);
+		if (!geometry.load(plyPath))
+			std::cerr << "Failed to load mesh: " << plyPath << std::endl;
+		textureID = loadTextureFromBMP(bmpPath);
+	}
+
+	~TextureMesh()
+	{
+		geometry.release();
+		if (vao)
+		{
+			glDeleteVertexArrays(1, &vao);
+			glState().forgetVertexArray(vao);
+		}
+		if (textureID)
+		{
+			glDeleteTextures(1, &textureID);
+			glState().forgetTexture(textureID);
+		}
+	}
+
+	TextureMesh(const TextureMesh &) = delete;
+	TextureMesh &operator=(const TextureMesh &) = delete;
+
+	bool isLoaded() const { return geometry.numIndices > 0; }
+	GLsizei numTriangles() const { return geometry.numIndices / 3; }
+	const MeshGeometry &getGeometry() const { return geometry; }
+
+	// Places the mesh in the world; uniform scales only (normals use it as is).
+	void setTransform(const glm::mat4 &m) { model = m; }
+	const glm::mat4 &getTransform() const { return model; }
+
+	void draw(glm::vec3 lightPos, glm::mat4 V, glm::mat4 P)
+	{
+		if (!isLoaded())
+			return;
+		PROFILE_CPU("mesh");
+		glState().useProgram(program());
+		glState().bindVertexArray(vao);
+		glState().bindTexture(0, GL_TEXTURE_2D, textureID);
+
+		MeshUniforms u;
+		u.MVP = P * V * model;
+		u.model = model;
+		u.lightPos = lightPos;
+		u.pad0 = 0.0f;
+		u.viewPos = glm::vec3(glm::inverse(V)[3]);
+		u.pad1 = 0.0f;
+		meshUBO.update(&u, sizeof(u));
+		meshUBO.bind();
+
+		glDrawElements(GL_TRIANGLES, geometry.numIndices, GL_UNSIGNED_INT, (void *)0);
+	}
+};
+
+#endif
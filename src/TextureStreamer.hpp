@@ -0,0 +1,279 @@
+#ifndef TEXTURE_STREAMER_HPP
+#define TEXTURE_STREAMER_HPP
+
+#include <string.h>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "GLState.hpp"
+
+// Streams whole-texture updates through a ring of pixel buffer slots so the
+// render thread never waits on the GPU or copies texels itself.
+//
+// A producer (any thread) takes a slot with acquire(), writes one full image
+// into it and hands it over with publish(). Once per frame the render thread
+// calls upload(), which issues glTexSubImage2D from the newest published slot
+// and puts a fence behind it; the slot only goes back to producers once that
+// fence has signalled, polled without waiting. A producer that runs ahead of
+// the GPU overwrites its own oldest unuploaded image instead of blocking, and
+// acquire() returns NULL only when every slot is in flight.
+//
+// With GL 4.4 / ARB_buffer_storage the slots are one persistently mapped,
+// coherent buffer and producers write straight into it. Without it, each slot
+// is CPU memory that upload() copies into an unsynchronised mapping of the
+// pixel buffer (the fence already guarantees the GPU is done with it).
+
+#define TEXTURE_STREAM_SLOTS 3
+
+class TextureStreamer
+{
+	enum SlotState
+	{
+		SLOT_FREE,
+		SLOT_WRITING,
+		SLOT_READY,
+		SLOT_IN_FLIGHT
+	};
+
+	struct Slot
+	{
+		SlotState state = SLOT_FREE;
+		unsigned long long sequence = 0; // publish order, newest is uploaded
+		GLsync fence = 0;
+		unsigned char *cpu = NULL;        // where producers write
+		std::vector<unsigned char> staging; // backs cpu without persistent mapping
+	};
+
+	GLuint texture, pbo;
+	GLenum format, type;
+	int width, height;
+	size_t slotBytes;
+	bool mipmaps, persistent;
+	unsigned char *mapped;
+
+	std::mutex lock;
+	Slot slots[TEXTURE_STREAM_SLOTS];
+	unsigned long long published;
+
+	// Render-thread stats.
+	size_t uploads, dropped;
+	double lastUploadMs, totalUploadMs;
+
+	// Returns in-flight slots whose upload the GPU has finished. Caller holds lock.
+	void retire()
+	{
+		for (Slot &s : slots)
+		{
+			if (s.state != SLOT_IN_FLIGHT)
+				continue;
+			GLenum status = glClientWaitSync(s.fence, 0, 0);
+			if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+			{
+				glDeleteSync(s.fence);
+				s.fence = 0;
+				s.state = SLOT_FREE;
+			}
+		}
+	}
+
+public:
+	// internalFormat/format/type as for glTexImage2D; bytesPerTexel must match
+	// format and type. The texture repeats and, with mipmaps, is trilinear.
+	TextureStreamer(GLenum internalFormat, int width, int height, GLenum format, GLenum type,
+					int bytesPerTexel, bool mipmaps = true)
+		: format(format), type(type), width(width), height(height),
+		  slotBytes((size_t)width * height * bytesPerTexel), mipmaps(mipmaps), mapped(NULL),
+		  published(0), uploads(0), dropped(0), lastUploadMs(0.0), totalUploadMs(0.0)
+	{
+		glGenTextures(1, &texture);
+		glState().bindTexture(0, GL_TEXTURE_2D, texture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, NULL);
+		if (mipmaps)
+			glGenerateMipmap(GL_TEXTURE_2D);
+
+		size_t total = slotBytes * TEXTURE_STREAM_SLOTS;
+		glGenBuffers(1, &pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		persistent = GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage;
+		if (persistent)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, total, NULL, flags);
+			mapped = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, total, flags);
+			persistent = mapped != NULL;
+		}
+		if (!persistent)
+			glBufferData(GL_PIXEL_UNPACK_BUFFER, total, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		for (int i = 0; i < TEXTURE_STREAM_SLOTS; ++i)
+		{
+			if (persistent)
+			{
+				slots[i].cpu = mapped + slotBytes * i;
+			}
+			else
+			{
+				slots[i].staging.assign(slotBytes, 0);
+				slots[i].cpu = slots[i].staging.data();
+			}
+		}
+	}
+
+	~TextureStreamer()
+	{
+		for (Slot &s : slots)
+			if (s.fence)
+				glDeleteSync(s.fence);
+		if (persistent)
+		{
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+		glDeleteBuffers(1, &pbo);
+		glDeleteTextures(1, &texture);
+		glState().forgetTexture(texture);
+	}
+
+	TextureStreamer(const TextureStreamer &) = delete;
+	TextureStreamer &operator=(const TextureStreamer &) = delete;
+
+	GLuint getTexture() const { return texture; }
+	int getWidth() const { return width; }
+	int getHeight() const { return height; }
+	size_t imageBytes() const { return slotBytes; }
+	bool isPersistent() const { return persistent; }
+
+	// Producer side, any thread. Returns imageBytes() of writable memory for
+	// one full image, rows bottom to top as glTexSubImage2D reads them, or
+	// NULL if every slot is still in flight. Each acquire() must be followed
+	// by publish() with the same pointer.
+	void *acquire()
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		Slot *pick = NULL;
+		for (Slot &s : slots)
+		{
+			if (s.state == SLOT_FREE)
+			{
+				pick = &s;
+				break;
+			}
+		}
+		// None free: reuse the oldest image nobody has uploaded yet.
+		if (!pick)
+		{
+			for (Slot &s : slots)
+				if (s.state == SLOT_READY && (!pick || s.sequence < pick->sequence))
+					pick = &s;
+			if (pick)
+				++dropped;
+		}
+		if (!pick)
+			return NULL;
+		pick->state = SLOT_WRITING;
+		return pick->cpu;
+	}
+
+	void publish(void *image)
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		for (Slot &s : slots)
+		{
+			if (s.cpu == image && s.state == SLOT_WRITING)
+			{
+				s.state = SLOT_READY;
+				s.sequence = ++published;
+				return;
+			}
+		}
+	}
+
+	// Render thread, once per frame before drawing with the texture. Uploads
+	// the newest published image if there is one; returns whether it did.
+	// Leaves the texture bound to unit 0.
+	bool upload()
+	{
+		auto start = std::chrono::steady_clock::now();
+		Slot *newest = NULL;
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			retire();
+			for (Slot &s : slots)
+			{
+				if (s.state != SLOT_READY)
+					continue;
+				if (newest && newest->sequence > s.sequence)
+				{
+					s.state = SLOT_FREE;
+					++dropped;
+				}
+				else
+				{
+					if (newest)
+					{
+						newest->state = SLOT_FREE;
+						++dropped;
+					}
+					newest = &s;
+				}
+			}
+			// Producers may not touch it until its fence is retired.
+			if (newest)
+				newest->state = SLOT_IN_FLIGHT;
+		}
+		if (!newest)
+		{
+			lastUploadMs = 0.0;
+			return false;
+		}
+
+		size_t offset = (size_t)(newest - slots) * slotBytes;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+		if (!persistent)
+		{
+			void *dst = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, slotBytes,
+										 GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			if (dst)
+			{
+				memcpy(dst, newest->cpu, slotBytes);
+				glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+			}
+		}
+		glState().bindTexture(0, GL_TEXTURE_2D, texture);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, (void *)offset);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		if (mipmaps)
+			glGenerateMipmap(GL_TEXTURE_2D);
+		GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			newest->fence = fence;
+		}
+
+		++uploads;
+		lastUploadMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		totalUploadMs += lastUploadMs;
+		return true;
+	}
+
+	// Render-thread time spent in the last upload() (0 if it had nothing to
+	// upload) and in all of them.
+	double getLastUploadMs() const { return lastUploadMs; }
+	double getTotalUploadMs() const { return totalUploadMs; }
+	size_t numUploads() const { return uploads; }
+	// Published images that were replaced before being uploaded.
+	size_t numDropped() const { return dropped; }
+};
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef THREAD_POOL_HPP
+#define THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Small work-stealing thread pool.
+//
+// Each worker owns a deque. parallelFor() deals its tasks out to the deques
+// in contiguous blocks, so neighbouring tasks (e.g. neighbouring tiles) tend
+// to run on the same thread. A worker pops from the back of its own deque and,
+// once that is empty, steals from the front of someone else's. The calling
+// thread helps out until its batch is done.
+class ThreadPool
+{
+public:
+	// fn(task, worker): worker is in [0, numWorkers()) and is unique among the
+	// threads running a batch, so it can index per-thread scratch memory.
+	typedef std::function<void(size_t, unsigned)> TaskFn;
+
+private:
+	struct Batch
+	{
+		const TaskFn *fn;
+		std::atomic<size_t> remaining;
+	};
+
+	struct Task
+	{
+		Batch *batch;
+		size_t index;
+	};
+
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::thread> threads;
+	std::vector<std::unique_ptr<Queue>> queues;
+
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::atomic<size_t> queued{0};
+	bool stopping = false;
+
+	// Only one parallelFor at a time, so the caller's worker slot is unique.
+	std::mutex callerLock;
+
+	bool popOwn(unsigned q, Task &out)
+	{
+		Queue &queue = *queues[q];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if (queue.tasks.empty())
+			return false;
+		out = queue.tasks.back();
+		queue.tasks.pop_back();
+		return true;
+	}
+
+	bool steal(unsigned thief, Task &out)
+	{
+		unsigned n = (unsigned)queues.size();
+		for (unsigned k = 1; k <= n; ++k)
+		{
+			Queue &queue = *queues[(thief + k) % n];
+			std::lock_guard<std::mutex> guard(queue.lock);
+			if (!queue.tasks.empty())
+			{
+				out = queue.tasks.front();
+				queue.tasks.pop_front();
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool next(unsigned worker, Task &out)
+	{
+		if (popOwn(worker % queues.size(), out) || steal(worker, out))
+		{
+			queued.fetch_sub(1);
+			return true;
+		}
+		return false;
+	}
+
+	static void run(const Task &task, unsigned worker)
+	{
+		(*task.batch->fn)(task.index, worker);
+		task.batch->remaining.fetch_sub(1, std::memory_order_release);
+	}
+
+	void workerLoop(unsigned worker)
+	{
+		Task task;
+		for (;;)
+		{
+			if (next(worker, task))
+			{
+				run(task, worker);
+				continue;
+			}
+			std::unique_lock<std::mutex> guard(sleepLock);
+			wake.wait(guard, [this]
+					  { return stopping || queued.load() > 0; });
+			if (stopping)
+				return;
+		}
+	}
+
+public:
+	// numThreads counts the calling thread; 0 means one per hardware thread.
+	explicit ThreadPool(unsigned numThreads = 0)
+	{
+		if (numThreads == 0)
+			numThreads = std::thread::hardware_concurrency();
+		if (numThreads == 0)
+			numThreads = 1;
+
+		for (unsigned i = 0; i < numThreads; ++i)
+			queues.emplace_back(new Queue());
+		for (unsigned i = 0; i + 1 < numThreads; ++i)
+			threads.emplace_back(&ThreadPool::workerLoop, this, i);
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread &t : threads)
+			t.join();
+	}
+
+	ThreadPool(const ThreadPool &) = delete;
+	ThreadPool &operator=(const ThreadPool &) = delete;
+
+	// Worker slots, including the calling thread.
+	unsigned numWorkers() const { return (unsigned)queues.size(); }
+
+	// Runs fn(i, worker) for every i in [0, count) and returns once all are done.
+	void parallelFor(size_t count, const TaskFn &fn)
+	{
+		if (count == 0)
+			return;
+
+		std::lock_guard<std::mutex> caller(callerLock);
+		unsigned self = numWorkers() - 1;
+		if (threads.empty())
+		{
+			for (size_t i = 0; i < count; ++i)
+				fn(i, self);
+			return;
+		}
+
+		Batch batch;
+		batch.fn = &fn;
+		batch.remaining.store(count);
+
+		// Contiguous blocks per queue; pushed in reverse so each owner pops
+		// its block front to back.
+		unsigned n = numWorkers();
+		for (unsigned q = 0; q < n; ++q)
+		{
+			size_t begin = count * q / n;
+			size_t end = count * (q + 1) / n;
+			std::lock_guard<std::mutex> guard(queues[q]->lock);
+			for (size_t i = end; i > begin; --i)
+				queues[q]->tasks.push_back(Task{&batch, i - 1});
+		}
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+			queued.fetch_add(count);
+		}
+		wake.notify_all();
+
+		Task task;
+		while (batch.remaining.load(std::memory_order_acquire) > 0)
+		{
+			if (next(self, task))
+				run(task, self);
+			else
+				std::this_thread::yield();
+		}
+	}
+};
+
+#endif
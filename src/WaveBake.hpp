@@ -0,0 +1,261 @@
+#ifndef WAVE_BAKE_HPP
+#define WAVE_BAKE_HPP
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <GL/glew.h>
+
+#include "GLState.hpp"
+#include "ThreadPool.hpp"
+#include "WaveField.hpp"
+
+// One loop of the Gerstner waves baked into a 3D texture, for
+// PIPELINE_TESS_BAKED: tess_eval_baked.glsl samples it instead of running
+// sin/cos for every wave, which pays off where the GPU is short on ALU.
+//
+// Texel (i, j, f) holds the displacement (x, y, z) of the point
+// ((i + 0.5) L / size, 0, (j + 0.5) L / size) at time (f + 0.5) T / frames,
+// for a tile of L world units and a loop of T seconds. All three axes repeat
+// and are filtered linearly, so the shader gets the animation between frames
+// for free. Normals come from central differences of the bake, as the tess
+// eval shader already does for distext.
+//
+// A repeating bake needs waves that repeat too, so the waves are "looped"
+// first (see loopGerstnerWaves()): every wave vector is moved to the nearest
+// multiple of 2 pi / L and every phase speed to the nearest multiple of
+// 2 pi / T. The looped waves should then be used everywhere (the wave
+// uniforms, buoyancy) so the sea stays consistent.
+
+#define WAVE_BAKE_PI 3.14159265358979f
+
+struct WaveBakeSettings
+{
+	int size = 256;             // texels per side of the tile
+	int frames = 96;            // slices over one loop
+	float tileSize = 50.0f;     // world units before the bake repeats
+	float period = 0.0f;        // loop in seconds; 0 picks one (see chooseLoopPeriod())
+	bool halfFloat = true;      // GL_RGBA16F, else GL_RGBA32F
+	size_t budgetBytes = 64u << 20; // GPU memory the bake may take
+	int minFramesPerCycle = 8;  // slices per period of the fastest wave
+};
+
+static float snapToMultiple(float value, float step, bool keepNonZero)
+{
+	float n = roundf(value / step);
+	if (n == 0.0f && keepNonZero && value != 0.0f)
+		n = value > 0.0f ? 1.0f : -1.0f;
+	return n * step;
+}
+
+// Largest relative change looping makes to any wave's phase speed.
+static float loopTimeError(const std::vector<GerstnerWave> &waves, float period)
+{
+	float step = 2.0f * WAVE_BAKE_PI / period, error = 0.0f;
+	for (const GerstnerWave &g : waves)
+		if (g.phi != 0.0f)
+			error = std::max(error, fabsf(snapToMultiple(g.phi, step, true) - g.phi) / fabsf(g.phi));
+	return error;
+}
+
+// Loop length for frames slices that still gives the fastest wave
+// minFramesPerCycle slices per period: of the periods that some wave already
+// repeats over, the one changing the others' speeds the least.
+float chooseLoopPeriod(const std::vector<GerstnerWave> &waves, int frames, int minFramesPerCycle)
+{
+	float phiMax = 0.0f;
+	for (const GerstnerWave &g : waves)
+		phiMax = std::max(phiMax, fabsf(g.phi));
+	if (phiMax == 0.0f)
+		return 1.0f; // nothing moves
+	float longest = frames * 2.0f * WAVE_BAKE_PI / (minFramesPerCycle * phiMax);
+	float best = longest, bestError = loopTimeError(waves, longest);
+	for (const GerstnerWave &g : waves)
+	{
+		if (g.phi == 0.0f)
+			continue;
+		for (int m = 1;; ++m)
+		{
+			float period = m * 2.0f * WAVE_BAKE_PI / fabsf(g.phi);
+			if (period > longest)
+				break;
+			float error = loopTimeError(waves, period);
+			if (error < bestError)
+			{
+				best = period;
+				bestError = error;
+			}
+		}
+	}
+	return best;
+}
+
+// waves moved onto a tileSize x tileSize tile. Wave vectors keep their
+// frequency w (which also sets the sharpness) and change direction instead;
+// a wave longer than the tile snaps to 0 and stands still.
+std::vector<GerstnerWave> tileGerstnerWaves(const std::vector<GerstnerWave> &waves, float tileSize)
+{
+	float kStep = 2.0f * WAVE_BAKE_PI / tileSize;
+	std::vector<GerstnerWave> tiled = waves;
+	for (GerstnerWave &g : tiled)
+	{
+		if (g.w == 0.0f)
+			continue;
+		g.Dx = snapToMultiple(g.w * g.Dx, kStep, false) / g.w;
+		g.Dz = snapToMultiple(g.w * g.Dz, kStep, false) / g.w;
+	}
+	return tiled;
+}
+
+// waves tiled as above and also moved onto a period-second loop. A phase
+// speed never snaps to 0.
+std::vector<GerstnerWave> loopGerstnerWaves(const std::vector<GerstnerWave> &waves, float tileSize, float period)
+{
+	float phiStep = 2.0f * WAVE_BAKE_PI / period;
+	std::vector<GerstnerWave> looped = tileGerstnerWaves(waves, tileSize);
+	for (GerstnerWave &g : looped)
+		g.phi = snapToMultiple(g.phi, phiStep, true);
+	return looped;
+}
+
+// Largest relative change looping made to a wave vector.
+float loopSpaceError(const std::vector<GerstnerWave> &waves, const std::vector<GerstnerWave> &looped)
+{
+	float error = 0.0f;
+	for (size_t i = 0; i < waves.size() && i < looped.size(); ++i)
+	{
+		const GerstnerWave &a = waves[i], &b = looped[i];
+		float k = a.w * sqrtf(a.Dx * a.Dx + a.Dz * a.Dz);
+		if (k > 0.0f)
+			error = std::max(error, a.w * sqrtf((a.Dx - b.Dx) * (a.Dx - b.Dx) + (a.Dz - b.Dz) * (a.Dz - b.Dz)) / k);
+	}
+	return error;
+}
+
+class WaveBake
+{
+	WaveBakeSettings settings; // as baked, after the budget
+	std::vector<GerstnerWave> waves;
+	float timeError, spaceError;
+	GLuint texture;
+	double bakeMs;
+
+	void release()
+	{
+		if (texture)
+		{
+			glDeleteTextures(1, &texture);
+			glState().forgetTexture(texture);
+			texture = 0;
+		}
+	}
+
+	size_t bytesFor(int size, int frames) const
+	{
+		return (size_t)size * size * frames * (settings.halfFloat ? 8 : 16);
+	}
+
+public:
+	WaveBake() : timeError(0.0f), spaceError(0.0f), texture(0), bakeMs(0.0) {}
+	~WaveBake() { release(); }
+
+	WaveBake(const WaveBake &) = delete;
+	WaveBake &operator=(const WaveBake &) = delete;
+
+	// Loops source and bakes it. Over budget, the frame count comes down
+	// to 32 first, then the size halves. Spreads the work over pool if given.
+	// False with a message if even the smallest bake won't fit.
+	bool bake(const std::vector<GerstnerWave> &source, const WaveBakeSettings &requested, ThreadPool *pool = nullptr)
+	{
+		auto start = std::chrono::steady_clock::now();
+		settings = requested;
+		while (bytesFor(settings.size, settings.frames) > settings.budgetBytes)
+		{
+			if (settings.frames > 32)
+				settings.frames = std::max(32, settings.frames / 2);
+			else if (settings.size > 32)
+				settings.size /= 2;
+			else
+			{
+				fprintf(stderr, "A wave bake doesn't fit in %zu bytes\n", settings.budgetBytes);
+				return false;
+			}
+		}
+		if (settings.size != requested.size || settings.frames != requested.frames)
+			fprintf(stderr, "Wave bake cut to %d x %d x %d to stay within %zu MB\n", settings.size, settings.size,
+					settings.frames, settings.budgetBytes >> 20);
+		if (settings.period <= 0.0f)
+			settings.period = chooseLoopPeriod(source, settings.frames, settings.minFramesPerCycle);
+		waves = loopGerstnerWaves(source, settings.tileSize, settings.period);
+		timeError = loopTimeError(source, settings.period);
+		spaceError = loopSpaceError(source, waves);
+
+		release();
+		glGenTextures(1, &texture);
+		glState().bindTexture(0, GL_TEXTURE_3D, texture);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		const int n = settings.size;
+		glTexImage3D(GL_TEXTURE_3D, 0, settings.halfFloat ? GL_RGBA16F : GL_RGBA32F, n, n, settings.frames, 0,
+					 GL_RGBA, GL_FLOAT, NULL);
+
+		// One slice at a time: the grid in SoA, displaced on the pool by
+		// rows, then interleaved for the upload (the driver converts to fp16).
+		WaveField field(waves);
+		std::vector<GerstnerTerm> terms;
+		std::vector<float> x((size_t)n * n), y((size_t)n * n), z((size_t)n * n), slice(4 * (size_t)n * n);
+		float texel = settings.tileSize / n;
+		for (int f = 0; f < settings.frames; ++f)
+		{
+			foldGerstnerTerms(waves, (f + 0.5f) * settings.period / settings.frames, terms);
+			auto row = [&](size_t j, unsigned)
+			{
+				size_t begin = j * n;
+				for (int i = 0; i < n; ++i)
+				{
+					x[begin + i] = (i + 0.5f) * texel;
+					y[begin + i] = 0.0f;
+					z[begin + i] = (j + 0.5f) * texel;
+				}
+				field.displace(terms, x.data(), y.data(), z.data(), begin, begin + n);
+				for (int i = 0; i < n; ++i)
+				{
+					float *t = &slice[4 * (begin + i)];
+					t[0] = x[begin + i] - (i + 0.5f) * texel;
+					t[1] = y[begin + i];
+					t[2] = z[begin + i] - (j + 0.5f) * texel;
+					t[3] = 0.0f;
+				}
+			};
+			if (pool)
+				pool->parallelFor(n, row);
+			else
+				for (int j = 0; j < n; ++j)
+					row(j, 0);
+			glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, f, n, n, 1, GL_RGBA, GL_FLOAT, slice.data());
+		}
+		bakeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return true;
+	}
+
+	bool isBaked() const { return texture != 0; }
+	GLuint getTexture() const { return texture; }
+	const WaveBakeSettings &getSettings() const { return settings; }
+	float getTileSize() const { return settings.tileSize; }
+	float getPeriod() const { return settings.period; }
+	// The looped waves the bake holds.
+	const std::vector<GerstnerWave> &getWaves() const { return waves; }
+	// Largest relative change looping made to a phase speed / wave vector.
+	float getTimeError() const { return timeError; }
+	float getSpaceError() const { return spaceError; }
+	size_t getBytes() const { return texture ? bytesFor(settings.size, settings.frames) : 0; }
+	double getBakeMs() const { return bakeMs; }
+};
+
+#endif
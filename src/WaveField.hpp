@@ -0,0 +1,484 @@
+#ifndef WAVE_FIELD_HPP
+#define WAVE_FIELD_HPP
+
+#include <stdio.h>
+#include <string.h>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define WAVE_FIELD_X86 1
+#include <immintrin.h>
+#endif
+
+// CPU evaluation of the Gerstner wave superposition done per vertex in
+// shaders/geo.glsl, so gameplay code can ask where the surface is. The same
+// wave table is uploaded to the shaders (see WaveUniforms in PlaneMesh.hpp).
+
+// One Gerstner wave, with the same parameters as Gerstner() in geo.glsl.
+struct GerstnerWave
+{
+	float w;      // frequency
+	float A;      // amplitude
+	float phi;    // phase multiplier (scales time)
+	float Q;      // sharpness, between 0 and 1
+	float Dx, Dz; // direction
+	int N;        // exponent controlling the influence of Q
+};
+
+// The four waves geo.glsl was written with (also assets/seastate.txt).
+std::vector<GerstnerWave> defaultGerstnerWaves()
+{
+	return {
+		{4.0f, 0.08f, 1.1f, 0.75f, 0.3f, 0.6f, 4},
+		{2.0f, 0.05f, 1.1f, 0.75f, 0.2f, 0.866f, 4},
+		{0.6f, 0.2f, 0.4f, 0.1f, 0.3f, 0.7f, 4},
+		{0.9f, 0.15f, 0.4f, 0.1f, 0.8f, 0.1f, 4},
+	};
+}
+
+// Reads a sea state: one wave per line as "w A phi Q Dx Dz N", with '#'
+// starting a comment. Returns false (leaving waves alone) if the file can't
+// be read or has no waves.
+bool loadSeaState(const char *path, std::vector<GerstnerWave> &waves)
+{
+	FILE *file = fopen(path, "r");
+	if (!file)
+	{
+		fprintf(stderr, "%s could not be opened\n", path);
+		return false;
+	}
+
+	std::vector<GerstnerWave> loaded;
+	char line[256];
+	int lineNumber = 0;
+	while (fgets(line, sizeof(line), file))
+	{
+		++lineNumber;
+		char *hash = strchr(line, '#');
+		if (hash)
+			*hash = '\0';
+
+		GerstnerWave g;
+		int n = sscanf(line, "%f %f %f %f %f %f %d", &g.w, &g.A, &g.phi, &g.Q, &g.Dx, &g.Dz, &g.N);
+		if (n == 7)
+			loaded.push_back(g);
+		else if (n > 0)
+			fprintf(stderr, "%s:%d: expected \"w A phi Q Dx Dz N\"\n", path, lineNumber);
+	}
+	fclose(file);
+
+	if (loaded.empty())
+	{
+		fprintf(stderr, "%s has no waves\n", path);
+		return false;
+	}
+	waves = loaded;
+	return true;
+}
+
+// A plausible wind sea of count waves, for trying out larger wave sets:
+// frequencies spread geometrically from long swell to short chop, directions
+// within about 60 degrees of the wind, deep-water phase speeds and constant
+// steepness split between the waves so the surface never folds over.
+std::vector<GerstnerWave> generateSeaState(int count, uint32_t seed = 1)
+{
+	std::vector<GerstnerWave> waves;
+	uint32_t state = seed ? seed : 1;
+	auto random = [&state]()
+	{
+		// xorshift32, in [0, 1)
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return (state >> 8) * (1.0f / 16777216.0f);
+	};
+
+	const float wMin = 0.5f, wMax = 6.0f;
+	const float windAngle = 0.6f;
+	for (int i = 0; i < count; ++i)
+	{
+		float f = count > 1 ? (float)i / (count - 1) : 0.0f;
+		GerstnerWave g;
+		g.w = wMin * std::pow(wMax / wMin, f);
+		g.A = 0.3f / (g.w * std::sqrt((float)count));
+		g.phi = 0.35f * std::sqrt(9.8f * g.w);
+		g.Q = 0.6f + 0.3f * random();
+		float angle = windAngle + (random() * 2.0f - 1.0f);
+		g.Dx = std::cos(angle);
+		g.Dz = std::sin(angle);
+		g.N = 1;
+		waves.push_back(g);
+	}
+	return waves;
+}
+
+// Straight port of Gerstner() and the loop in geo.glsl's main(), one point at
+// a time. Each wave sees the position already displaced by the previous ones.
+void gerstnerReference(const std::vector<GerstnerWave> &waves, float time, float &x, float &y, float &z)
+{
+	for (const GerstnerWave &g : waves)
+	{
+		float Qi = g.w * g.A * std::pow(g.Q, (float)g.N);
+		float phase = g.w * (g.Dx * x + g.Dz * z) + g.phi * time;
+		float c = std::cos(phase);
+		float dx = g.Dx * g.A * c * Qi;
+		float dz = g.Dz * g.A * c * Qi;
+		float dy = g.A * std::sin(phase);
+		x += dx;
+		y += dy;
+		z += dz;
+	}
+}
+
+// A wave with everything that doesn't depend on position folded in, for one
+// point in time: phase = kx*x + kz*z + phase0, and the displacement is
+// (ax*cos, A*sin, az*cos).
+struct GerstnerTerm
+{
+	float kx, kz, phase0;
+	float A, ax, az;
+};
+
+static void foldGerstnerTerms(const std::vector<GerstnerWave> &waves, float time, std::vector<GerstnerTerm> &terms)
+{
+	terms.resize(waves.size());
+	for (size_t i = 0; i < waves.size(); ++i)
+	{
+		const GerstnerWave &g = waves[i];
+		float Qi = g.w * g.A * std::pow(g.Q, (float)g.N);
+		terms[i].kx = g.w * g.Dx;
+		terms[i].kz = g.w * g.Dz;
+		terms[i].phase0 = g.phi * time;
+		terms[i].A = g.A;
+		terms[i].ax = g.Dx * g.A * Qi;
+		terms[i].az = g.Dz * g.A * Qi;
+	}
+}
+
+static void gerstnerDisplaceScalar(const GerstnerTerm *terms, int numTerms,
+								   float *x, float *y, float *z, size_t begin, size_t end)
+{
+	for (size_t i = begin; i < end; ++i)
+	{
+		float px = x[i], py = y[i], pz = z[i];
+		for (int t = 0; t < numTerms; ++t)
+		{
+			const GerstnerTerm &g = terms[t];
+			float phase = g.kx * px + g.kz * pz + g.phase0;
+			float c = std::cos(phase);
+			px += g.ax * c;
+			py += g.A * std::sin(phase);
+			pz += g.az * c;
+		}
+		x[i] = px;
+		y[i] = py;
+		z[i] = pz;
+	}
+}
+
+// The values the *Chain functions below carry for each point: its position
+// and the derivatives of the position with respect to the undisplaced (u, v)
+// it started from. Newton solves and analytic normals need the derivatives
+// (see SurfaceQuery.hpp).
+enum WaveDerivative
+{
+	WD_X, WD_Y, WD_Z,
+	WD_XU, WD_XV, WD_YU, WD_YV, WD_ZU, WD_ZV,
+	WD_COUNT
+};
+
+// Runs one point through the chain of waves like gerstnerDisplaceScalar,
+// carrying the derivatives along: each wave's phase moves with the already
+// displaced x and z. p holds WD_COUNT values.
+static inline void gerstnerChainScalar(const GerstnerTerm *terms, int numTerms, float *p)
+{
+	for (int t = 0; t < numTerms; ++t)
+	{
+		const GerstnerTerm &g = terms[t];
+		float phase = g.kx * p[WD_X] + g.kz * p[WD_Z] + g.phase0;
+		float du = g.kx * p[WD_XU] + g.kz * p[WD_ZU];
+		float dv = g.kx * p[WD_XV] + g.kz * p[WD_ZV];
+		float s = std::sin(phase), c = std::cos(phase);
+		p[WD_X] += g.ax * c;
+		p[WD_Y] += g.A * s;
+		p[WD_Z] += g.az * c;
+		float axs = g.ax * s, azs = g.az * s, ac = g.A * c;
+		p[WD_XU] -= axs * du;
+		p[WD_XV] -= axs * dv;
+		p[WD_YU] += ac * du;
+		p[WD_YV] += ac * dv;
+		p[WD_ZU] -= azs * du;
+		p[WD_ZV] -= azs * dv;
+	}
+}
+
+#ifdef WAVE_FIELD_X86
+
+// sincos for 4 floats: Cody-Waite reduction by pi/4 and the minimax
+// polynomials from Cephes sinf/cosf. Max error is a few ulp for |x| < 8192.
+static inline void sincosSSE(__m128 x, __m128 *s, __m128 *c)
+{
+	const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32((int)0x80000000));
+	__m128 sinSign = _mm_and_ps(x, signMask);
+	x = _mm_andnot_ps(signMask, x);
+
+	// octant, rounded up to even
+	__m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.27323954473516f)));
+	j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+	__m128 fj = _mm_cvtepi32_ps(j);
+
+	__m128 swapSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29));
+	__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(
+		_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+	sinSign = _mm_xor_ps(sinSign, swapSign);
+	__m128 polyMask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+
+	x = _mm_sub_ps(x, _mm_mul_ps(fj, _mm_set1_ps(0.78515625f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(fj, _mm_set1_ps(2.4187564849853515625e-4f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(fj, _mm_set1_ps(3.77489497744594108e-8f)));
+	__m128 z = _mm_mul_ps(x, x);
+
+	__m128 yc = _mm_set1_ps(2.443315711809948e-5f);
+	yc = _mm_add_ps(_mm_mul_ps(yc, z), _mm_set1_ps(-1.388731625493765e-3f));
+	yc = _mm_add_ps(_mm_mul_ps(yc, z), _mm_set1_ps(4.166664568298827e-2f));
+	yc = _mm_mul_ps(_mm_mul_ps(yc, z), z);
+	yc = _mm_sub_ps(yc, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+	yc = _mm_add_ps(yc, _mm_set1_ps(1.0f));
+
+	__m128 ys = _mm_set1_ps(-1.9515295891e-4f);
+	ys = _mm_add_ps(_mm_mul_ps(ys, z), _mm_set1_ps(8.3321608736e-3f));
+	ys = _mm_add_ps(_mm_mul_ps(ys, z), _mm_set1_ps(-1.6666654611e-1f));
+	ys = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(ys, z), x), x);
+
+	__m128 sinv = _mm_or_ps(_mm_and_ps(polyMask, ys), _mm_andnot_ps(polyMask, yc));
+	__m128 cosv = _mm_or_ps(_mm_and_ps(polyMask, yc), _mm_andnot_ps(polyMask, ys));
+	*s = _mm_xor_ps(sinv, sinSign);
+	*c = _mm_xor_ps(cosv, cosSign);
+}
+
+static void gerstnerDisplaceSSE(const GerstnerTerm *terms, int numTerms,
+								float *x, float *y, float *z, size_t begin, size_t end)
+{
+	size_t i = begin;
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128 px = _mm_loadu_ps(x + i);
+		__m128 py = _mm_loadu_ps(y + i);
+		__m128 pz = _mm_loadu_ps(z + i);
+		for (int t = 0; t < numTerms; ++t)
+		{
+			const GerstnerTerm &g = terms[t];
+			__m128 phase = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(g.kx), px),
+												 _mm_mul_ps(_mm_set1_ps(g.kz), pz)),
+									  _mm_set1_ps(g.phase0));
+			__m128 s, c;
+			sincosSSE(phase, &s, &c);
+			px = _mm_add_ps(px, _mm_mul_ps(_mm_set1_ps(g.ax), c));
+			py = _mm_add_ps(py, _mm_mul_ps(_mm_set1_ps(g.A), s));
+			pz = _mm_add_ps(pz, _mm_mul_ps(_mm_set1_ps(g.az), c));
+		}
+		_mm_storeu_ps(x + i, px);
+		_mm_storeu_ps(y + i, py);
+		_mm_storeu_ps(z + i, pz);
+	}
+	gerstnerDisplaceScalar(terms, numTerms, x, y, z, i, end);
+}
+
+// gerstnerChainScalar for 4 points.
+static inline void gerstnerChainSSE(const GerstnerTerm *terms, int numTerms, __m128 *p)
+{
+	for (int t = 0; t < numTerms; ++t)
+	{
+		const GerstnerTerm &g = terms[t];
+		__m128 kx = _mm_set1_ps(g.kx), kz = _mm_set1_ps(g.kz);
+		__m128 phase = _mm_add_ps(_mm_add_ps(_mm_mul_ps(kx, p[WD_X]), _mm_mul_ps(kz, p[WD_Z])), _mm_set1_ps(g.phase0));
+		__m128 du = _mm_add_ps(_mm_mul_ps(kx, p[WD_XU]), _mm_mul_ps(kz, p[WD_ZU]));
+		__m128 dv = _mm_add_ps(_mm_mul_ps(kx, p[WD_XV]), _mm_mul_ps(kz, p[WD_ZV]));
+		__m128 s, c;
+		sincosSSE(phase, &s, &c);
+		__m128 ax = _mm_set1_ps(g.ax), az = _mm_set1_ps(g.az), A = _mm_set1_ps(g.A);
+		p[WD_X] = _mm_add_ps(p[WD_X], _mm_mul_ps(ax, c));
+		p[WD_Y] = _mm_add_ps(p[WD_Y], _mm_mul_ps(A, s));
+		p[WD_Z] = _mm_add_ps(p[WD_Z], _mm_mul_ps(az, c));
+		__m128 axs = _mm_mul_ps(ax, s), azs = _mm_mul_ps(az, s), ac = _mm_mul_ps(A, c);
+		p[WD_XU] = _mm_sub_ps(p[WD_XU], _mm_mul_ps(axs, du));
+		p[WD_XV] = _mm_sub_ps(p[WD_XV], _mm_mul_ps(axs, dv));
+		p[WD_YU] = _mm_add_ps(p[WD_YU], _mm_mul_ps(ac, du));
+		p[WD_YV] = _mm_add_ps(p[WD_YV], _mm_mul_ps(ac, dv));
+		p[WD_ZU] = _mm_sub_ps(p[WD_ZU], _mm_mul_ps(azs, du));
+		p[WD_ZV] = _mm_sub_ps(p[WD_ZV], _mm_mul_ps(azs, dv));
+	}
+}
+
+// Same as sincosSSE, 8 wide.
+__attribute__((target("avx2,fma"))) static inline void sincosAVX2(__m256 x, __m256 *s, __m256 *c)
+{
+	const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32((int)0x80000000));
+	__m256 sinSign = _mm256_and_ps(x, signMask);
+	x = _mm256_andnot_ps(signMask, x);
+
+	__m256i j = _mm256_cvttps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(1.27323954473516f)));
+	j = _mm256_and_si256(_mm256_add_epi32(j, _mm256_set1_epi32(1)), _mm256_set1_epi32(~1));
+	__m256 fj = _mm256_cvtepi32_ps(j);
+
+	__m256 swapSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(j, _mm256_set1_epi32(4)), 29));
+	__m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(
+		_mm256_andnot_si256(_mm256_sub_epi32(j, _mm256_set1_epi32(2)), _mm256_set1_epi32(4)), 29));
+	sinSign = _mm256_xor_ps(sinSign, swapSign);
+	__m256 polyMask = _mm256_castsi256_ps(
+		_mm256_cmpeq_epi32(_mm256_and_si256(j, _mm256_set1_epi32(2)), _mm256_setzero_si256()));
+
+	x = _mm256_fnmadd_ps(fj, _mm256_set1_ps(0.78515625f), x);
+	x = _mm256_fnmadd_ps(fj, _mm256_set1_ps(2.4187564849853515625e-4f), x);
+	x = _mm256_fnmadd_ps(fj, _mm256_set1_ps(3.77489497744594108e-8f), x);
+	__m256 z = _mm256_mul_ps(x, x);
+
+	__m256 yc = _mm256_set1_ps(2.443315711809948e-5f);
+	yc = _mm256_fmadd_ps(yc, z, _mm256_set1_ps(-1.388731625493765e-3f));
+	yc = _mm256_fmadd_ps(yc, z, _mm256_set1_ps(4.166664568298827e-2f));
+	yc = _mm256_mul_ps(_mm256_mul_ps(yc, z), z);
+	yc = _mm256_fnmadd_ps(z, _mm256_set1_ps(0.5f), yc);
+	yc = _mm256_add_ps(yc, _mm256_set1_ps(1.0f));
+
+	__m256 ys = _mm256_set1_ps(-1.9515295891e-4f);
+	ys = _mm256_fmadd_ps(ys, z, _mm256_set1_ps(8.3321608736e-3f));
+	ys = _mm256_fmadd_ps(ys, z, _mm256_set1_ps(-1.6666654611e-1f));
+	ys = _mm256_fmadd_ps(_mm256_mul_ps(ys, z), x, x);
+
+	*s = _mm256_xor_ps(_mm256_blendv_ps(yc, ys, polyMask), sinSign);
+	*c = _mm256_xor_ps(_mm256_blendv_ps(ys, yc, polyMask), cosSign);
+}
+
+__attribute__((target("avx2,fma"))) static void gerstnerDisplaceAVX2(const GerstnerTerm *terms, int numTerms,
+																	 float *x, float *y, float *z, size_t begin, size_t end)
+{
+	size_t i = begin;
+	for (; i + 8 <= end; i += 8)
+	{
+		__m256 px = _mm256_loadu_ps(x + i);
+		__m256 py = _mm256_loadu_ps(y + i);
+		__m256 pz = _mm256_loadu_ps(z + i);
+		for (int t = 0; t < numTerms; ++t)
+		{
+			const GerstnerTerm &g = terms[t];
+			__m256 phase = _mm256_fmadd_ps(_mm256_set1_ps(g.kx), px,
+										   _mm256_fmadd_ps(_mm256_set1_ps(g.kz), pz, _mm256_set1_ps(g.phase0)));
+			__m256 s, c;
+			sincosAVX2(phase, &s, &c);
+			px = _mm256_fmadd_ps(_mm256_set1_ps(g.ax), c, px);
+			py = _mm256_fmadd_ps(_mm256_set1_ps(g.A), s, py);
+			pz = _mm256_fmadd_ps(_mm256_set1_ps(g.az), c, pz);
+		}
+		_mm256_storeu_ps(x + i, px);
+		_mm256_storeu_ps(y + i, py);
+		_mm256_storeu_ps(z + i, pz);
+	}
+	gerstnerDisplaceSSE(terms, numTerms, x, y, z, i, end);
+}
+
+// gerstnerChainScalar for 8 points.
+__attribute__((target("avx2,fma"))) static inline void gerstnerChainAVX2(const GerstnerTerm *terms, int numTerms,
+																		 __m256 *p)
+{
+	for (int t = 0; t < numTerms; ++t)
+	{
+		const GerstnerTerm &g = terms[t];
+		__m256 kx = _mm256_set1_ps(g.kx), kz = _mm256_set1_ps(g.kz);
+		__m256 phase = _mm256_fmadd_ps(kx, p[WD_X], _mm256_fmadd_ps(kz, p[WD_Z], _mm256_set1_ps(g.phase0)));
+		__m256 du = _mm256_fmadd_ps(kx, p[WD_XU], _mm256_mul_ps(kz, p[WD_ZU]));
+		__m256 dv = _mm256_fmadd_ps(kx, p[WD_XV], _mm256_mul_ps(kz, p[WD_ZV]));
+		__m256 s, c;
+		sincosAVX2(phase, &s, &c);
+		__m256 ax = _mm256_set1_ps(g.ax), az = _mm256_set1_ps(g.az), A = _mm256_set1_ps(g.A);
+		p[WD_X] = _mm256_fmadd_ps(ax, c, p[WD_X]);
+		p[WD_Y] = _mm256_fmadd_ps(A, s, p[WD_Y]);
+		p[WD_Z] = _mm256_fmadd_ps(az, c, p[WD_Z]);
+		__m256 axs = _mm256_mul_ps(ax, s), azs = _mm256_mul_ps(az, s), ac = _mm256_mul_ps(A, c);
+		p[WD_XU] = _mm256_fnmadd_ps(axs, du, p[WD_XU]);
+		p[WD_XV] = _mm256_fnmadd_ps(axs, dv, p[WD_XV]);
+		p[WD_YU] = _mm256_fmadd_ps(ac, du, p[WD_YU]);
+		p[WD_YV] = _mm256_fmadd_ps(ac, dv, p[WD_YV]);
+		p[WD_ZU] = _mm256_fnmadd_ps(azs, du, p[WD_ZU]);
+		p[WD_ZV] = _mm256_fnmadd_ps(azs, dv, p[WD_ZV]);
+	}
+}
+
+#endif
+
+class WaveField
+{
+public:
+	enum Kernel
+	{
+		KERNEL_SCALAR,
+		KERNEL_SSE,
+		KERNEL_AVX2
+	};
+
+private:
+	std::vector<GerstnerWave> waves;
+	Kernel kernel;
+
+public:
+	WaveField() : WaveField(defaultGerstnerWaves()) {}
+
+	explicit WaveField(const std::vector<GerstnerWave> &waves)
+		: waves(waves), kernel(bestKernel())
+	{
+	}
+
+	// Widest kernel this CPU can run.
+	static Kernel bestKernel()
+	{
+#ifdef WAVE_FIELD_X86
+		if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+			return KERNEL_AVX2;
+		return KERNEL_SSE;
+#else
+		return KERNEL_SCALAR;
+#endif
+	}
+
+	// Forces a kernel, e.g. to compare them. Falls back if it isn't supported.
+	void setKernel(Kernel k) { kernel = k > bestKernel() ? bestKernel() : k; }
+	Kernel getKernel() const { return kernel; }
+
+	const std::vector<GerstnerWave> &getWaves() const { return waves; }
+	void setWaves(const std::vector<GerstnerWave> &w) { waves = w; }
+
+	// Displaces count points in place, exactly like geo.glsl displaces pos[i]:
+	// x/z move horizontally and y is offset by the wave height. The input y is
+	// the undisplaced height (0 for the plane, or the displacement map value).
+	void displace(float time, float *x, float *y, float *z, size_t count) const
+	{
+		std::vector<GerstnerTerm> terms;
+		foldGerstnerTerms(waves, time, terms);
+		displace(terms, x, y, z, 0, count);
+	}
+
+	// Same with the per-wave constants already folded, over [begin, end).
+	// Lets callers that split one batch across threads fold only once.
+	void displace(const std::vector<GerstnerTerm> &terms, float *x, float *y, float *z, size_t begin, size_t end) const
+	{
+		int n = (int)terms.size();
+		switch (kernel)
+		{
+#ifdef WAVE_FIELD_X86
+		case KERNEL_AVX2:
+			gerstnerDisplaceAVX2(terms.data(), n, x, y, z, begin, end);
+			break;
+		case KERNEL_SSE:
+			gerstnerDisplaceSSE(terms.data(), n, x, y, z, begin, end);
+			break;
+#endif
+		default:
+			gerstnerDisplaceScalar(terms.data(), n, x, y, z, begin, end);
+			break;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,125 @@
+#ifndef WAVE_SAMPLER_HPP
+#define WAVE_SAMPLER_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "ThreadPool.hpp"
+#include "WaveField.hpp"
+
+// A regular nx * nz lattice of sample points over [xmin,xmax] x [zmin,zmax],
+// laid out row-major with z fastest, like PlaneGrid's vertices.
+struct WaveSampleRegion
+{
+	float xmin, xmax;
+	float zmin, zmax;
+	int nx, nz;
+
+	// The square domain PlaneMesh is built over, at n samples per side.
+	static WaveSampleRegion fromPlane(float min, float max, int n)
+	{
+		return WaveSampleRegion{min, max, min, max, n, n};
+	}
+
+	float dx() const { return nx > 1 ? (xmax - xmin) / (nx - 1) : 0.0f; }
+	float dz() const { return nz > 1 ? (zmax - zmin) / (nz - 1) : 0.0f; }
+	size_t numSamples() const { return (size_t)nx * nz; }
+};
+
+// Where the sampler writes. Each array holds region.numSamples() floats with
+// rows rowStride floats apart (0 means nz). outX/outZ may be null when only
+// heights are wanted.
+struct WaveSampleOutput
+{
+	float *outX = nullptr;
+	float *outY = nullptr;
+	float *outZ = nullptr;
+	size_t rowStride = 0;
+};
+
+// Samples the displaced wave surface over a whole region every tick
+// (minimaps, collision grids, network snapshots) by splitting it into tiles
+// and running them on a work-stealing pool. Nothing is allocated per call
+// once the first call has sized the per-worker scratch.
+class WaveSampler
+{
+	ThreadPool &pool;
+	int tileSize;
+
+	// Per-worker SoA scratch, one tile big.
+	std::vector<std::vector<float>> scratch;
+	std::vector<GerstnerTerm> terms;
+
+	// Tiles each worker ran during the last call, to check load balance.
+	std::vector<size_t> tilesPerWorker;
+	double lastMs = 0.0;
+
+public:
+	// tileSize is in samples per side; 64 keeps a tile's three SoA arrays at
+	// 48 KB, inside a typical L2.
+	WaveSampler(ThreadPool &pool, int tileSize = 64)
+		: pool(pool), tileSize(tileSize)
+	{
+		scratch.resize(pool.numWorkers());
+		tilesPerWorker.resize(pool.numWorkers());
+		for (std::vector<float> &s : scratch)
+			s.resize((size_t)tileSize * tileSize * 3);
+	}
+
+	void sample(const WaveField &field, float time, const WaveSampleRegion &region, const WaveSampleOutput &out)
+	{
+		auto start = std::chrono::steady_clock::now();
+
+		foldGerstnerTerms(field.getWaves(), time, terms);
+		std::fill(tilesPerWorker.begin(), tilesPerWorker.end(), 0);
+
+		size_t stride = out.rowStride ? out.rowStride : (size_t)region.nz;
+		int tilesX = (region.nx + tileSize - 1) / tileSize;
+		int tilesZ = (region.nz + tileSize - 1) / tileSize;
+		float dx = region.dx(), dz = region.dz();
+
+		pool.parallelFor((size_t)tilesX * tilesZ, [&](size_t tile, unsigned worker)
+						 {
+			int i0 = (int)(tile / tilesZ) * tileSize;
+			int j0 = (int)(tile % tilesZ) * tileSize;
+			int rows = std::min(tileSize, region.nx - i0);
+			int cols = std::min(tileSize, region.nz - j0);
+			size_t n = (size_t)rows * cols;
+
+			float *x = scratch[worker].data();
+			float *y = x + n;
+			float *z = y + n;
+			for (int i = 0; i < rows; ++i)
+			{
+				float px = region.xmin + (i0 + i) * dx;
+				for (int j = 0; j < cols; ++j)
+				{
+					x[i * cols + j] = px;
+					y[i * cols + j] = 0.0f;
+					z[i * cols + j] = region.zmin + (j0 + j) * dz;
+				}
+			}
+
+			field.displace(terms, x, y, z, 0, n);
+
+			for (int i = 0; i < rows; ++i)
+			{
+				size_t dst = (size_t)(i0 + i) * stride + j0;
+				const size_t src = (size_t)i * cols;
+				std::copy(y + src, y + src + cols, out.outY + dst);
+				if (out.outX)
+					std::copy(x + src, x + src + cols, out.outX + dst);
+				if (out.outZ)
+					std::copy(z + src, z + src + cols, out.outZ + dst);
+			}
+			tilesPerWorker[worker]++; });
+
+		lastMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	double lastSampleMs() const { return lastMs; }
+	const std::vector<size_t> &lastTilesPerWorker() const { return tilesPerWorker; }
+};
+
+#endif
@@ -2,272 +2,333 @@
 #define SHADER_HPP
 
 #include <stdio.h>
+#include <stdint.h>
 #include <string>
 #include <vector>
 #include <iostream>
 #include <fstream>
 #include <algorithm>
 #include <sstream>
+#include <chrono>
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #include <GL/glew.h>
 
-GLuint LoadShaders(const char *vertex_file_path, const char *fragment_file_path)
-{
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+
+// Shader programs are built with ShaderBuilder from any set of stages.
+// Linked programs are saved with glGetProgramBinary under shaderCacheDir,
+// keyed by a hash of the sources, defines and the driver's vendor, renderer
+// and version strings, so a later start skips compiling and linking. An entry
+// the driver rejects (e.g. after a driver update) is rebuilt from source.
+//
+// Where GL_KHR_parallel_shader_compile is available the driver compiles on
+// its own threads: start() only submits the work, and the program can be
+// polled with isReady() and collected with finish() once it is needed.
 
-    // Create the shaders
-    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+#define SHADER_CACHE_MAGIC 0x31485350 // "PSH1"
 
-    // Read the Vertex Shader code from the file
-    std::string VertexShaderCode;
-    std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-    if (VertexShaderStream.is_open())
+// Empty disables the program binary cache.
+std::string shaderCacheDir = "build/shadercache";
+
+struct ShaderCacheHeader
+{
+    uint32_t magic;
+    uint32_t format; // binaryFormat from glGetProgramBinary
+    uint64_t key;
+    uint32_t length;
+    uint32_t pad0;
+};
+
+// Lets the driver compile on as many threads as it likes. True if
+// GL_KHR_parallel_shader_compile is there; call once after glewInit().
+bool enableParallelShaderCompile()
+{
+    static int enabled = -1;
+    if (enabled < 0)
     {
-        std::stringstream sstr;
-        sstr << VertexShaderStream.rdbuf();
-        VertexShaderCode = sstr.str();
-        VertexShaderStream.close();
+        enabled = GLEW_KHR_parallel_shader_compile ? 1 : 0;
+        if (enabled)
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
     }
-    else
+    return enabled == 1;
+}
+
+// Utility function to load a shader file's contents into a std::string.
+std::string readFile(const char *filePath)
+{
+    std::ifstream fileStream(filePath, std::ios::in);
+    if (!fileStream.is_open())
     {
-        printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-        getchar();
-        return 0;
+        std::cerr << "Could not open file " << filePath << std::endl;
+        return "";
     }
+    std::stringstream sstr;
+    sstr << fileStream.rdbuf();
+    fileStream.close();
+    return sstr.str();
+}
 
-    // Read the Fragment Shader code from the file
-    std::string FragmentShaderCode;
-    std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-    if (FragmentShaderStream.is_open())
+class ShaderBuilder
+{
+    struct Stage
+    {
+        GLenum type;
+        std::string path;
+        std::string source;
+        GLuint shader;
+    };
+    std::vector<Stage> stages;
+    std::string defines;
+    GLuint program;
+    uint64_t key;
+    bool started, cached, failed;
+    double buildMs;
+
+    std::string cachePath() const
     {
-        std::stringstream sstr;
-        sstr << FragmentShaderStream.rdbuf();
-        FragmentShaderCode = sstr.str();
-        FragmentShaderStream.close();
+        char name[32];
+        snprintf(name, sizeof(name), "/%016llx.bin", (unsigned long long)key);
+        return shaderCacheDir + name;
     }
 
-    GLint Result = GL_FALSE;
-    int InfoLogLength;
-
-    // Compile Vertex Shader
-    printf("Compiling shader : %s\n", vertex_file_path);
-    char const *VertexSourcePointer = VertexShaderCode.c_str();
-    glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
-    glCompileShader(VertexShaderID);
-
-    // Check Vertex Shader
-    glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if (InfoLogLength > 0)
+    // Sources with the defines spliced in after the #version line.
+    std::string expand(const std::string &source) const
     {
-        std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-        glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-        printf("%s\n", &VertexShaderErrorMessage[0]);
+        if (defines.empty())
+            return source;
+        size_t at = 0;
+        if (source.compare(0, 8, "#version") == 0)
+        {
+            at = source.find('\n');
+            at = at == std::string::npos ? source.size() : at + 1;
+        }
+        return source.substr(0, at) + defines + source.substr(at);
     }
 
-    // Compile Fragment Shader
-    printf("Compiling shader : %s\n", fragment_file_path);
-    char const *FragmentSourcePointer = FragmentShaderCode.c_str();
-    glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
-    glCompileShader(FragmentShaderID);
-
-    // Check Fragment Shader
-    glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if (InfoLogLength > 0)
+    bool loadCached()
     {
-        std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-        glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-        printf("%s\n", &FragmentShaderErrorMessage[0]);
+        MappedFile file;
+        if (!file.open(cachePath().c_str()) || file.size() < sizeof(ShaderCacheHeader))
+            return false;
+        const ShaderCacheHeader *h = (const ShaderCacheHeader *)file.data();
+        if (h->magic != SHADER_CACHE_MAGIC || h->key != key || h->length != file.size() - sizeof(ShaderCacheHeader))
+            return false;
+        glProgramBinary(program, h->format, file.data() + sizeof(ShaderCacheHeader), h->length);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        return linked == GL_TRUE;
     }
 
-    // Link the program
-    printf("Linking program\n");
-    GLuint ProgramID = glCreateProgram();
-    glAttachShader(ProgramID, VertexShaderID);
-    glAttachShader(ProgramID, FragmentShaderID);
-
-    glLinkProgram(ProgramID);
-
-    // Check the program
-    glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-    glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if (InfoLogLength > 0)
+    void saveCached(GLuint id)
     {
-        std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-        glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-        printf("%s\n", &ProgramErrorMessage[0]);
+        GLint length = 0;
+        glGetProgramiv(id, GL_PROGRAM_BINARY_LENGTH, &length);
+        if (length <= 0)
+            return;
+        std::vector<unsigned char> data(sizeof(ShaderCacheHeader) + length);
+        ShaderCacheHeader *h = (ShaderCacheHeader *)data.data();
+        GLenum format = 0;
+        glGetProgramBinary(id, length, NULL, &format, data.data() + sizeof(ShaderCacheHeader));
+        h->magic = SHADER_CACHE_MAGIC;
+        h->format = format;
+        h->key = key;
+        h->length = (uint32_t)length;
+        h->pad0 = 0;
+
+        mkdir(shaderCacheDir.c_str(), 0755);
+        std::string path = cachePath();
+        std::string tmp = path + ".tmp";
+        FILE *out = fopen(tmp.c_str(), "wb");
+        if (!out)
+            return;
+        bool ok = fwrite(data.data(), 1, data.size(), out) == data.size();
+        ok = fclose(out) == 0 && ok;
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0)
+            remove(tmp.c_str());
     }
 
-    glDetachShader(ProgramID, VertexShaderID);
-    glDetachShader(ProgramID, FragmentShaderID);
-
-    glDeleteShader(VertexShaderID);
-    glDeleteShader(FragmentShaderID);
-
-    return ProgramID;
-}
-
-GLuint LoadShaders(const char *vertex_file_path, const char *geo_file_path, const char *fragment_file_path)
-{
+    // Prints the log of a failed stage or link.
+    void report(GLuint id)
+    {
+        for (const Stage &s : stages)
+        {
+            GLint success = GL_FALSE;
+            glGetShaderiv(s.shader, GL_COMPILE_STATUS, &success);
+            if (success)
+                continue;
+            char infoLog[1024];
+            glGetShaderInfoLog(s.shader, sizeof(infoLog), nullptr, infoLog);
+            std::cerr << "ERROR::SHADER_COMPILATION_ERROR in " << s.path << "\n"
+                      << infoLog << std::endl;
+        }
+        char infoLog[1024];
+        glGetProgramInfoLog(id, sizeof(infoLog), nullptr, infoLog);
+        std::cerr << "ERROR::PROGRAM_LINKING_ERROR:\n"
+                  << infoLog << std::endl;
+    }
 
-    // Create the shaders
-    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
+public:
+    ShaderBuilder() : program(0), key(0), started(false), cached(false), failed(false), buildMs(0.0) {}
 
-    // Read the Vertex Shader code from the file
-    std::string VertexShaderCode;
-    std::ifstream VertexShaderStream(vertex_file_path, std::ios::in);
-    if (VertexShaderStream.is_open())
+    // Unfinished programs are deleted.
+    ~ShaderBuilder()
     {
-        std::stringstream sstr;
-        sstr << VertexShaderStream.rdbuf();
-        VertexShaderCode = sstr.str();
-        VertexShaderStream.close();
+        if (started && program)
+            glDeleteProgram(finish());
     }
-    else
+
+    ShaderBuilder(const ShaderBuilder &) = delete;
+    ShaderBuilder &operator=(const ShaderBuilder &) = delete;
+
+    ShaderBuilder &stage(GLenum type, const char *path)
     {
-        printf("Impossible to open %s. Are you in the right directory ? Don't forget to read the FAQ !\n", vertex_file_path);
-        getchar();
-        return 0;
+        Stage s = {type, path, readFile(path), 0};
+        if (s.source.empty())
+            failed = true;
+        stages.push_back(s);
+        return *this;
     }
 
-    // Read the Fragment Shader code from the file
-    std::string FragmentShaderCode;
-    std::ifstream FragmentShaderStream(fragment_file_path, std::ios::in);
-    if (FragmentShaderStream.is_open())
+    // Adds "#define name value" to every stage.
+    ShaderBuilder &define(const char *name, const char *value = "1")
     {
-        std::stringstream sstr;
-        sstr << FragmentShaderStream.rdbuf();
-        FragmentShaderCode = sstr.str();
-        FragmentShaderStream.close();
+        defines += std::string("#define ") + name + " " + value + "\n";
+        return *this;
     }
 
-    GLint Result = GL_FALSE;
-    int InfoLogLength;
-
-    // Compile Vertex Shader
-    printf("Compiling shader : %s\n", vertex_file_path);
-    char const *VertexSourcePointer = VertexShaderCode.c_str();
-    glShaderSource(VertexShaderID, 1, &VertexSourcePointer, NULL);
-    glCompileShader(VertexShaderID);
-
-    // Check Vertex Shader
-    glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if (InfoLogLength > 0)
+    ShaderBuilder &define(const char *name, int value)
     {
-        std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-        glGetShaderInfoLog(VertexShaderID, InfoLogLength, NULL, &VertexShaderErrorMessage[0]);
-        printf("%s\n", &VertexShaderErrorMessage[0]);
+        return define(name, std::to_string(value).c_str());
     }
 
-    // Read the geo Shader code from the file
-    std::string GeoShaderCode;
-    std::ifstream GeoShaderStream(geo_file_path, std::ios::in);
-    if (GeoShaderStream.is_open())
+    // Loads the cached binary, or submits every stage for compiling and the
+    // program for linking without waiting on either.
+    void start()
     {
-        std::stringstream sstr;
-        sstr << GeoShaderStream.rdbuf();
-        GeoShaderCode = sstr.str();
-        GeoShaderStream.close();
+        if (started)
+            return;
+        started = true;
+        if (failed)
+            return;
+        auto begin = std::chrono::steady_clock::now();
+
+        const char *driver[3] = {(const char *)glGetString(GL_VENDOR), (const char *)glGetString(GL_RENDERER),
+                                 (const char *)glGetString(GL_VERSION)};
+        key = FNV1A64_SEED;
+        for (const char *s : driver)
+            if (s)
+                key = fnv1a64(s, strlen(s) + 1, key);
+        key = fnv1a64(defines.data(), defines.size(), key);
+        for (const Stage &s : stages)
+        {
+            key = fnv1a64(&s.type, sizeof(s.type), key);
+            key = fnv1a64(s.source.data(), s.source.size(), key);
+        }
+
+        program = glCreateProgram();
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        bool useCache = !shaderCacheDir.empty() && formats > 0;
+        if (useCache && loadCached())
+        {
+            cached = true;
+        }
+        else
+        {
+            for (Stage &s : stages)
+            {
+                std::string source = expand(s.source);
+                const char *text = source.c_str();
+                s.shader = glCreateShader(s.type);
+                glShaderSource(s.shader, 1, &text, nullptr);
+                glCompileShader(s.shader);
+                glAttachShader(program, s.shader);
+            }
+            if (useCache)
+                glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+            glLinkProgram(program);
+        }
+        buildMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
     }
 
-    GLuint GSID = glCreateShader(GL_GEOMETRY_SHADER);
-    char const *GeoShaderPtr = GeoShaderCode.c_str();
-    glShaderSource(GSID, 1, &GeoShaderPtr, NULL);
-    glCompileShader(GSID);
-    // Check GEO Shader
-    glGetShaderiv(GSID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(GSID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if (InfoLogLength > 0)
+    // True once finish() won't block. Always true without parallel compile.
+    bool isReady()
     {
-        std::vector<char> GSErrorMessage(InfoLogLength + 1);
-        glGetShaderInfoLog(GSID, InfoLogLength, NULL, &GSErrorMessage[0]);
-        printf("%s\n", &GSErrorMessage[0]);
+        start();
+        if (!program || cached || !GLEW_KHR_parallel_shader_compile)
+            return true;
+        GLint done = GL_TRUE;
+        glGetProgramiv(program, GL_COMPLETION_STATUS_KHR, &done);
+        return done == GL_TRUE;
     }
 
-    // Compile Fragment Shader
-    printf("Compiling shader : %s\n", fragment_file_path);
-    char const *FragmentSourcePointer = FragmentShaderCode.c_str();
-    glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, NULL);
-    glCompileShader(FragmentShaderID);
-
-    // Check Fragment Shader
-    glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if (InfoLogLength > 0)
+    // Waits for the program and hands it over to the caller, who deletes it.
+    // Prints the logs and returns 0 if a stage or the link failed.
+    GLuint finish()
     {
-        std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-        glGetShaderInfoLog(FragmentShaderID, InfoLogLength, NULL, &FragmentShaderErrorMessage[0]);
-        printf("%s\n", &FragmentShaderErrorMessage[0]);
+        start();
+        GLuint id = program;
+        program = 0;
+        if (!id)
+            return 0;
+        auto begin = std::chrono::steady_clock::now();
+        GLint linked = GL_TRUE;
+        if (!cached)
+        {
+            glGetProgramiv(id, GL_LINK_STATUS, &linked);
+            if (!linked)
+                report(id);
+            else if (!shaderCacheDir.empty())
+                saveCached(id);
+            for (Stage &s : stages)
+            {
+                glDetachShader(id, s.shader);
+                glDeleteShader(s.shader);
+                s.shader = 0;
+            }
+        }
+        buildMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+        if (!linked)
+        {
+            glDeleteProgram(id);
+            return 0;
+        }
+        return id;
     }
 
-    // Link the program
-    printf("Linking program\n");
-    GLuint ProgramID = glCreateProgram();
-    glAttachShader(ProgramID, VertexShaderID);
-    glAttachShader(ProgramID, GSID);
-    glAttachShader(ProgramID, FragmentShaderID);
-
-    glLinkProgram(ProgramID);
-
-    // Check the program
-    glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-    glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if (InfoLogLength > 0)
+    GLuint build()
     {
-        std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-        glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-        printf("%s\n", &ProgramErrorMessage[0]);
+        start();
+        return finish();
     }
 
-    glDetachShader(ProgramID, VertexShaderID);
-    glDetachShader(ProgramID, FragmentShaderID);
-
-    glDeleteShader(VertexShaderID);
-    glDeleteShader(FragmentShaderID);
+    // Came from the binary cache rather than the sources.
+    bool wasCached() const { return cached; }
+    // Time spent in start() and finish(); the driver's parallel work in
+    // between isn't counted.
+    double getBuildMs() const { return buildMs; }
+};
 
-    return ProgramID;
-}
-
-// Utility function to load a shader file's contents into a std::string.
-std::string readFile(const char *filePath)
+GLuint LoadShaders(const char *vertex_file_path, const char *fragment_file_path)
 {
-    std::ifstream fileStream(filePath, std::ios::in);
-    if (!fileStream.is_open())
-    {
-        std::cerr << "Could not open file " << filePath << std::endl;
-        return "";
-    }
-    std::stringstream sstr;
-    sstr << fileStream.rdbuf();
-    fileStream.close();
-    return sstr.str();
+    return ShaderBuilder()
+        .stage(GL_VERTEX_SHADER, vertex_file_path)
+        .stage(GL_FRAGMENT_SHADER, fragment_file_path)
+        .build();
 }
 
-// Compiles a shader of a given type from source code.
-GLuint compileShader(const char *source, GLenum shaderType)
+GLuint LoadShaders(const char *vertex_file_path, const char *geo_file_path, const char *fragment_file_path)
 {
-    GLuint shader = glCreateShader(shaderType);
-    glShaderSource(shader, 1, &source, nullptr);
-    glCompileShader(shader);
-
-    // Check for compile errors.
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success)
-    {
-        char infoLog[512];
-        glGetShaderInfoLog(shader, sizeof(infoLog), nullptr, infoLog);
-        std::cerr << "ERROR::SHADER_COMPILATION_ERROR of type ("
-                  << shaderType << "):\n"
-                  << infoLog << std::endl;
-    }
-    return shader;
+    return ShaderBuilder()
+        .stage(GL_VERTEX_SHADER, vertex_file_path)
+        .stage(GL_GEOMETRY_SHADER, geo_file_path)
+        .stage(GL_FRAGMENT_SHADER, fragment_file_path)
+        .build();
 }
 
 // Creates a shader program from 5 shader files (vertex, tessellation control, tessellation evaluation, geometry, and fragment).
@@ -277,54 +338,28 @@ GLuint createShaderProgram(const char *vertexPath,
                            const char *geoPath,
                            const char *fragmentPath)
 {
-    // Load shader source code from files.
-    std::string vertexCode = readFile(vertexPath);
-    std::string tessControlCode = readFile(tessControlPath);
-    std::string tessEvalCode = readFile(tessEvalPath);
-    std::string geoCode = readFile(geoPath);
-    std::string fragmentCode = readFile(fragmentPath);
-
-    const char *vertexSource = vertexCode.c_str();
-    const char *tessControlSource = tessControlCode.c_str();
-    const char *tessEvalSource = tessEvalCode.c_str();
-    const char *geoSource = geoCode.c_str();
-    const char *fragmentSource = fragmentCode.c_str();
-
-    // Compile each shader.
-    GLuint vertexShader = compileShader(vertexSource, GL_VERTEX_SHADER);
-    GLuint tessControlShader = compileShader(tessControlSource, GL_TESS_CONTROL_SHADER);
-    GLuint tessEvalShader = compileShader(tessEvalSource, GL_TESS_EVALUATION_SHADER);
-    GLuint geoShader = compileShader(geoSource, GL_GEOMETRY_SHADER);
-    GLuint fragmentShader = compileShader(fragmentSource, GL_FRAGMENT_SHADER);
-
-    // Create the shader program and attach all shaders.
-    GLuint shaderProgram = glCreateProgram();
-    glAttachShader(shaderProgram, vertexShader);
-    glAttachShader(shaderProgram, tessControlShader);
-    glAttachShader(shaderProgram, tessEvalShader);
-    glAttachShader(shaderProgram, geoShader);
-    glAttachShader(shaderProgram, fragmentShader);
-    glLinkProgram(shaderProgram);
-
-    // Check for linking errors.
-    GLint success;
-    glGetProgramiv(shaderProgram, GL_LINK_STATUS, &success);
-    if (!success)
-    {
-        char infoLog[512];
-        glGetProgramInfoLog(shaderProgram, sizeof(infoLog), nullptr, infoLog);
-        std::cerr << "ERROR::PROGRAM_LINKING_ERROR:\n"
-                  << infoLog << std::endl;
-    }
-
-    // Shaders are no longer needed after linking.
-    glDeleteShader(vertexShader);
-    glDeleteShader(tessControlShader);
-    glDeleteShader(tessEvalShader);
-    glDeleteShader(geoShader);
-    glDeleteShader(fragmentShader);
+    return ShaderBuilder()
+        .stage(GL_VERTEX_SHADER, vertexPath)
+        .stage(GL_TESS_CONTROL_SHADER, tessControlPath)
+        .stage(GL_TESS_EVALUATION_SHADER, tessEvalPath)
+        .stage(GL_GEOMETRY_SHADER, geoPath)
+        .stage(GL_FRAGMENT_SHADER, fragmentPath)
+        .build();
+}
 
-    return shaderProgram;
+// Same as above without a geometry shader (vertex, tessellation control,
+// tessellation evaluation and fragment).
+GLuint createShaderProgram(const char *vertexPath,
+                           const char *tessControlPath,
+                           const char *tessEvalPath,
+                           const char *fragmentPath)
+{
+    return ShaderBuilder()
+        .stage(GL_VERTEX_SHADER, vertexPath)
+        .stage(GL_TESS_CONTROL_SHADER, tessControlPath)
+        .stage(GL_TESS_EVALUATION_SHADER, tessEvalPath)
+        .stage(GL_FRAGMENT_SHADER, fragmentPath)
+        .build();
 }
 
 #endif
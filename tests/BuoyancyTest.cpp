@@ -0,0 +1,96 @@
+// Checks BuoyancySystem: on a flat sea a box settles half under, as its mass
+// says it should, and stays level; on the default waves a fleet keeps
+// floating, upright, and comes out the same whatever the pool size. Exits
+// non-zero on a mismatch.
+//
+//   make test
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include "Buoyancy.hpp"
+
+// A 2 x 1 x 4 box: columnHeight 1, centre of mass a third of the way up.
+static BuoyancyHull testHull()
+{
+	return BuoyancyHull::box(glm::vec3(-1.0f, 0.0f, -2.0f), glm::vec3(1.0f, 1.0f, 2.0f), 3, 5);
+}
+
+int main()
+{
+	int failures = 0;
+	auto check = [&](const char *name, bool ok, float value)
+	{
+		printf("%-34s %9.4f %s\n", name, value, ok ? "ok" : "FAIL");
+		failures += !ok;
+	};
+
+	// Flat sea: dropped from above, the box ends with its bottom 0.5 under,
+	// so its centre of mass at 1/3 - 0.5.
+	{
+		WaveField calm(std::vector<GerstnerWave>{});
+		ThreadPool pool(1);
+		BuoyancySystem system(calm, pool, testHull());
+		system.addBody(glm::vec3(0.0f, 2.0f, 0.0f), 0.3f);
+		for (int i = 0; i < 1200; ++i)
+			system.step();
+		glm::vec3 p = system.getPosition(0);
+		float expected = 1.0f / 3.0f - 0.5f;
+		check("calm: rest height error", fabsf(p.y - expected) < 0.01f, p.y - expected);
+		check("calm: horizontal drift", fabsf(p.x) < 1e-3f && fabsf(p.z) < 1e-3f, std::max(fabsf(p.x), fabsf(p.z)));
+		std::vector<glm::mat4> m;
+		system.writeTransforms(m);
+		check("calm: up axis y", m[0][1].y > 0.9999f, m[0][1].y);
+	}
+
+	// Default waves: a fleet of 600 (more than two BUOYANCY_CHUNKs) over
+	// 20 s, on 1 and 4 threads.
+	std::vector<glm::vec3> results[2];
+	unsigned threads[2] = {1, 4};
+	for (int run = 0; run < 2; ++run)
+	{
+		WaveField field;
+		ThreadPool pool(threads[run]);
+		BuoyancySystem system(field, pool, testHull());
+		for (int i = 0; i < 600; ++i)
+			system.addBody(glm::vec3((i % 30) * 6.0f, 0.0f, (i / 30) * 8.0f), 0.1f * i);
+
+		float lowest = INFINITY, highest = -INFINITY, leastUp = 1.0f;
+		std::vector<glm::mat4> m;
+		for (int step = 0; step < 1200; ++step)
+		{
+			system.step();
+			if (step < 600)
+				continue;
+			system.writeTransforms(m);
+			for (size_t b = 0; b < system.numBodies(); ++b)
+			{
+				float y = system.getPosition(b).y;
+				lowest = std::min(lowest, y);
+				highest = std::max(highest, y);
+				leastUp = std::min(leastUp, m[b][1].y);
+			}
+		}
+		for (size_t b = 0; b < system.numBodies(); ++b)
+			results[run].push_back(system.getPosition(b));
+
+		if (run == 0)
+		{
+			// The default waves add up to under 0.5 high, so the centre of
+			// mass should stay within that of its calm rest height, -1/6.
+			check("waves: lowest centre of mass", lowest > -0.7f, lowest);
+			check("waves: highest centre of mass", highest < 0.4f, highest);
+			check("waves: least up axis y", leastUp > 0.9f, leastUp);
+		}
+	}
+	float diff = 0.0f;
+	for (size_t b = 0; b < results[0].size(); ++b)
+		diff = std::max(diff, glm::length(results[0][b] - results[1][b]));
+	check("waves: 1 vs 4 threads", diff == 0.0f, diff);
+
+	if (failures)
+		fprintf(stderr, "%d buoyancy check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,184 @@
+// Checks MappedBMP against small BMP files written on the spot: the layouts
+// it accepts come back with the right size, row stride, orientation and
+// pixels, and the ones it doesn't are rejected instead of read past the end.
+// Exits non-zero on a mismatch.
+//
+//   make test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <vector>
+
+#include "LoadBMP.hpp"
+
+static void put16(std::vector<unsigned char> &f, size_t at, uint16_t v)
+{
+	f[at] = v & 0xFF;
+	f[at + 1] = v >> 8;
+}
+
+static void put32(std::vector<unsigned char> &f, size_t at, uint32_t v)
+{
+	for (int i = 0; i < 4; ++i)
+		f[at + i] = (v >> (8 * i)) & 0xFF;
+}
+
+// A w x h image with a 40 byte header (plus the bitfield masks for
+// compression 3). Pixel byte k of row r is (r * 31 + k) & 0xFF; the 8 bpp
+// palette is the grey ramp.
+static std::vector<unsigned char> makeBMP(int32_t w, int32_t h, uint16_t bpp, uint32_t compression = 0)
+{
+	size_t stride = (((size_t)(w > 0 ? w : 0) * bpp + 31) / 32) * 4;
+	size_t rows = h < 0 ? -h : h;
+	size_t masks = compression == 3 ? 12 : 0;
+	size_t palette = bpp == 8 ? 256 * 4 : 0;
+	size_t dataPos = 14 + 40 + masks + palette;
+	std::vector<unsigned char> f(dataPos + stride * rows, 0);
+	f[0] = 'B';
+	f[1] = 'M';
+	put32(f, 0x02, (uint32_t)f.size());
+	put32(f, 0x0A, (uint32_t)dataPos);
+	put32(f, 0x0E, 40);
+	put32(f, 0x12, (uint32_t)w);
+	put32(f, 0x16, (uint32_t)h);
+	put16(f, 0x1A, 1);
+	put16(f, 0x1C, bpp);
+	put32(f, 0x1E, compression);
+	if (masks)
+	{
+		put32(f, 0x36, 0x00FF0000);
+		put32(f, 0x3A, 0x0000FF00);
+		put32(f, 0x3E, 0x000000FF);
+	}
+	for (size_t i = 0; i < palette / 4; ++i)
+		f[14 + 40 + masks + 4 * i] = f[14 + 40 + masks + 4 * i + 1] = f[14 + 40 + masks + 4 * i + 2] = (unsigned char)i;
+	for (size_t r = 0; r < rows; ++r)
+		for (size_t k = 0; k < stride; ++k)
+			f[dataPos + r * stride + k] = (unsigned char)((r * 31 + k) & 0xFF);
+	return f;
+}
+
+static char tmpPath[] = "/tmp/load-bmp-test-XXXXXX";
+
+static void writeFile(const std::vector<unsigned char> &f)
+{
+	FILE *out = fopen(tmpPath, "wb");
+	if (!out || fwrite(f.data(), 1, f.size(), out) != f.size())
+	{
+		fprintf(stderr, "Could not write %s\n", tmpPath);
+		exit(1);
+	}
+	fclose(out);
+}
+
+// Writes f, opens it and compares what MappedBMP hands out with makeBMP()'s
+// layout.
+static bool checkAccepted(const std::vector<unsigned char> &f, int32_t w, int32_t h, int bpp)
+{
+	writeFile(f);
+	MappedBMP bmp;
+	if (!bmp.open(tmpPath))
+		return false;
+	const BMPImage &img = bmp.image();
+	size_t stride = (((size_t)w * bpp + 31) / 32) * 4;
+	unsigned int rows = h < 0 ? -h : h;
+	if (img.width != (unsigned int)w || img.height != rows || img.bitsPerPixel != bpp || img.rowStride != stride ||
+		img.topDown != (h < 0) || img.isGreyscale() != (bpp == 8))
+		return false;
+	for (size_t r = 0; r < rows; ++r)
+		for (size_t k = 0; k < stride; ++k)
+			if (img.pixels[r * stride + k] != (unsigned char)((r * 31 + k) & 0xFF))
+				return false;
+	return true;
+}
+
+static bool checkRejected(const std::vector<unsigned char> &f)
+{
+	writeFile(f);
+	MappedBMP bmp;
+	return !bmp.open(tmpPath) && !bmp.isOpen();
+}
+
+int main()
+{
+	int fd = mkstemp(tmpPath);
+	if (fd < 0)
+	{
+		fprintf(stderr, "Could not create a temporary file\n");
+		return 1;
+	}
+	close(fd);
+
+	struct Accepted
+	{
+		const char *name;
+		int32_t w, h;
+		uint16_t bpp;
+		uint32_t compression;
+	};
+	// Odd widths so the rows need padding.
+	Accepted accepted[] = {
+		{"24 bpp bottom-up", 13, 7, 24, 0},
+		{"24 bpp top-down", 13, -7, 24, 0},
+		{"32 bpp", 5, 3, 32, 0},
+		{"32 bpp bitfields", 5, 3, 32, 3},
+		{"8 bpp grey", 9, 4, 8, 0},
+	};
+
+	int failures = 0;
+	for (const Accepted &a : accepted)
+	{
+		bool ok = checkAccepted(makeBMP(a.w, a.h, a.bpp, a.compression), a.w, a.h, a.bpp);
+		printf("accept %-22s %s\n", a.name, ok ? "ok" : "FAIL");
+		failures += !ok;
+	}
+
+	struct Rejected
+	{
+		const char *name;
+		std::vector<unsigned char> file;
+	};
+	std::vector<Rejected> rejected;
+	rejected.push_back({"too short", std::vector<unsigned char>(20, 'B')});
+	rejected.push_back({"no signature", makeBMP(4, 4, 24)});
+	rejected.back().file[0] = 'X';
+	rejected.push_back({"os/2 header", makeBMP(4, 4, 24)});
+	put32(rejected.back().file, 0x0E, 12);
+	rejected.push_back({"zero width", makeBMP(0, 4, 24)});
+	rejected.push_back({"16 bpp", makeBMP(4, 4, 16)});
+	rejected.push_back({"rle", makeBMP(4, 4, 8, 1)});
+	rejected.push_back({"rgba masks", makeBMP(4, 4, 32, 3)});
+	put32(rejected.back().file, 0x36, 0x000000FF);
+	rejected.push_back({"huge palette", makeBMP(4, 4, 8)});
+	put32(rejected.back().file, 0x2E, 100000);
+	rejected.push_back({"truncated pixels", makeBMP(64, 64, 24)});
+	rejected.back().file.resize(rejected.back().file.size() - 1);
+	rejected.push_back({"huge height", makeBMP(4, 4, 24)});
+	put32(rejected.back().file, 0x16, 0x40000000);
+
+	for (const Rejected &r : rejected)
+	{
+		bool ok = checkRejected(r.file);
+		printf("reject %-22s %s\n", r.name, ok ? "ok" : "FAIL");
+		failures += !ok;
+	}
+
+	// The shipped textures, when run from the repository root.
+	for (const char *asset : {"assets/water.bmp", "assets/displacement-map1.bmp", "assets/boat.bmp", "assets/head.bmp",
+							  "assets/eyes.bmp"})
+	{
+		if (access(asset, R_OK) != 0)
+			continue;
+		MappedBMP bmp;
+		bool ok = bmp.open(asset) && bmp.image().width > 0 && bmp.image().height > 0;
+		printf("accept %-22s %s\n", asset + 7, ok ? "ok" : "FAIL");
+		failures += !ok;
+	}
+
+	unlink(tmpPath);
+	if (failures)
+		fprintf(stderr, "%d BMP check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,148 @@
+// Checks the cooked mesh cache: a mesh cooked by cookMesh() maps back with
+// exactly the vertices, indices and bounds loadPly() parses, and CookedMesh
+// refuses a cooked file whose source changed or which is cut short. Exits
+// non-zero on a mismatch.
+//
+//   make test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <utime.h>
+#include <string>
+#include <vector>
+
+#include "MeshCache.hpp"
+
+// A quad and a triangle, so the fan triangulation is covered too.
+static const char *testPly =
+	"ply\n"
+	"format ascii 1.0\n"
+	"element vertex 5\n"
+	"property float x\n"
+	"property float y\n"
+	"property float z\n"
+	"property float nx\n"
+	"property float ny\n"
+	"property float nz\n"
+	"property float s\n"
+	"property float t\n"
+	"element face 2\n"
+	"property list uchar uint vertex_indices\n"
+	"end_header\n"
+	"0 0 0 0 1 0 0 0\n"
+	"1 0 0 0 1 0 1 0\n"
+	"1 0 1 0 1 0 1 1\n"
+	"0 0 1 0 1 0 0 1\n"
+	"0.5 2 -3 0 0 1 0.5 0.25\n"
+	"4 0 1 2 3\n"
+	"3 0 1 4\n";
+
+static bool writeText(const std::string &path, const char *text)
+{
+	FILE *f = fopen(path.c_str(), "wb");
+	if (!f)
+		return false;
+	bool ok = fputs(text, f) >= 0;
+	return fclose(f) == 0 && ok;
+}
+
+// Cooks source into cooked and compares the mapped result with loadPly().
+static bool roundTrip(const char *source, const std::string &cooked)
+{
+	PlyMesh mesh;
+	if (!loadPly(source, mesh) || !cookMesh(source, cooked.c_str()))
+		return false;
+	CookedMesh c;
+	if (!c.open(cooked.c_str(), source))
+		return false;
+	float lo[3], hi[3];
+	mesh.bounds(lo, hi);
+	return c.vertexCount() == mesh.vertexCount() && c.indexCount() == mesh.indices.size() &&
+		   !memcmp(c.vertices(), mesh.vertices.data(), c.vertexBytes()) &&
+		   !memcmp(c.indices(), mesh.indices.data(), c.indexBytes()) && !memcmp(c.boundsMin(), lo, sizeof(lo)) &&
+		   !memcmp(c.boundsMax(), hi, sizeof(hi));
+}
+
+static bool opens(const std::string &cooked, const char *source)
+{
+	CookedMesh c;
+	return c.open(cooked.c_str(), source);
+}
+
+int main()
+{
+	char dirTemplate[] = "/tmp/mesh-cache-test-XXXXXX";
+	if (!mkdtemp(dirTemplate))
+	{
+		fprintf(stderr, "Could not create a temporary directory\n");
+		return 1;
+	}
+	std::string dir = dirTemplate;
+	std::string source = dir + "/quad.ply", cooked = dir + "/quad.mesh";
+
+	int failures = 0;
+	auto check = [&](const char *name, bool ok)
+	{
+		printf("%-34s %s\n", name, ok ? "ok" : "FAIL");
+		failures += !ok;
+	};
+
+	check("write source", writeText(source, testPly));
+	check("round trip", roundTrip(source.c_str(), cooked));
+	{
+		PlyMesh mesh;
+		static const float last[PLY_VERTEX_FLOATS] = {0.5f, 2.0f, -3.0f, 0.0f, 0.0f, 1.0f, 0.5f, 0.25f};
+		static const uint32_t indices[9] = {0, 1, 2, 0, 2, 3, 0, 1, 4};
+		bool ok = loadPly(source.c_str(), mesh) && mesh.vertexCount() == 5 && mesh.indices.size() == 9;
+		ok = ok && !memcmp(&mesh.vertices[4 * PLY_VERTEX_FLOATS], last, sizeof(last));
+		ok = ok && !memcmp(mesh.indices.data(), indices, sizeof(indices));
+		check("parsed vertices and fan indices", ok);
+	}
+
+	// Only the mtime moves: the hash still matches.
+	struct utimbuf times = {1000000000, 1000000000};
+	check("touched source still fresh", utime(source.c_str(), &times) == 0 && opens(cooked, source.c_str()));
+
+	// Same size, different bytes, new mtime: the hash catches it.
+	std::string edited = testPly;
+	edited[edited.size() - 2] = '3';
+	check("edited source is stale", writeText(source, edited.c_str()) && utime(source.c_str(), &times) == 0 &&
+										!opens(cooked, source.c_str()));
+
+	check("recook", roundTrip(source.c_str(), cooked));
+	check("grown source is stale", writeText(source, (edited + "\n").c_str()) && !opens(cooked, source.c_str()));
+	check("missing source still used", unlink(source.c_str()) == 0 && opens(cooked, source.c_str()));
+
+	// Drop the last index.
+	{
+		MappedFile f;
+		std::vector<unsigned char> bytes;
+		if (f.open(cooked.c_str()))
+			bytes.assign(f.data(), f.data() + f.size() - 1);
+		f.close();
+		FILE *out = fopen(cooked.c_str(), "wb");
+		bool written = out && fwrite(bytes.data(), 1, bytes.size(), out) == bytes.size();
+		if (out)
+			fclose(out);
+		check("truncated cooked mesh rejected", written && !bytes.empty() && !opens(cooked, NULL));
+	}
+	check("missing cooked mesh", !opens(dir + "/none.mesh", NULL));
+
+	// The shipped meshes, when run from the repository root.
+	for (const char *asset : {"assets/boat.ply", "assets/head.ply", "assets/eyes.ply"})
+	{
+		if (access(asset, R_OK) != 0)
+			continue;
+		std::string name = std::string("round trip ") + asset;
+		check(name.c_str(), roundTrip(asset, dir + "/asset.mesh"));
+	}
+
+	unlink(cooked.c_str());
+	unlink((dir + "/asset.mesh").c_str());
+	rmdir(dir.c_str());
+	if (failures)
+		fprintf(stderr, "%d mesh cache check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+// Checks SurfaceQuery against brute force: grid points are displaced with
+// gerstnerReference(), and querying the x/z they land on must give back
+// their height and the normal of the reference surface there, with every
+// kernel this CPU can run, with and without a pool. Exits non-zero on a
+// mismatch.
+//
+//   make test
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "SurfaceQuery.hpp"
+
+// Height error allowed: the polynomial sincos plus the query tolerance
+// times the steepest slope.
+#define SURFACE_QUERY_HEIGHT_TOLERANCE 1e-3f
+// Normal error allowed, as the length of the difference of unit vectors.
+#define SURFACE_QUERY_NORMAL_TOLERANCE 5e-3f
+
+static const char *kernelName(WaveField::Kernel k)
+{
+	static const char *names[3] = {"scalar", "sse", "avx2"};
+	return names[k];
+}
+
+// Where grid point (u, v) ends up.
+static void reference(const std::vector<GerstnerWave> &waves, float time, float u, float v, float *p)
+{
+	p[0] = u;
+	p[1] = 0.0f;
+	p[2] = v;
+	gerstnerReference(waves, time, p[0], p[1], p[2]);
+}
+
+int main()
+{
+	struct Case
+	{
+		const char *name;
+		std::vector<GerstnerWave> waves;
+	};
+	std::vector<Case> cases = {{"default", defaultGerstnerWaves()}, {"generated-32", generateSeaState(32)}};
+	const float time = 321.0f;
+	// Not a multiple of any vector width, so the scalar tails run too.
+	const size_t count = 20001;
+
+	ThreadPool pool(4);
+	int failures = 0;
+	for (const Case &c : cases)
+	{
+		// Random grid points, their displaced positions and the reference
+		// normal from central differences over the grid.
+		std::vector<float> qx(count), qz(count), height(count), normal(3 * count);
+		srand(2);
+		for (size_t i = 0; i < count; ++i)
+		{
+			float u = 400.0f * rand() / RAND_MAX - 200.0f;
+			float v = 400.0f * rand() / RAND_MAX - 200.0f;
+			const float h = 1e-2f;
+			float p[3], pu0[3], pu1[3], pv0[3], pv1[3];
+			reference(c.waves, time, u, v, p);
+			reference(c.waves, time, u - h, v, pu0);
+			reference(c.waves, time, u + h, v, pu1);
+			reference(c.waves, time, u, v - h, pv0);
+			reference(c.waves, time, u, v + h, pv1);
+			glm::vec3 du(pu1[0] - pu0[0], pu1[1] - pu0[1], pu1[2] - pu0[2]);
+			glm::vec3 dv(pv1[0] - pv0[0], pv1[1] - pv0[1], pv1[2] - pv0[2]);
+			glm::vec3 n = glm::normalize(glm::cross(dv, du));
+			qx[i] = p[0];
+			qz[i] = p[2];
+			height[i] = p[1];
+			normal[3 * i] = n.x;
+			normal[3 * i + 1] = n.y;
+			normal[3 * i + 2] = n.z;
+		}
+
+		for (int k = WaveField::KERNEL_SCALAR; k <= WaveField::bestKernel(); ++k)
+		{
+			for (int pooled = 0; pooled < 2; ++pooled)
+			{
+				WaveField field(c.waves);
+				field.setKernel((WaveField::Kernel)k);
+				SurfaceQuery query(field, pooled ? &pool : nullptr);
+				query.setTime(time);
+				query.setIterations(8);
+
+				std::vector<float> h(count), nx(count), ny(count), nz(count);
+				SurfaceQueryOutput out;
+				out.height = h.data();
+				out.nx = nx.data();
+				out.ny = ny.data();
+				out.nz = nz.data();
+				size_t misses = query.query(qx.data(), qz.data(), count, out);
+
+				float heightError = 0.0f, normalError = 0.0f;
+				for (size_t i = 0; i < count; ++i)
+				{
+					heightError = std::max(heightError, fabsf(h[i] - height[i]));
+					glm::vec3 d(nx[i] - normal[3 * i], ny[i] - normal[3 * i + 1], nz[i] - normal[3 * i + 2]);
+					normalError = std::max(normalError, glm::length(d));
+				}
+				bool ok = misses == 0 && heightError <= SURFACE_QUERY_HEIGHT_TOLERANCE &&
+						  normalError <= SURFACE_QUERY_NORMAL_TOLERANCE;
+				printf("%-6s %-13s %-7s height %.2e normal %.2e misses %zu %s\n", kernelName((WaveField::Kernel)k), c.name,
+					   pooled ? "pool" : "no pool", heightError, normalError, misses, ok ? "ok" : "FAIL");
+				failures += !ok;
+			}
+		}
+	}
+	if (failures)
+		fprintf(stderr, "%d surface query check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}
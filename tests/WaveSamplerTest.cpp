@@ -0,0 +1,104 @@
+// Checks that ThreadPool::parallelFor() runs every task exactly once on a
+// valid worker slot, and that WaveSampler's tiles put every sample where
+// gerstnerReference() says, for several pool and tile sizes. Exits non-zero
+// on a mismatch.
+//
+//   make test
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "ThreadPool.hpp"
+#include "WaveSampler.hpp"
+
+// Same bound as WaveFieldTest: the polynomial sincos over a sea state.
+#define WAVE_SAMPLER_TOLERANCE 5e-4f
+
+// Runs several batches of count tasks and checks each ran once, with a
+// worker index below numWorkers().
+static bool checkPool(ThreadPool &pool, size_t count)
+{
+	std::unique_ptr<std::atomic<int>[]> runs(new std::atomic<int>[count]);
+	for (int batch = 0; batch < 3; ++batch)
+	{
+		for (size_t i = 0; i < count; ++i)
+			runs[i] = 0;
+		std::atomic<int> badWorker(0);
+		pool.parallelFor(count, [&](size_t i, unsigned worker)
+						 {
+			runs[i]++;
+			if (worker >= pool.numWorkers())
+				badWorker++; });
+		for (size_t i = 0; i < count; ++i)
+			if (runs[i] != 1 || badWorker)
+				return false;
+	}
+	return true;
+}
+
+// Samples region into rows padded to stride and returns the largest
+// difference from the reference on any axis, or INFINITY if the padding was
+// written.
+static float maxError(ThreadPool &pool, int tileSize, const WaveField &field, const WaveSampleRegion &region,
+					  size_t stride, float time)
+{
+	const float pad = -12345.0f;
+	std::vector<float> x(region.nx * stride, pad), y(region.nx * stride, pad), z(region.nx * stride, pad);
+	WaveSampleOutput out;
+	out.outX = x.data();
+	out.outY = y.data();
+	out.outZ = z.data();
+	out.rowStride = stride;
+	WaveSampler sampler(pool, tileSize);
+	sampler.sample(field, time, region, out);
+
+	float error = 0.0f;
+	for (int i = 0; i < region.nx; ++i)
+	{
+		for (size_t j = 0; j < stride; ++j)
+		{
+			size_t k = i * stride + j;
+			if (j >= (size_t)region.nz)
+			{
+				if (x[k] != pad || y[k] != pad || z[k] != pad)
+					return INFINITY;
+				continue;
+			}
+			float rx = region.xmin + i * region.dx(), ry = 0.0f, rz = region.zmin + j * region.dz();
+			gerstnerReference(field.getWaves(), time, rx, ry, rz);
+			error = std::max(error, std::max(fabsf(x[k] - rx), std::max(fabsf(y[k] - ry), fabsf(z[k] - rz))));
+		}
+	}
+	return error;
+}
+
+int main()
+{
+	int failures = 0;
+	WaveField field(generateSeaState(16));
+	// Sizes that leave partial tiles on both axes.
+	WaveSampleRegion region = {-40.0f, 25.0f, -10.0f, 60.0f, 131, 97};
+
+	for (unsigned threads : {1u, 2u, 4u})
+	{
+		ThreadPool pool(threads);
+		bool ok = checkPool(pool, 1) && checkPool(pool, 1000);
+		printf("pool   %u threads            %s\n", threads, ok ? "ok" : "FAIL");
+		failures += !ok;
+
+		for (int tileSize : {16, 64})
+		{
+			float error = maxError(pool, tileSize, field, region, region.nz + 3, 77.0f);
+			ok = error <= WAVE_SAMPLER_TOLERANCE;
+			printf("sample %u threads, tile %-3d max error %.2e %s\n", threads, tileSize, error, ok ? "ok" : "FAIL");
+			failures += !ok;
+		}
+	}
+	if (failures)
+		fprintf(stderr, "%d sampler check(s) failed\n", failures);
+	return failures ? 1 : 0;
+}